@@ -9,6 +9,16 @@
 #include "config.h"
 #include "utils/storage.h"
 #include "utils/share.h"
+#include "utils/trash.h"
+#include "utils/xmove.h"
+#include "utils/backup.h"
+#include "utils/fileindex.h"
+#include "utils/bufpool.h"
+#include "utils/deltasave.h"
+#include "utils/notecodec.h"
+#if STORAGE_BENCH
+#include "utils/storagebench.h"
+#endif
 
 // For readability in AppManager context
 using SDHelper = StorageHelper;
@@ -20,11 +30,13 @@ using SDHelper = StorageHelper;
 class AppManager {
 private:
     static constexpr size_t IMAGE_GALLERY_MAX_ITEMS = 128;
+    static constexpr size_t READ_CHUNK = 8192;
     static constexpr size_t IMAGE_GALLERY_SCAN_ENTRY_LIMIT = 80;
     static constexpr size_t IMAGE_GALLERY_SCAN_IMAGE_LIMIT = 64;
     AppMode current_mode;
     FileManager file_manager;
     Editor editor;
+    DeltaSaver note_saver;
     ImageViewer image_viewer;
     MenuManager menu_manager;
     SDHelper* sd_helper;
@@ -42,14 +54,13 @@ public:
     }
     
     void init() {
+        // SD is mounted later from update() so boot never waits on card init.
         sd_helper = SDHelper::getInstance();
-        bool sd_ok = sd_helper && sd_helper->begin();
-        if (!sd_ok) Serial.println("[SD] unavailable, D: disabled");
         ap_share.init(sd_helper);
         
         // Create UI components
         file_manager.create(
-            sd_ok,
+            false,
             [this](const char* name){
                 String path = String(name ? name : "");
                 if (isImageFile(path)) this->showImage(path);
@@ -66,6 +77,13 @@ public:
             [this](){ this->showNextImage(); }
         );
         menu_manager.create();
+#if STORAGE_BENCH
+        StorageBench::getInstance()->setNoteIo(
+            [this](const String& vpath, const char* data, size_t len) { return this->writeVirtualFile(vpath, data, len); },
+            [this](const String& vpath, String& out) { return this->readVirtualFile(vpath, out); },
+            [this](const String& src, const String& dst) { return this->file_manager.copyFileNow(src, dst); }
+        );
+#endif
         
         // Show file manager initially
         showFileManager();
@@ -96,7 +114,14 @@ private:
         editor.setTitle(filename);
         editor.setText("");
         String content;
-        if (readVirtualFile(filename, content)) editor.setText(content);
+        if (readVirtualFile(filename, content)) {
+            editor.setText(content);
+            content = "";
+            const char* text = editor.getTextPtr();
+            note_saver.track(filename, text, strlen(text));
+        } else {
+            note_saver.invalidate();
+        }
 
         editor.show(LV_SCR_LOAD_ANIM_FADE_IN);
     }
@@ -115,6 +140,28 @@ public:
     void update() {
         // Avoid AP share FS polling while heavy file operations are running.
         if (!file_manager.isFsBusy()) ap_share.update();
+        // SD hot-plug and background free-space count; only when no SD file is open.
+        if (!file_manager.isFsBusy() && !ap_share.isUploading()) {
+            SdMountEvent ev = sd_helper ? sd_helper->pollPresence() : SD_MOUNT_NONE;
+            if (ev == SD_MOUNT_REMOVED) {
+                TrashBin::getInstance()->onSdRemoved();
+                NoteBackup::getInstance()->onSdRemoved();
+                FileIndex::getInstance()->onSdRemoved();
+            }
+            if (ev != SD_MOUNT_NONE) file_manager.setSdAvailable(ev == SD_MOUNT_INSERTED);
+            SdSpaceTracker::getInstance()->step();
+            TrashBin::getInstance()->step(lv_display_get_inactive_time(nullptr) >= TRASH_IDLE_MS);
+            CrossDriveMove::getInstance()->stepBackground(sd_helper && sd_helper->isInitialized());
+            NoteBackup::getInstance()->step(
+                lv_display_get_inactive_time(nullptr) >= BACKUP_IDLE_MS && !CrossDriveMove::getInstance()->isActive(),
+                sd_helper && sd_helper->isInitialized());
+            FileIndex::getInstance()->step(lv_display_get_inactive_time(nullptr) >= INDEX_IDLE_MS);
+            file_manager.pollFsUsage();
+            file_manager.pollPrefetch();
+#if STORAGE_BENCH
+            StorageBench::getInstance()->poll();
+#endif
+        }
 
         // Check menu actions
         MenuAction action = menu_manager.getLastAction();
@@ -146,18 +193,28 @@ public:
         if (current_filename.isEmpty()) {
             current_filename = "L:/note.txt";
         }
-        String content = editor.getText();
+        const char* text = editor.getTextPtr();
+        size_t len = strlen(text);
+        uint32_t t0 = millis();
+        size_t from = 0;
+        bool delta = !wantsCompression(current_filename, len) &&
+                     note_saver.plan(current_filename, text, len, editor.dirtyByteOffset(), from);
         uint64_t old_size = 0;
-        bool had_old = getVirtualFileSize(current_filename, old_size);
-        if (writeVirtualFile(current_filename, content)) {
-            uint64_t new_size = 0;
-            bool has_new = getVirtualFileSize(current_filename, new_size);
-            if (!has_new) new_size = (uint64_t)content.length();
+        bool had_old = delta ? true : getVirtualFileSize(current_filename, old_size);
+        if (delta) old_size = note_saver.trackedSize();
+        bool ok = delta ? note_saver.writeTail(current_filename, text, len, from)
+                        : writeVirtualFile(current_filename, text, len);
+        if (ok) {
+            if (!delta) note_saver.track(current_filename, text, len);
+            if (!had_old) FileIndex::getInstance()->noteAdded(driveOf(current_filename), innerPathOf(current_filename));
+            editor.markClean();
             String from_h = had_old ? formatBytesHuman(old_size) : "0 B";
-            String to_h = formatBytesHuman(new_size);
+            String to_h = formatBytesHuman((uint64_t)len);
             editor.showSaveSuccessPopup(fileNameOf(current_filename), from_h, to_h);
-            Serial.println("File saved: " + current_filename);
+            Serial.printf("File saved: %s (%s from %u, %lu ms)\n", current_filename.c_str(), delta ? "delta" : "full",
+                          (unsigned)(delta ? from : 0), (unsigned long)(millis() - t0));
         } else {
+            note_saver.invalidate();
             Serial.println("Save failed!");
         }
     }
@@ -215,30 +272,36 @@ private:
         if (drive == 'L') {
             File f = LittleFS.open(path.c_str(), "r");
             if (!f) return false;
-            out = "";
-            size_t file_size = (size_t)f.size();
-            if (file_size > 0) out.reserve(file_size + 1);
-            static constexpr size_t CHUNK = 1024;
-            char buf[CHUNK + 1];
-            while (true) {
-                int n = f.read((uint8_t*)buf, CHUNK);
-                if (n <= 0) break;
-                buf[n] = '\0';
-                if (!out.concat(buf, (unsigned int)n)) {
-                    f.close();
-                    return false;
-                }
-            }
+            bool ok = NoteCodec::readAll(f, (size_t)f.size(), out);
             f.close();
-            return true;
+            return ok;
         }
         if (drive == 'D' && sd_helper && sd_helper->isInitialized()) {
-            return sd_helper->readFile(path.c_str(), out);
+            FsFile f = sd_helper->getFs().open(path.c_str(), O_RDONLY);
+            if (!f.isOpen()) return false;
+            bool ok = NoteCodec::readAll(f, (size_t)f.fileSize(), out);
+            f.close();
+            return ok;
         }
         return false;
     }
 
+    bool wantsCompression(const String& vpath, size_t len) const {
+        return LFS_COMPRESS_NOTES && driveOf(vpath) == 'L' && len >= LFS_COMPRESS_MIN_BYTES;
+    }
+
     bool writeVirtualFile(const String& vpath, const String& data) {
+        return writeVirtualFile(vpath, data.c_str(), data.length());
+    }
+
+    // Listings are invalidated after the write, so one read meanwhile is not kept.
+    bool writeVirtualFile(const String& vpath, const char* data, size_t len) {
+        bool ok = storeVirtualFile(vpath, data, len);
+        DirListingCache::getInstance()->invalidatePath(String(driveOf(vpath)) + ":" + innerPathOf(vpath));
+        return ok;
+    }
+
+    bool storeVirtualFile(const String& vpath, const char* data, size_t len) {
         char drive = driveOf(vpath);
         String path = innerPathOf(vpath);
         if (drive == 'L') {
@@ -246,14 +309,26 @@ private:
             if (parent.length() > 0 && !LittleFS.exists(parent.c_str())) {
                 LittleFS.mkdir(parent.c_str());
             }
+            if (wantsCompression(vpath, len)) {
+                // Keep the compressed copy only if it saves at least 1/8.
+                String tmp = path + ".~z";
+                uint32_t t0 = millis();
+                size_t stored = NoteCodec::writeFile(tmp.c_str(), data, len);
+                if (stored > 0 && stored * 8 < len * 7 && LittleFS.rename(tmp.c_str(), path.c_str())) {
+                    Serial.printf("[LZ] %s %u -> %u bytes, %lu ms\n", path.c_str(), (unsigned)len, (unsigned)stored,
+                                  (unsigned long)(millis() - t0));
+                    return true;
+                }
+                LittleFS.remove(tmp.c_str());
+            }
             File f = LittleFS.open(path.c_str(), "w");
             if (!f) return false;
-            size_t w = f.write((const uint8_t*)data.c_str(), data.length());
+            size_t w = f.write((const uint8_t*)data, len);
             f.close();
-            return w == data.length();
+            return w == len;
         }
         if (drive == 'D' && sd_helper && sd_helper->isInitialized()) {
-            return sd_helper->writeFile(path.c_str(), data);
+            return sd_helper->writeFile(path.c_str(), data, len);
         }
         return false;
     }
@@ -393,19 +468,16 @@ private:
         size_t scanned = 0;
 
         if (drive == 'L') {
-            File d = LittleFS.open(dir.c_str(), "r");
-            if (d) {
-                while (true) {
-                    File e = d.openNextFile();
-                    if (!e) break;
+            LfsDirIter d(dir);
+            if (d.isOpen()) {
+                String name;
+                bool is_dir = false;
+                while (d.next(name, is_dir)) {
                     scanned++;
-                    if (e.isDirectory()) {
-                        e.close();
+                    if (is_dir) {
                         if (scanned >= IMAGE_GALLERY_SCAN_ENTRY_LIMIT) break;
                         continue;
                     }
-                    String name = String(e.name());
-                    e.close();
                     if (!isImageFile(name)) continue;
                     String full = dir;
                     if (!full.endsWith("/")) full += "/";
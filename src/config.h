@@ -18,9 +18,146 @@
 #define SD_CS 5
 #define SD_SPI_SPEED 25000000
 #define SD_ALLOW_FALLBACK_SPEEDS 0
+// Benchmark candidate SPI clocks once per card (keyed by CID) and keep the fastest
+// clock that reads back identical data; the result is stored in NVS ("sdtune").
+#ifndef SD_AUTO_TUNE
+#define SD_AUTO_TUNE 1
+#endif
 #define SD_SCK 14
 #define SD_MISO 12
 #define SD_MOSI 13
+// LRU cache of FAT/directory sectors under SdFat (x512 bytes of heap). 0 disables.
+// Needs -DUSE_BLOCK_DEVICE_INTERFACE=1 (set in platformio.ini).
+#ifndef SD_SECTOR_CACHE_SECTORS
+#define SD_SECTOR_CACHE_SECTORS 16
+#endif
+
+// SD hot-plug: presence probe / removal check interval while idle.
+#ifndef SD_PRESENCE_POLL_MS
+#define SD_PRESENCE_POLL_MS 1000
+#endif
+// Periodic background recount of SD free clusters (catches changes made elsewhere).
+#ifndef SD_SPACE_RESYNC_MS
+#define SD_SPACE_RESYNC_MS (10UL * 60UL * 1000UL)
+#endif
+
+// Shared I/O scratch buffers: a lease must leave this much in the largest free heap
+// block, and released buffers up to SCRATCH_KEEP_MAX bytes stay cached for reuse.
+#ifndef SCRATCH_HEAP_RESERVE
+#define SCRATCH_HEAP_RESERVE (16UL * 1024UL)
+#endif
+#ifndef SCRATCH_KEEP_MAX
+#define SCRATCH_KEEP_MAX 4096
+#endif
+
+// Optional LZSS compression of notes saved to L: (files >= LFS_COMPRESS_MIN_BYTES).
+// Compressed notes are decoded transparently on open, on share download, and whenever
+// they leave L: (copy, move, backup to D:).
+#ifndef LFS_COMPRESS_NOTES
+#define LFS_COMPRESS_NOTES 0
+#endif
+#ifndef LFS_COMPRESS_MIN_BYTES
+#define LFS_COMPRESS_MIN_BYTES 1024
+#endif
+
+// Storage benchmark over serial ("bench", "bench L", "bench D"); CSV on Serial.
+// Built in by the esp32-2432s028r-bench environment.
+#ifndef STORAGE_BENCH
+#define STORAGE_BENCH 0
+#endif
+#ifndef STORAGE_BENCH_DIR
+#define STORAGE_BENCH_DIR "/.bench"
+#endif
+
+// Directory listing cache (per-directory LRU, bounded by dirs and total entries)
+#ifndef LISTING_CACHE_MAX_DIRS
+#define LISTING_CACHE_MAX_DIRS 8
+#endif
+#ifndef LISTING_CACHE_MAX_ITEMS
+#define LISTING_CACHE_MAX_ITEMS 1500
+#endif
+// Parent folders remembered (scroll offset, selection) while browsing down; their
+// listings stay pinned in the cache. Keep below LISTING_CACHE_MAX_DIRS.
+#ifndef NAV_BACK_DEPTH
+#define NAV_BACK_DEPTH 6
+#endif
+// While a folder is on screen, list the selected subfolder and the first few others
+// into the cache once the UI has been idle for PREFETCH_DELAY_MS. L: runs on the
+// worker; D: steps PREFETCH_SD_CHUNKS 1 KB directory chunks per loop on the UI task.
+#ifndef PREFETCH_ENABLED
+#define PREFETCH_ENABLED 1
+#endif
+#ifndef PREFETCH_DELAY_MS
+#define PREFETCH_DELAY_MS 400
+#endif
+#ifndef PREFETCH_MAX_DIRS
+#define PREFETCH_MAX_DIRS 3
+#endif
+#ifndef PREFETCH_SD_CHUNKS
+#define PREFETCH_SD_CHUNKS 2
+#endif
+
+// Force delete renames into /.trash on the same drive; entries are purged while idle
+// once over the count or age limit, and right after a delete that leaves the drive
+// below the free-space floor.
+// Age counts powered-on minutes (no RTC), persisted in NVS ("trash").
+#ifndef TRASH_ENABLED
+#define TRASH_ENABLED 1
+#endif
+#ifndef TRASH_MAX_ENTRIES
+#define TRASH_MAX_ENTRIES 32
+#endif
+#ifndef TRASH_MAX_AGE_MIN
+#define TRASH_MAX_AGE_MIN (3UL * 24UL * 60UL)
+#endif
+#ifndef TRASH_MIN_FREE_PCT
+#define TRASH_MIN_FREE_PCT 20
+#endif
+#ifndef TRASH_IDLE_MS
+#define TRASH_IDLE_MS 3000
+#endif
+
+// Background backup of L: into BACKUP_DIR on D: (current/ mirror, vNNNNN/ old copies,
+// manifest.txt). Runs while idle, at most once per interval; only changed files are copied.
+#ifndef BACKUP_ENABLED
+#define BACKUP_ENABLED 1
+#endif
+#ifndef BACKUP_DIR
+#define BACKUP_DIR "/CYDnote-backup"
+#endif
+#ifndef BACKUP_INTERVAL_MS
+#define BACKUP_INTERVAL_MS (30UL * 60UL * 1000UL)
+#endif
+#ifndef BACKUP_IDLE_MS
+#define BACKUP_IDLE_MS 5000
+#endif
+#ifndef BACKUP_KEEP_VERSIONS
+#define BACKUP_KEEP_VERSIONS 8
+#endif
+
+// Filename search: per-drive index in /INDEX_DIR_NAME, kept current by the file manager's
+// own operations and uploads. Rebuilt while idle when missing, after INDEX_MAX_RULES
+// removals, and (D:) when a mounted card no longer matches the stamp saved with its
+// index (volume serial + exact free-cluster count), i.e. a PC changed it.
+#ifndef INDEX_ENABLED
+#define INDEX_ENABLED 1
+#endif
+#ifndef INDEX_DIR_NAME
+#define INDEX_DIR_NAME ".index"
+#endif
+#define INDEX_DIR "/" INDEX_DIR_NAME
+#ifndef INDEX_IDLE_MS
+#define INDEX_IDLE_MS 2000
+#endif
+#ifndef INDEX_MAX_RULES
+#define INDEX_MAX_RULES 128
+#endif
+#ifndef INDEX_VERIFY_ON_MOUNT
+#define INDEX_VERIFY_ON_MOUNT 1
+#endif
+#ifndef SEARCH_MAX_RESULTS
+#define SEARCH_MAX_RESULTS 300
+#endif
 
 // Backlight / status LED
 #define TFT_BACKLIGHT_PIN 21
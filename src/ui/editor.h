@@ -6,6 +6,7 @@
 #include <string.h>
 #include "../config.h"
 #include "fonts.h"
+#include "theme.h"
 #include "../ime/pinyin.h"
 
 class Editor {
@@ -47,6 +48,7 @@ private:
     bool ime_font_acquired;
     uint32_t ime_cursor_anchor_pos;
     bool ime_cursor_anchor_valid;
+    uint32_t dirty_char_from;  // earliest edited character since load/save; UINT32_MAX if clean
     String current_file;
     std::function<void()> on_exit_cb;
     std::function<void()> on_save_cb;
@@ -56,7 +58,7 @@ public:
                keyboard(nullptr), ime_container(nullptr), ime_cand_proxy(nullptr), ime_cand_src(nullptr), ime_btn(nullptr), title_wrap(nullptr), title_label(nullptr), top_btn(nullptr),
                save_popup(nullptr), save_popup_timer(nullptr),
                ime_cand_syncing(false), ime_is_k9_mode(false), ime_cand_count(0), ime_cand_page(0),
-               ime_visible(false), large_doc_mode(false), ime_font_acquired(false), ime_cursor_anchor_pos(0), ime_cursor_anchor_valid(false),
+               ime_visible(false), large_doc_mode(false), ime_font_acquired(false), ime_cursor_anchor_pos(0), ime_cursor_anchor_valid(false), dirty_char_from(UINT32_MAX),
                current_file(""), on_exit_cb(nullptr), on_save_cb(nullptr) {
         memset(ime_compose, 0, sizeof(ime_compose));
         memset(ime_cands, 0, sizeof(ime_cands));
@@ -101,12 +103,11 @@ public:
 
         lv_obj_t* exit_btn = lv_btn_create(left_wrap);
         lv_obj_set_size(exit_btn, 28, 26);
-        styleActionButton(exit_btn);
+        Theme::actionButton(exit_btn);
         lv_obj_add_event_cb(exit_btn, exit_btn_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* exit_label = lv_label_create(exit_btn);
         lv_label_set_text(exit_label, LV_SYMBOL_LEFT);
-        lv_obj_set_style_text_font(exit_label, FontManager::iconFont(), 0);
-        lv_obj_set_style_text_color(exit_label, lv_color_hex(0xFFFFFF), 0);
+        Theme::iconLabel(exit_label);
         lv_obj_center(exit_label);
 
         title_wrap = lv_obj_create(toolbar);
@@ -142,32 +143,29 @@ public:
 
         top_btn = lv_btn_create(right_wrap);
         lv_obj_set_size(top_btn, 28, 26);
-        styleActionButton(top_btn);
+        Theme::actionButton(top_btn);
         lv_obj_add_event_cb(top_btn, top_btn_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* top_label = lv_label_create(top_btn);
         lv_label_set_text(top_label, LV_SYMBOL_UP);
-        lv_obj_set_style_text_font(top_label, FontManager::iconFont(), 0);
-        lv_obj_set_style_text_color(top_label, lv_color_hex(0xFFFFFF), 0);
+        Theme::iconLabel(top_label);
         lv_obj_center(top_label);
 
         lv_obj_t* save_btn = lv_btn_create(right_wrap);
         lv_obj_set_size(save_btn, 28, 26);
-        styleActionButton(save_btn);
+        Theme::actionButton(save_btn);
         lv_obj_add_event_cb(save_btn, save_btn_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* save_label = lv_label_create(save_btn);
         lv_label_set_text(save_label, LV_SYMBOL_SAVE);
-        lv_obj_set_style_text_font(save_label, FontManager::iconFont(), 0);
-        lv_obj_set_style_text_color(save_label, lv_color_hex(0xFFFFFF), 0);
+        Theme::iconLabel(save_label);
         lv_obj_center(save_label);
 
         ime_btn = lv_btn_create(right_wrap);
         lv_obj_set_size(ime_btn, 28, 26);
-        styleActionButton(ime_btn);
+        Theme::actionButton(ime_btn);
         lv_obj_add_event_cb(ime_btn, ime_btn_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* ime_label = lv_label_create(ime_btn);
         lv_label_set_text(ime_label, LV_SYMBOL_KEYBOARD);
-        lv_obj_set_style_text_font(ime_label, FontManager::iconFont(), 0);
-        lv_obj_set_style_text_color(ime_label, lv_color_hex(0xFFFFFF), 0);
+        Theme::iconLabel(ime_label);
         lv_obj_center(ime_label);
 
         textarea = lv_textarea_create(screen);
@@ -194,6 +192,8 @@ public:
         lv_obj_set_style_height(textarea, editor_cursor_h, LV_PART_CURSOR);
         lv_obj_add_event_cb(textarea, textarea_cursor_anchor_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_add_event_cb(textarea, textarea_cursor_anchor_event_cb, LV_EVENT_VALUE_CHANGED, this);
+        lv_obj_add_event_cb(textarea, textarea_dirty_event_cb, LV_EVENT_INSERT, this);
+        lv_obj_add_event_cb(textarea, textarea_dirty_event_cb, LV_EVENT_VALUE_CHANGED, this);
         ime_cursor_anchor_pos = lv_textarea_get_cursor_pos(textarea);
         ime_cursor_anchor_valid = true;
 
@@ -212,36 +212,13 @@ public:
         ime = lv_ime_pinyin_create(ime_container);
         lv_obj_set_width(ime, lv_pct(100));
         lv_obj_set_height(ime, IME_CANDIDATE_H);
-        lv_obj_set_style_bg_color(ime, lv_color_hex(0x000000), 0);
-        lv_obj_set_style_text_color(ime, lv_color_hex(0xFFFFFF), 0);
-        lv_obj_set_style_bg_color(ime, lv_color_hex(0x111111), LV_PART_ITEMS);
-        lv_obj_set_style_text_color(ime, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_DEFAULT);
-        lv_obj_set_style_text_color(ime, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_FOCUSED);
-        lv_obj_set_style_text_color(ime, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_PRESSED);
-        lv_obj_set_style_text_color(ime, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_CHECKED);
         lv_obj_set_style_text_font(ime, FontManager::imeFont(), LV_PART_MAIN);
         lv_obj_set_style_text_font(ime, FontManager::imeFont(), LV_PART_ITEMS);
 
         keyboard = lv_keyboard_create(ime_container);
         lv_obj_set_width(keyboard, lv_pct(100));
         lv_obj_set_height(keyboard, IME_KEYBOARD_H);
-        lv_obj_set_style_bg_color(keyboard, lv_color_hex(0x000000), 0);
-        lv_obj_set_style_text_color(keyboard, lv_color_hex(0xFFFFFF), 0);
-        lv_obj_set_style_bg_color(keyboard, lv_color_hex(0x1A1A1A), LV_PART_ITEMS | LV_STATE_DEFAULT);
-        lv_obj_set_style_bg_color(keyboard, lv_color_hex(0x222222), LV_PART_ITEMS | LV_STATE_FOCUSED);
-        lv_obj_set_style_bg_color(keyboard, lv_color_hex(0x2A2A2A), LV_PART_ITEMS | LV_STATE_PRESSED);
-        lv_obj_set_style_bg_color(keyboard, lv_color_hex(0x202020), LV_PART_ITEMS | LV_STATE_CHECKED);
-        lv_obj_set_style_bg_color(keyboard, lv_color_hex(0x111111), LV_PART_ITEMS | LV_STATE_DISABLED);
-        lv_obj_set_style_text_color(keyboard, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_DEFAULT);
-        lv_obj_set_style_text_color(keyboard, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_FOCUSED);
-        lv_obj_set_style_text_color(keyboard, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_PRESSED);
-        lv_obj_set_style_text_color(keyboard, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_CHECKED);
-        lv_obj_set_style_text_color(keyboard, lv_color_hex(0xB8B8B8), LV_PART_ITEMS | LV_STATE_DISABLED);
-        lv_obj_set_style_border_color(keyboard, lv_color_hex(0x303030), LV_PART_ITEMS | LV_STATE_DEFAULT);
-        lv_obj_set_style_border_color(keyboard, lv_color_hex(0x3A3A3A), LV_PART_ITEMS | LV_STATE_FOCUSED);
-        lv_obj_set_style_border_color(keyboard, lv_color_hex(0x4A4A4A), LV_PART_ITEMS | LV_STATE_PRESSED);
-        lv_obj_set_style_border_color(keyboard, lv_color_hex(0x3A3A3A), LV_PART_ITEMS | LV_STATE_CHECKED);
-        lv_obj_set_style_border_color(keyboard, lv_color_hex(0x242424), LV_PART_ITEMS | LV_STATE_DISABLED);
+        Theme::keyboard(keyboard);
         lv_obj_set_style_text_font(keyboard, FontManager::imeFont(), LV_PART_MAIN);
         lv_obj_set_style_text_font(keyboard, FontManager::imeFont(), LV_PART_ITEMS);
         lv_keyboard_set_textarea(keyboard, textarea);
@@ -256,24 +233,7 @@ public:
         lv_ime_pinyin_set_keyboard(ime, keyboard);
         lv_ime_pinyin_set_dict(ime, g_pinyin_dict_plus);
         lv_ime_pinyin_set_mode(ime, LV_IME_PINYIN_MODE_K26);
-        lv_obj_t* cand_panel = lv_ime_pinyin_get_cand_panel(ime);
-        if (cand_panel) {
-            lv_obj_set_style_bg_color(cand_panel, lv_color_hex(0x000000), LV_PART_MAIN);
-            lv_obj_set_style_bg_color(cand_panel, lv_color_hex(0x111111), LV_PART_ITEMS | LV_STATE_DEFAULT);
-            lv_obj_set_style_bg_color(cand_panel, lv_color_hex(0x1A1A1A), LV_PART_ITEMS | LV_STATE_FOCUSED);
-            lv_obj_set_style_bg_color(cand_panel, lv_color_hex(0x202020), LV_PART_ITEMS | LV_STATE_PRESSED);
-            lv_obj_set_style_bg_color(cand_panel, lv_color_hex(0x151515), LV_PART_ITEMS | LV_STATE_CHECKED);
-            lv_obj_set_style_bg_opa(cand_panel, LV_OPA_TRANSP, LV_PART_MAIN);
-            lv_obj_set_style_bg_opa(cand_panel, LV_OPA_TRANSP, LV_PART_ITEMS);
-            lv_obj_set_style_border_width(cand_panel, 0, LV_PART_MAIN);
-            lv_obj_set_style_border_width(cand_panel, 0, LV_PART_ITEMS);
-            lv_obj_set_style_text_color(cand_panel, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
-            lv_obj_set_style_text_color(cand_panel, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_DEFAULT);
-            lv_obj_set_style_text_color(cand_panel, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_FOCUSED);
-            lv_obj_set_style_text_color(cand_panel, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_PRESSED);
-            lv_obj_set_style_text_color(cand_panel, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_CHECKED);
-            lv_obj_set_style_text_color(cand_panel, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_DISABLED);
-        }
+        Theme::imeCandidates(ime, lv_ime_pinyin_get_cand_panel(ime));
         applyIMEFonts();
 
         lv_obj_add_flag(ime_container, LV_OBJ_FLAG_HIDDEN);
@@ -322,6 +282,7 @@ public:
         applyLargeDocPerfMode(content.length());
         lv_textarea_set_text(textarea, content.c_str());
         moveCursorAndViewToStart();
+        markClean();
     }
 
     String getText() {
@@ -329,6 +290,25 @@ public:
         return "";
     }
 
+    // Textarea buffer without a copy; valid until the next edit.
+    const char* getTextPtr() const {
+        return textarea ? lv_textarea_get_text(textarea) : "";
+    }
+
+    void markClean() { dirty_char_from = UINT32_MAX; }
+
+    // Byte offset of the earliest edit since load/save; SIZE_MAX if clean.
+    size_t dirtyByteOffset() const {
+        if (dirty_char_from == UINT32_MAX) return SIZE_MAX;
+        const char* p = getTextPtr();
+        size_t off = 0;
+        for (uint32_t ch = 0; ch < dirty_char_from && p[off]; ch++) {
+            off++;
+            while ((p[off] & 0xC0) == 0x80) off++;  // UTF-8 continuation bytes
+        }
+        return off;
+    }
+
     void setTitle(const String& filename) {
         current_file = filename;
         if (!title_label) return;
@@ -414,17 +394,6 @@ private:
         ed->closeSavePopup();
     }
 
-    void styleActionButton(lv_obj_t* btn) {
-        lv_obj_set_style_radius(btn, 4, 0);
-        lv_obj_set_style_bg_color(btn, lv_color_hex(0x1E1E1E), LV_STATE_DEFAULT);
-        lv_obj_set_style_bg_color(btn, lv_color_hex(0x5CB8FF), LV_STATE_PRESSED);
-        lv_obj_set_style_bg_color(btn, lv_color_hex(0x8ED1FF), LV_STATE_FOCUSED);
-        lv_obj_set_style_border_color(btn, lv_color_hex(0x404040), LV_STATE_DEFAULT);
-        lv_obj_set_style_border_color(btn, lv_color_hex(0x8ED1FF), LV_STATE_PRESSED);
-        lv_obj_set_style_border_color(btn, lv_color_hex(0x8ED1FF), LV_STATE_FOCUSED);
-        lv_obj_set_style_text_color(btn, lv_color_hex(0xFFFFFF), 0);
-        lv_obj_set_style_shadow_width(btn, 0, 0);
-    }
 
     void setIMEVisible(bool visible) {
         ime_visible = visible;
@@ -507,6 +476,15 @@ private:
         ed->ime_cursor_anchor_valid = true;
     }
 
+    // INSERT fires before the text lands (cursor at the insertion point); VALUE_CHANGED
+    // after deletes leaves the cursor at the deleted position.
+    static void textarea_dirty_event_cb(lv_event_t* e) {
+        Editor* ed = (Editor*)lv_event_get_user_data(e);
+        if (!ed || !ed->textarea) return;
+        uint32_t pos = lv_textarea_get_cursor_pos(ed->textarea);
+        if (pos < ed->dirty_char_from) ed->dirty_char_from = pos;
+    }
+
     static void exit_btn_event_cb(lv_event_t* e) {
         Editor* ed = (Editor*)lv_event_get_user_data(e);
         if (!ed) return;
@@ -3,7 +3,10 @@
 
 #include <Arduino.h>
 #include <LittleFS.h>
+#include <algorithm>
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <vector>
 #include <cctype>
 #include <string.h>
@@ -11,7 +14,18 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include "../utils/storage.h"
+#include "../utils/listing.h"
+#include "../utils/dirscan.h"
+#include "../utils/lfsdir.h"
+#include "../utils/sddelete.h"
+#include "../utils/trash.h"
+#include "../utils/jobs.h"
+#include "../utils/xmove.h"
+#include "../utils/fileindex.h"
+#include "../utils/bufpool.h"
+#include "../utils/notecodec.h"
 #include "fonts.h"
+#include "theme.h"
 #include "../ime/pinyin.h"
 
 class FileManager {
@@ -25,8 +39,17 @@ private:
     static constexpr int32_t INPUT_TEXT_SIZE_PX = 14;
     static constexpr int32_t IME_TOTAL_H_FALLBACK = IME_CANDIDATE_H + IME_KEYBOARD_H;
     static constexpr uint8_t IME_PROXY_CAND_MAX = 20;
-    static constexpr size_t COPY_IO_CHUNK = 24576;
+    static constexpr size_t COPY_IO_CHUNK = 32768;      // preferred lease; smaller when memory is tight
+    static constexpr size_t COPY_FILE_CHUNK = 16384;    // per-file copies (worker / directory walks)
     static constexpr uint8_t COPY_CHUNKS_PER_TICK = 12;
+    static constexpr uint16_t SD_DELETE_OPS_PER_TICK = 32;
+    static constexpr uint32_t XMOVE_BYTES_PER_TICK = 16384;
+    static constexpr uint8_t LIST_ROW_MARGIN = 3;       // pooled rows kept above/below the viewport
+    static constexpr int32_t LIST_ROW_GAP = 1;
+    static constexpr size_t SCAN_FIRST_BATCH = 16;       // entries before the first publish
+    static constexpr size_t SCAN_PUBLISH_MAX = 1024;     // later publishes double up to this
+    static constexpr uint16_t SD_SCAN_CHUNKS_PER_TICK = 8;  // 1 KB directory chunks per step
+    static constexpr uint32_t SEARCH_STEP_MS = 12;       // index reading per search tick
     enum FsWorkerJobType {
         FS_WORK_NONE = 0,
         FS_WORK_COPY_DIR = 1,
@@ -36,6 +59,46 @@ private:
         FS_WORK_CREATE_DIR = 5,
         FS_WORK_RENAME = 6,
         FS_WORK_SCAN_DIR = 7,
+        FS_WORK_COPY_BATCH = 8,
+        FS_WORK_PREFETCH = 9,
+    };
+    enum ListSortOrder : uint8_t {
+        SORT_BY_NAME = 0,
+        SORT_BY_SIZE = 1,   // largest first
+        SORT_BY_MTIME = 2,  // newest first
+    };
+    // Folders first, then the chosen order; ties fall back to the name order.
+    struct EntryOrder {
+        uint8_t order;
+        explicit EntryOrder(uint8_t o) : order(o) {}
+        bool operator()(const EntryView& a, const EntryView& b) const {
+            if (a.is_dir != b.is_dir) return a.is_dir;
+            if (order == SORT_BY_SIZE && a.size != b.size) return a.size > b.size;
+            if (order == SORT_BY_MTIME && a.mtime != b.mtime) return a.mtime > b.mtime;
+            return NameCollation::less(a, b);
+        }
+    };
+    // One planned copy/move: destination chosen up front, is_dir from the listing.
+    struct BatchItem {
+        String src;
+        String dst;
+        bool is_dir;
+        BatchItem() : is_dir(false) {}
+        BatchItem(const String& s, const String& d, bool dir) : src(s), dst(d), is_dir(dir) {}
+    };
+    struct FsJob {
+        uint32_t id;
+        uint8_t priority;
+        FsWorkerJobType type;
+        String a1;
+        String a2;
+        bool force;
+        uint8_t order;                                       // scan: ListSortOrder
+        std::shared_ptr<CancelToken> token;
+        std::shared_ptr<std::vector<String>> paths;          // delete batch / prefetch folders
+        std::shared_ptr<BatchPipe<FileListItem>> pipe;       // scan output, in batches
+        std::shared_ptr<std::vector<BatchItem>> batch;       // copy batch
+        FsJob() : id(0), priority(FS_PRIO_NORMAL), type(FS_WORK_NONE), force(false), order(SORT_BY_NAME) {}
     };
     enum DialogMode {
         DIALOG_NONE,
@@ -43,21 +106,14 @@ private:
         DIALOG_RENAME
     };
 
-    struct EntryMeta {
-        String name;
-        bool is_dir;
-        String vpath;
-        bool marked;
-        lv_obj_t* checkbox;
-        lv_obj_t* label;
-    };
-
     struct CrumbMeta {
         String path;
     };
-    struct FileListItem {
-        String name;
-        bool is_dir;
+    // A parent folder left by browsing down, restored when coming back up.
+    struct NavEntry {
+        String vpath;
+        int32_t scroll_y;
+        String selected;
     };
 
     lv_obj_t* screen;
@@ -65,6 +121,15 @@ private:
     lv_obj_t* breadcrumb_wrap;
     lv_obj_t* file_list;
     lv_obj_t* empty_label;
+    lv_obj_t* list_spacer;                // sized to the whole listing: gives the scroll range
+    std::vector<lv_obj_t*> row_pool;      // fixed set of row buttons, rebound while scrolling
+    std::vector<int32_t> row_bound;       // item index shown by each pooled row, -1 if none
+    EntryArena list_items;                // listing currently shown
+    std::vector<bool> list_marked;        // remove-mode marks, parallel to list_items
+    char list_drive;
+    String list_path;
+    int32_t row_pitch;
+    uint8_t sort_order;                   // ListSortOrder of listings and the cache
     lv_obj_t* fs_bar;
     lv_obj_t* fs_label;
     lv_obj_t* fs_panel;
@@ -81,6 +146,7 @@ private:
     lv_obj_t* menu_paste_progress_bg;
     lv_obj_t* menu_copy_cancel_btn;
     lv_obj_t* menu_copy_cancel_label;
+    lv_obj_t* menu_sort_label;
     lv_timer_t* copy_timer;
     lv_timer_t* delete_timer;
     lv_timer_t* fs_job_timer;
@@ -94,10 +160,20 @@ private:
     volatile size_t copy_done_files;
     bool copy_is_dir_job;
     File copy_src_lfs;
+    NoteCodec::Reader<File> copy_src_note;  // decodes a compressed note copied off L:
     File copy_dst_lfs;
     FsFile copy_src_sdfs;
     FsFile copy_dst_sdfs;
-    uint8_t copy_buf[COPY_IO_CHUNK];
+    ScratchLease copy_lease;  // held only while a timer-driven copy runs
+    // Timer-driven batch copy (D: involved): totals are counted one directory per tick,
+    // then each plan item is expanded one directory per tick and copied file by file.
+    bool copy_batch_stepped;
+    bool copy_batch_counting;
+    std::vector<BatchItem> copy_batch_plan;
+    size_t copy_batch_next;                 // next plan item to start
+    std::vector<BatchItem> copy_batch_work; // entries of the current plan item still to copy
+    std::vector<String> copy_batch_count;   // directories still to count
+    size_t copy_file_base;                  // copy_done_bytes when the open file started
     lv_obj_t* dialog_box;
     lv_obj_t* dialog_input;
     lv_obj_t* dialog_ime_container;
@@ -129,53 +205,109 @@ private:
     String selected_vpath;
     String copied_vpath;
     String moved_vpath;
+    std::vector<BatchItem> clip_batch;  // marked entries picked for copy/move; *_vpath holds the first
     String pending_open_vpath;
     bool new_as_dir;
-    volatile bool copy_cancel_requested;
+    std::atomic<bool> copy_cancel_requested;  // also read by copies running on fm_fs_worker
     bool copy_in_progress;
+    bool xmove_in_progress;
+    std::vector<BatchItem> xmove_queue;
+    size_t xmove_next;
+    size_t xmove_base_bytes;
+    size_t xmove_base_files;
     bool delete_in_progress;
+    bool delete_on_ui_task;
     bool copy_dir_worker_mode;
     bool fs_job_in_progress;
     uint32_t copy_started_ms;
     TaskHandle_t fs_worker_task;
-    volatile FsWorkerJobType fs_worker_job;
-    volatile bool fs_worker_busy;
-    volatile bool fs_worker_done;
-    volatile bool fs_worker_ok;
-    volatile size_t fs_worker_delete_done;
-    volatile size_t fs_worker_delete_removed;
+    FsJobQueue<FsJob> fs_jobs;
+    SpscRing<FsJobEvent, 32> fs_events;
+    // DONE events that found fs_events full; drained by pumpWorkerEvents().
+    SemaphoreHandle_t fs_done_lock;
+    std::vector<FsJobEvent> fs_done_overflow;
+    // UI side: job in flight per kind (0 = none), fed by fs_events.
+    uint32_t copy_job_id;
+    uint32_t delete_job_id;
+    uint32_t op_job_id;
+    uint32_t scan_job_id;
+    bool copy_job_done;
+    bool copy_job_ok;
+    bool delete_job_done;
+    bool op_job_done;
+    bool scan_refresh_pending;
+    bool scan_rescan_pending;  // reload asked for while the folder was being scanned
+    std::shared_ptr<CancelToken> copy_token;
+    std::shared_ptr<CancelToken> scan_token;
+    std::shared_ptr<BatchPipe<FileListItem>> scan_pipe;
+    bool scan_live;                        // scan batches merge straight into the shown list
+    lv_obj_t* scan_label;
+    lv_timer_t* sd_scan_timer;
+    FsFile sd_scan_dir;
+    std::unique_ptr<SdDirScanner> sd_scanner;
+    // Worker side: only touched by fm_fs_worker.
+    uint32_t worker_job_id;
+    uint8_t worker_priority;
+    std::shared_ptr<CancelToken> worker_token;
+    uint64_t worker_done_bytes;
+    uint32_t worker_done_files;
+    size_t fs_worker_delete_done;
+    size_t fs_worker_delete_removed;
     size_t fs_worker_delete_total;
     bool fs_worker_delete_force;
     std::vector<String> fs_worker_delete_paths;
+    SdTreeDeleter sd_deleter;
     String fs_worker_src_vpath;
     String fs_worker_dst_vpath;
-    String fs_worker_arg1;
-    String fs_worker_arg2;
-    std::vector<FileListItem> fs_worker_scan_items;
+    EntryArena fs_worker_scan_items;
     String fs_worker_scan_vpath;
     bool scan_in_progress;
     bool scan_result_ready;
     bool scan_result_ok;
+    uint32_t scan_cache_gen;
     DialogMode dialog_mode;
-    uint32_t fs_usage_last_ms;
+    uint32_t fs_usage_rev;
     int fs_usage_last_pct;
     bool fs_usage_last_valid;
     bool list_suspended_for_dialog;
     bool reset_scroll_pending;
+    int32_t restore_scroll_y;             // offset to restore once the listing is complete, -1 if none
+    std::vector<NavEntry> nav_stack;      // parents of the current folder, outermost first
+    // Speculative listings of the folders likely to be opened next (pollPrefetch).
+    uint32_t prefetch_due_ms;             // 0 = nothing scheduled
+    uint32_t prefetch_job_id;             // L: worker job in flight, 0 = none
+    std::shared_ptr<CancelToken> prefetch_token;
+    std::vector<String> prefetch_sd_queue;   // D: folders still to list, front is in progress
+    std::unique_ptr<SdDirScanner> prefetch_scanner;
+    std::vector<FileListItem> prefetch_items;
+    uint64_t prefetch_pos;                // D: directory offset to resume at
+    uint32_t prefetch_gen;
+    // Filename search: the breadcrumb becomes a text box and the list shows matches
+    // (list_path "" and item names are full inner paths) streamed in by search_timer.
+    bool search_mode;
+    bool search_wait_index;               // drive has no usable index yet; retried each tick
+    lv_obj_t* search_input;
+    lv_obj_t* search_btn_ref;
+    lv_timer_t* search_timer;
+    String search_text;
+    FileIndex::Query search_query;
+    std::vector<FileListItem> search_batch;
     uint32_t dialog_ime_cursor_anchor_pos;
     bool dialog_ime_cursor_anchor_valid;
 
 public:
     FileManager()
         : screen(nullptr), sidebar(nullptr), breadcrumb_wrap(nullptr), file_list(nullptr),
-          empty_label(nullptr), fs_bar(nullptr), fs_label(nullptr), fs_panel(nullptr), up_btn_ref(nullptr), share_btn_ref(nullptr), drive_btn_l(nullptr), drive_btn_d(nullptr), menu_panel(nullptr), menu_copy_btn(nullptr), menu_move_btn(nullptr), menu_paste_btn(nullptr), menu_paste_label(nullptr), menu_paste_progress_track(nullptr), menu_paste_progress_bg(nullptr), menu_copy_cancel_btn(nullptr), menu_copy_cancel_label(nullptr), copy_timer(nullptr), delete_timer(nullptr), fs_job_timer(nullptr), copy_src_drive('L'), copy_dst_drive('L'), copy_src_inner(""), copy_dst_inner(""), copy_total_bytes(0), copy_done_bytes(0), copy_total_files(0), copy_done_files(0), copy_is_dir_job(false), dialog_box(nullptr), dialog_input(nullptr),
+          empty_label(nullptr), list_spacer(nullptr), list_drive('L'), list_path("/"), row_pitch(0), sort_order(SORT_BY_NAME), fs_bar(nullptr), fs_label(nullptr), fs_panel(nullptr), up_btn_ref(nullptr), share_btn_ref(nullptr), drive_btn_l(nullptr), drive_btn_d(nullptr), menu_panel(nullptr), menu_copy_btn(nullptr), menu_move_btn(nullptr), menu_paste_btn(nullptr), menu_paste_label(nullptr), menu_paste_progress_track(nullptr), menu_paste_progress_bg(nullptr), menu_copy_cancel_btn(nullptr), menu_copy_cancel_label(nullptr), menu_sort_label(nullptr), copy_timer(nullptr), delete_timer(nullptr), fs_job_timer(nullptr), copy_src_drive('L'), copy_dst_drive('L'), copy_src_inner(""), copy_dst_inner(""), copy_total_bytes(0), copy_done_bytes(0), copy_total_files(0), copy_done_files(0), copy_is_dir_job(false), copy_batch_stepped(false), copy_batch_counting(false), copy_batch_next(0), copy_file_base(0), dialog_box(nullptr), dialog_input(nullptr),
           dialog_ime_container(nullptr), dialog_ime(nullptr), dialog_keyboard(nullptr), dialog_ime_cand_proxy(nullptr), dialog_ime_cand_src(nullptr),
           dialog_new_file_btn(nullptr), dialog_new_dir_btn(nullptr), share_info_label(nullptr), share_action_btn(nullptr), share_action_label(nullptr),
           dialog_ime_font_acquired(false), dialog_ime_cand_syncing(false),
           on_open_cb(nullptr), on_share_ap_toggle_cb(nullptr), on_share_ap_running_cb(nullptr), on_share_ap_status_cb(nullptr),
           sd_ready(false), remove_mode(false), copy_pick_mode(false), move_pick_mode(false), active_drive('L'),
-          current_path("/"), selected_vpath(""), copied_vpath(""), moved_vpath(""), pending_open_vpath(""), new_as_dir(false), copy_cancel_requested(false), copy_in_progress(false), delete_in_progress(false), copy_dir_worker_mode(false), fs_job_in_progress(false), copy_started_ms(0), fs_worker_task(nullptr), fs_worker_job(FS_WORK_NONE), fs_worker_busy(false), fs_worker_done(false), fs_worker_ok(false), fs_worker_delete_done(0), fs_worker_delete_removed(0), fs_worker_delete_total(0), fs_worker_delete_force(false), fs_worker_src_vpath(""), fs_worker_dst_vpath(""), fs_worker_arg1(""), fs_worker_arg2(""), fs_worker_scan_items(), fs_worker_scan_vpath(""), scan_in_progress(false), scan_result_ready(false), scan_result_ok(false), dialog_mode(DIALOG_NONE),
-          fs_usage_last_ms(0), fs_usage_last_pct(0), fs_usage_last_valid(false), list_suspended_for_dialog(false), reset_scroll_pending(true),
+          current_path("/"), selected_vpath(""), copied_vpath(""), moved_vpath(""), pending_open_vpath(""), new_as_dir(false), copy_cancel_requested(false), copy_in_progress(false), xmove_in_progress(false), xmove_next(0), xmove_base_bytes(0), xmove_base_files(0), delete_in_progress(false), delete_on_ui_task(false), copy_dir_worker_mode(false), fs_job_in_progress(false), copy_started_ms(0), fs_worker_task(nullptr), fs_done_lock(xSemaphoreCreateMutex()), copy_job_id(0), delete_job_id(0), op_job_id(0), scan_job_id(0), copy_job_done(false), copy_job_ok(false), delete_job_done(false), op_job_done(false), scan_refresh_pending(false), scan_rescan_pending(false), scan_live(false), scan_label(nullptr), sd_scan_timer(nullptr), worker_job_id(0), worker_priority(FS_PRIO_BULK), worker_done_bytes(0), worker_done_files(0), fs_worker_delete_done(0), fs_worker_delete_removed(0), fs_worker_delete_total(0), fs_worker_delete_force(false), fs_worker_src_vpath(""), fs_worker_dst_vpath(""), fs_worker_scan_items(), fs_worker_scan_vpath(""), scan_in_progress(false), scan_result_ready(false), scan_result_ok(false), scan_cache_gen(0), dialog_mode(DIALOG_NONE),
+          fs_usage_rev(0), fs_usage_last_pct(0), fs_usage_last_valid(false), list_suspended_for_dialog(false), reset_scroll_pending(true), restore_scroll_y(-1),
+          prefetch_due_ms(0), prefetch_job_id(0), prefetch_pos(0), prefetch_gen(0),
+          search_mode(false), search_wait_index(false), search_input(nullptr), search_btn_ref(nullptr), search_timer(nullptr),
           dialog_ime_cursor_anchor_pos(0), dialog_ime_cursor_anchor_valid(false) {
         memset(dialog_ime_cand_texts, 0, sizeof(dialog_ime_cand_texts));
         memset(dialog_ime_cand_map, 0, sizeof(dialog_ime_cand_map));
@@ -202,6 +334,8 @@ public:
         dialog_mode = DIALOG_NONE;
         list_suspended_for_dialog = false;
         reset_scroll_pending = true;
+        restore_scroll_y = -1;
+        clearNavStack();
 
         screen = lv_obj_create(NULL);
         lv_obj_set_size(screen, 240, 320);
@@ -331,11 +465,11 @@ public:
 
         lv_obj_t* up_btn = lv_button_create(control_row);
         lv_obj_set_size(up_btn, 26, 26);
-        styleActionButton(up_btn);
+        Theme::actionButton(up_btn);
         up_btn_ref = up_btn;
         lv_obj_t* up_lbl = lv_label_create(up_btn);
         lv_label_set_text(up_lbl, LV_SYMBOL_LEFT);
-        lv_obj_set_style_text_font(up_lbl, FontManager::iconFont(), 0);
+        Theme::iconLabel(up_lbl);
         lv_obj_center(up_lbl);
         lv_obj_add_event_cb(up_btn, up_btn_event_cb, LV_EVENT_CLICKED, this);
 
@@ -349,34 +483,61 @@ public:
 
         lv_obj_t* menu_btn = lv_button_create(control_row);
         lv_obj_set_size(menu_btn, 26, 26);
-        styleActionButton(menu_btn);
+        Theme::actionButton(menu_btn);
         lv_obj_t* menu_lbl = lv_label_create(menu_btn);
         lv_label_set_text(menu_lbl, LV_SYMBOL_LIST);
-        lv_obj_set_style_text_font(menu_lbl, FontManager::iconFont(), 0);
+        Theme::iconLabel(menu_lbl);
         lv_obj_center(menu_lbl);
         lv_obj_add_event_cb(menu_btn, menu_btn_event_cb, LV_EVENT_CLICKED, this);
 
         lv_obj_t* share_btn = lv_button_create(control_row);
         lv_obj_set_size(share_btn, 26, 26);
-        styleActionButton(share_btn);
+        Theme::actionButton(share_btn);
         share_btn_ref = share_btn;
         lv_obj_t* share_lbl = lv_label_create(share_btn);
         lv_label_set_text(share_lbl, LV_SYMBOL_UPLOAD);
-        lv_obj_set_style_text_font(share_lbl, FontManager::iconFont(), 0);
+        Theme::iconLabel(share_lbl);
         lv_obj_center(share_lbl);
         lv_obj_add_event_cb(share_btn, share_btn_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_move_to_index(share_btn, lv_obj_get_index(menu_btn));
 
+        lv_obj_t* search_btn = lv_button_create(control_row);
+        lv_obj_set_size(search_btn, 26, 26);
+        Theme::actionButton(search_btn);
+        search_btn_ref = search_btn;
+        lv_obj_t* search_lbl = lv_label_create(search_btn);
+        lv_label_set_text(search_lbl, LV_SYMBOL_EYE_OPEN);
+        Theme::iconLabel(search_lbl);
+        lv_obj_center(search_lbl);
+        lv_obj_add_event_cb(search_btn, search_btn_event_cb, LV_EVENT_CLICKED, this);
+        lv_obj_move_to_index(search_btn, lv_obj_get_index(share_btn));
+
         file_list = lv_obj_create(main);
         lv_obj_set_width(file_list, lv_pct(100));
         lv_obj_set_flex_grow(file_list, 1);
         lv_obj_set_style_pad_all(file_list, 1, 0);
-        lv_obj_set_style_pad_row(file_list, 1, 0);
-        lv_obj_set_flex_flow(file_list, LV_FLEX_FLOW_COLUMN);
         lv_obj_set_scroll_dir(file_list, LV_DIR_VER);
         lv_obj_set_style_bg_color(file_list, lv_color_hex(0x000000), 0);
         lv_obj_set_style_border_color(file_list, lv_color_hex(0x303030), 0);
         lv_obj_set_style_radius(file_list, 4, 0);
+        lv_obj_add_event_cb(file_list, list_scroll_event_cb, LV_EVENT_SCROLL, this);
+
+        list_spacer = lv_obj_create(file_list);
+        lv_obj_remove_style_all(list_spacer);
+        lv_obj_remove_flag(list_spacer, LV_OBJ_FLAG_CLICKABLE);
+        lv_obj_set_pos(list_spacer, 0, 0);
+        lv_obj_set_size(list_spacer, 1, 0);
+
+        scan_label = lv_label_create(file_list);
+        lv_label_set_text(scan_label, "");
+        lv_obj_add_flag(scan_label, LV_OBJ_FLAG_FLOATING);
+        lv_obj_set_style_bg_color(scan_label, lv_color_hex(0x000000), 0);
+        lv_obj_set_style_bg_opa(scan_label, LV_OPA_80, 0);
+        lv_obj_set_style_pad_hor(scan_label, 3, 0);
+        lv_obj_set_style_text_color(scan_label, lv_color_hex(0x8ED1FF), 0);
+        lv_obj_set_style_text_font(scan_label, FontManager::iconFont(), 0);
+        lv_obj_align(scan_label, LV_ALIGN_BOTTOM_RIGHT, -2, -2);
+        lv_obj_add_flag(scan_label, LV_OBJ_FLAG_HIDDEN);
 
         empty_label = lv_label_create(file_list);
         lv_label_set_text(empty_label, "");
@@ -423,6 +584,8 @@ public:
         menu_copy_cancel_label = lv_obj_get_child(menu_copy_cancel_btn, 0);
         lv_obj_add_flag(menu_copy_cancel_btn, LV_OBJ_FLAG_HIDDEN);
         addMenuAction(menu_panel, LV_SYMBOL_EDIT " Rename", menu_rename_event_cb);
+        menu_sort_label = lv_obj_get_child(addMenuAction(menu_panel, "", menu_sort_event_cb), 0);
+        updateSortLabel();
         lv_obj_add_flag(menu_panel, LV_OBJ_FLAG_HIDDEN);
         updateMenuActionStates();
 
@@ -431,6 +594,12 @@ public:
 
     void destroy() {
         cancelCopyJob(true);
+        leaveRunningScan();
+        cancelPrefetch();
+        stopSearchTimer();
+        search_mode = false;
+        search_query = FileIndex::Query();
+        clearNavStack();
         releaseDialogIMEFont();
         if (screen) {
             clearList();
@@ -441,9 +610,15 @@ public:
             breadcrumb_wrap = nullptr;
             file_list = nullptr;
             empty_label = nullptr;
+            list_spacer = nullptr;
+            scan_label = nullptr;
+            row_pool.clear();
+            row_bound.clear();
             fs_panel = nullptr;
             up_btn_ref = nullptr;
             share_btn_ref = nullptr;
+            search_btn_ref = nullptr;
+            search_input = nullptr;
             drive_btn_l = nullptr;
             drive_btn_d = nullptr;
             menu_panel = nullptr;
@@ -455,6 +630,7 @@ public:
             menu_paste_progress_bg = nullptr;
             menu_copy_cancel_btn = nullptr;
             menu_copy_cancel_label = nullptr;
+            menu_sort_label = nullptr;
             copy_timer = nullptr;
             dialog_box = nullptr;
             dialog_input = nullptr;
@@ -478,8 +654,83 @@ public:
     }
 
     bool isCopyInProgress() const { return copy_in_progress; }
+    // One file, synchronously on the loop task (storage benchmark); idle only.
+    bool copyFileNow(const String& src_vpath, const String& dst_vpath) { return copyFile(src_vpath, dst_vpath); }
+
     bool isFsBusy() const { return copy_in_progress || delete_in_progress || fs_job_in_progress || scan_in_progress; }
 
+    // Live D: availability from the hot-plug poller.
+    void setSdAvailable(bool ready) {
+        if (sd_ready == ready) return;
+        sd_ready = ready;
+        DirListingCache::getInstance()->invalidateDrive('D');
+        if (drive_btn_d) {
+            if (ready) lv_obj_clear_state(drive_btn_d, LV_STATE_DISABLED);
+            else lv_obj_add_state(drive_btn_d, LV_STATE_DISABLED);
+        }
+        if (!ready) {
+            if (usesSdPath(copied_vpath)) copied_vpath = "";
+            if (usesSdPath(moved_vpath)) moved_vpath = "";
+            if (batchTouchesSd(clip_batch)) {
+                clip_batch.clear();
+                copied_vpath = "";
+                moved_vpath = "";
+            }
+            if (usesSdPath(selected_vpath)) selected_vpath = "";
+            if (active_drive == 'D') {
+                exitRemoveModeIfNeeded(false);
+                navigateTo('L', "/");
+                updateDriveButtonStyles();
+                if (!list_suspended_for_dialog) refreshUi();
+            }
+        }
+        updateMenuActionStates();
+    }
+
+    // Redraws the usage bar when the SD space counter moved (background count finished, resync).
+    void pollFsUsage() {
+        if (active_drive != 'D' || !screen || lv_screen_active() != screen) return;
+        if (SdSpaceTracker::getInstance()->revision() == fs_usage_rev) return;
+        updateFsUsageUi();
+    }
+
+    // Idle-loop hook. Once the shown folder has sat for PREFETCH_DELAY_MS, lists the
+    // selected subfolder and the first few others into DirListingCache so opening
+    // one is a cache hit. Any foreground job or navigation cancels it.
+    void pollPrefetch() {
+#if PREFETCH_ENABLED
+        if (!screen || lv_screen_active() != screen || isFsBusy() || list_suspended_for_dialog) {
+            cancelPrefetch();
+            return;
+        }
+        if (!prefetch_sd_queue.empty()) {
+            stepSdPrefetch();
+            return;
+        }
+        if (prefetch_due_ms == 0 || (int32_t)(millis() - prefetch_due_ms) < 0) return;
+        if (prefetch_job_id != 0) return;  // a cancelled job is still winding down
+        prefetch_due_ms = 0;
+        std::vector<String> want;
+        collectPrefetchTargets(want);
+        if (want.empty()) return;
+        if (list_drive == 'D') {
+            prefetch_sd_queue.swap(want);
+            stepSdPrefetch();
+            return;
+        }
+        FsJob job;
+        job.type = FS_WORK_PREFETCH;
+        job.priority = FS_PRIO_IDLE;
+        job.order = sort_order;
+        job.paths = std::make_shared<std::vector<String>>(want);
+        job.token = std::make_shared<CancelToken>();
+        uint32_t id = submitWorkerJob(job);
+        if (id == 0) return;
+        prefetch_job_id = id;
+        prefetch_token = job.token;
+#endif
+    }
+
 private:
     static void drive_btn_event_cb(lv_event_t* e) {
         FileManager* fm = (FileManager*)lv_event_get_user_data(e);
@@ -487,10 +738,7 @@ private:
         char drive = (char)(intptr_t)lv_obj_get_user_data((lv_obj_t*)lv_event_get_target(e));
         if (drive == 'D' && !fm->sd_ready) return;
         fm->exitRemoveModeIfNeeded(false);
-        fm->active_drive = drive;
-        fm->current_path = "/";
-        fm->selected_vpath = "";
-        fm->reset_scroll_pending = true;
+        fm->navigateTo(drive, "/");
         fm->updateDriveButtonStyles();
         fm->refreshUi();
     }
@@ -502,9 +750,12 @@ private:
             fm->exitRemoveModeIfNeeded(true);
             return;
         }
+        if (fm->search_mode) {
+            fm->exitSearch(true);
+            return;
+        }
         if (fm->current_path == "/") return;
         fm->goUp();
-        fm->reset_scroll_pending = true;
         fm->refreshUi();
     }
 
@@ -514,8 +765,7 @@ private:
         if (!fm || !btn) return;
         CrumbMeta* meta = (CrumbMeta*)lv_obj_get_user_data(btn);
         if (!meta) return;
-        fm->current_path = meta->path;
-        fm->reset_scroll_pending = true;
+        fm->navigateTo(fm->active_drive, meta->path);
         fm->refreshUi();
     }
 
@@ -524,21 +774,25 @@ private:
         lv_obj_t* btn = (lv_obj_t*)lv_event_get_target(e);
         if (!fm || !btn) return;
         if (fm->delete_in_progress || fm->fs_job_in_progress) return;
-        EntryMeta* meta = (EntryMeta*)lv_obj_get_user_data(btn);
-        if (!meta) return;
+        size_t slot = (size_t)(uintptr_t)lv_obj_get_user_data(btn);
+        if (slot >= fm->row_bound.size() || fm->row_bound[slot] < 0) return;
+        size_t idx = (size_t)fm->row_bound[slot];
+        if (idx >= fm->list_items.size()) return;
+        String vpath = fm->entryVPath(idx);
 
-        bool same_selected = (fm->selected_vpath == meta->vpath);
-        fm->selected_vpath = meta->vpath;
-        fm->refreshSelectionHighlight();
+        bool same_selected = (fm->selected_vpath == vpath);
+        fm->selected_vpath = vpath;
 
         if (fm->remove_mode) {
-            meta->marked = !meta->marked;
+            fm->list_marked[idx] = !fm->list_marked[idx];
             fm->refreshSelectionHighlight();
             return;
         }
+        fm->refreshSelectionHighlight();
         if (fm->copy_pick_mode) {
-            fm->copied_vpath = meta->vpath;
-            fm->selected_vpath = meta->vpath;
+            fm->clip_batch.clear();
+            fm->copied_vpath = vpath;
+            fm->selected_vpath = vpath;
             fm->updateMenuActionStates();
             fm->copy_pick_mode = false;
             fm->closeMenuPanel();
@@ -546,8 +800,9 @@ private:
             return;
         }
         if (fm->move_pick_mode) {
-            fm->moved_vpath = meta->vpath;
-            fm->selected_vpath = meta->vpath;
+            fm->clip_batch.clear();
+            fm->moved_vpath = vpath;
+            fm->selected_vpath = vpath;
             fm->updateMenuActionStates();
             fm->move_pick_mode = false;
             fm->closeMenuPanel();
@@ -556,42 +811,53 @@ private:
         }
 
         // Single tap: select only. Tap the same row again to open.
-        if (!same_selected) return;
+        if (!same_selected) {
+            if (fm->list_items.isDir(idx)) fm->schedulePrefetch();
+            return;
+        }
 
-        if (meta->is_dir) {
-            fm->current_path = fm->joinPath(fm->current_path, meta->name);
-            fm->selected_vpath = "";
-            fm->reset_scroll_pending = true;
+        if (fm->search_mode && !fm->pathExists(vpath)) {
+            // Changed behind the index (e.g. on a PC): drop the hit and reindex.
+            FileIndex::getInstance()->noteMissing(fm->list_drive, fm->list_items.name(idx));
+            fm->startSearch();
+            return;
+        }
+        if (fm->list_items.isDir(idx) && fm->search_mode) {
+            char drive = fm->list_drive;
+            String inner = fm->list_items.name(idx);
+            fm->exitSearch(false);
+            fm->navigateTo(drive, inner);
+            fm->refreshUi();
+            return;
+        }
+        if (fm->list_items.isDir(idx)) {
+            fm->navigateTo(fm->list_drive, fm->joinPath(fm->list_path, String(fm->list_items.name(idx))));
             fm->refreshUi();
             return;
         }
 
         if (fm->on_open_cb) {
             static const size_t LARGE_FILE_WARN_BYTES = 128 * 1024;
-            size_t fsz = fm->getFileSize(meta->vpath);
+            size_t fsz = fm->getFileSize(vpath);
             if (fsz >= LARGE_FILE_WARN_BYTES) {
-                fm->openLargeFileWarnDialog(meta->vpath, fsz);
+                fm->openLargeFileWarnDialog(vpath, fsz);
             } else {
-                fm->on_open_cb(meta->vpath.c_str());
+                fm->on_open_cb(vpath.c_str());
             }
         }
     }
 
-    static void checkbox_event_cb(lv_event_t* e) {
+    static void list_scroll_event_cb(lv_event_t* e) {
         FileManager* fm = (FileManager*)lv_event_get_user_data(e);
-        lv_obj_t* cb = (lv_obj_t*)lv_event_get_target(e);
-        if (!fm || !cb) return;
-        lv_obj_t* row_btn = lv_obj_get_parent(cb);
-        if (!row_btn) return;
-        EntryMeta* meta = (EntryMeta*)lv_obj_get_user_data(row_btn);
-        if (!meta) return;
-        meta->marked = lv_obj_has_state(cb, LV_STATE_CHECKED);
+        if (!fm) return;
+        fm->bindVisibleRows(false);
     }
 
     static void menu_btn_event_cb(lv_event_t* e) {
         FileManager* fm = (FileManager*)lv_event_get_user_data(e);
         if (!fm || !fm->menu_panel) return;
         if (lv_obj_has_flag(fm->menu_panel, LV_OBJ_FLAG_HIDDEN)) {
+            fm->exitSearch(true);
             fm->updateMenuActionStates();
             lv_obj_remove_flag(fm->menu_panel, LV_OBJ_FLAG_HIDDEN);
         }
@@ -601,9 +867,45 @@ private:
     static void share_btn_event_cb(lv_event_t* e) {
         FileManager* fm = (FileManager*)lv_event_get_user_data(e);
         if (!fm) return;
+        fm->closeDialogIME();
         fm->openShareDialog();
     }
 
+    static void search_btn_event_cb(lv_event_t* e) {
+        FileManager* fm = (FileManager*)lv_event_get_user_data(e);
+        if (!fm) return;
+        if (fm->search_mode) {
+            fm->exitSearch(true);
+            return;
+        }
+        fm->exitRemoveModeIfNeeded(false);
+        fm->exitCopyPickModeIfNeeded(false);
+        fm->exitMovePickModeIfNeeded(false);
+        fm->closeMenuPanel();
+        fm->enterSearch();
+    }
+
+    static void search_input_event_cb(lv_event_t* e) {
+        FileManager* fm = (FileManager*)lv_event_get_user_data(e);
+        if (!fm || !fm->search_input) return;
+        lv_event_code_t code = lv_event_get_code(e);
+        if (code == LV_EVENT_VALUE_CHANGED) {
+            fm->startSearch();
+            return;
+        }
+        if (code == LV_EVENT_READY || code == LV_EVENT_CANCEL) {
+            fm->closeDialogIME();
+            return;
+        }
+        fm->dialog_input = fm->search_input;
+        fm->openDialogIME();
+    }
+
+    static void search_timer_cb(lv_timer_t* t) {
+        FileManager* fm = (FileManager*)lv_timer_get_user_data(t);
+        if (fm) fm->stepSearchView();
+    }
+
     static void menu_new_event_cb(lv_event_t* e) {
         FileManager* fm = (FileManager*)lv_event_get_user_data(e);
         if (!fm) return;
@@ -639,9 +941,18 @@ private:
         FileManager* fm = (FileManager*)lv_event_get_user_data(e);
         if (!fm) return;
         if (fm->delete_in_progress || fm->fs_job_in_progress) return;
+        fm->pickMarkedForClipboard();
         fm->exitRemoveModeIfNeeded(false);
         fm->exitMovePickModeIfNeeded(false);
         fm->moved_vpath = "";
+        if (!fm->clip_batch.empty()) {
+            fm->copied_vpath = fm->clip_batch[0].src;
+            fm->copy_pick_mode = false;
+            fm->updateMenuActionStates();
+            fm->closeMenuPanel();
+            fm->refreshUi();
+            return;
+        }
         if (fm->selected_vpath.length() > 0) {
             // Use current selection as copy source immediately.
             fm->copied_vpath = fm->selected_vpath;
@@ -659,9 +970,18 @@ private:
         FileManager* fm = (FileManager*)lv_event_get_user_data(e);
         if (!fm) return;
         if (fm->delete_in_progress || fm->fs_job_in_progress || fm->copy_in_progress) return;
+        fm->pickMarkedForClipboard();
         fm->exitRemoveModeIfNeeded(false);
         fm->exitCopyPickModeIfNeeded(false);
         fm->copied_vpath = "";
+        if (!fm->clip_batch.empty()) {
+            fm->moved_vpath = fm->clip_batch[0].src;
+            fm->move_pick_mode = false;
+            fm->updateMenuActionStates();
+            fm->closeMenuPanel();
+            fm->refreshUi();
+            return;
+        }
         if (fm->selected_vpath.length() > 0) {
             fm->moved_vpath = fm->selected_vpath;
             fm->move_pick_mode = false;
@@ -680,7 +1000,9 @@ private:
         fm->exitRemoveModeIfNeeded(true);
         fm->exitCopyPickModeIfNeeded(false);
         fm->exitMovePickModeIfNeeded(false);
-        if (fm->moved_vpath.length() > 0) fm->moveSelected();
+        bool is_move = fm->moved_vpath.length() > 0;
+        if (fm->clip_batch.size() > 1) fm->pasteBatch(is_move);
+        else if (is_move) fm->moveSelected();
         else fm->pasteCopied();
     }
 
@@ -695,10 +1017,32 @@ private:
         fm->openInputDialog(DIALOG_RENAME, "Rename to", cur.c_str());
     }
 
+    // Cycles name / size / date. Cached listings are in the old order, so drop them
+    // and rescan; a rescan of the folder on screen is staged, so the rows don't flash.
+    static void menu_sort_event_cb(lv_event_t* e) {
+        FileManager* fm = (FileManager*)lv_event_get_user_data(e);
+        if (!fm) return;
+        fm->sort_order = (uint8_t)((fm->sort_order + 1) % 3);
+        fm->updateSortLabel();
+        fm->leaveRunningScan();
+        DirListingCache::getInstance()->invalidateDrive('L');
+        DirListingCache::getInstance()->invalidateDrive('D');
+        fm->refreshUi();
+    }
+
+    void updateSortLabel() {
+        if (!menu_sort_label) return;
+        const char* txt = LV_SYMBOL_LIST " Sort: Name";
+        if (sort_order == SORT_BY_SIZE) txt = LV_SYMBOL_LIST " Sort: Size";
+        else if (sort_order == SORT_BY_MTIME) txt = LV_SYMBOL_LIST " Sort: Date";
+        lv_label_set_text(menu_sort_label, txt);
+    }
+
     static void menu_copy_cancel_event_cb(lv_event_t* e) {
         FileManager* fm = (FileManager*)lv_event_get_user_data(e);
         if (!fm) return;
         fm->copy_cancel_requested = true;
+        if (fm->copy_token) fm->copy_token->cancel();
     }
 
     static void sidebar_info_event_cb(lv_event_t* e) {
@@ -736,36 +1080,12 @@ private:
             return;
         }
         while (true) {
-            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-            bool ok = false;
-            fm->fs_worker_busy = true;
-            fm->fs_worker_done = false;
-            if (fm->fs_worker_job == FS_WORK_COPY_DIR) {
-                ok = fm->copyDirectoryRecursive(fm->fs_worker_src_vpath, fm->fs_worker_dst_vpath);
-            } else if (fm->fs_worker_job == FS_WORK_DELETE_BATCH) {
-                ok = true;
-                fm->fs_worker_delete_removed = 0;
-                for (size_t i = 0; i < fm->fs_worker_delete_paths.size(); i++) {
-                    if (fm->deletePath(fm->fs_worker_delete_paths[i], fm->fs_worker_delete_force)) {
-                        fm->fs_worker_delete_removed++;
-                    }
-                    fm->fs_worker_delete_done = i + 1;
-                    delay(0);
-                }
-            } else if (fm->fs_worker_job == FS_WORK_COPY_FILE) {
-                ok = fm->copyFile(fm->fs_worker_src_vpath, fm->fs_worker_dst_vpath, fm->copy_total_bytes, false);
-            } else if (fm->fs_worker_job == FS_WORK_CREATE_FILE) {
-                ok = fm->writeTextFile(fm->fs_worker_arg1, "");
-            } else if (fm->fs_worker_job == FS_WORK_CREATE_DIR) {
-                ok = fm->makeDir(fm->fs_worker_arg1);
-            } else if (fm->fs_worker_job == FS_WORK_RENAME) {
-                ok = fm->renamePath(fm->fs_worker_arg1, fm->fs_worker_arg2);
-            } else if (fm->fs_worker_job == FS_WORK_SCAN_DIR) {
-                ok = fm->scanDirectoryIntoWorker(fm->fs_worker_scan_vpath);
+            FsJob job;
+            if (!fm->fs_jobs.pop(job)) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                continue;
             }
-            fm->fs_worker_ok = ok;
-            fm->fs_worker_busy = false;
-            fm->fs_worker_done = true;
+            fm->runWorkerJob(job);
         }
     }
 
@@ -879,12 +1199,11 @@ private:
         lv_obj_set_size(btn, 30, 30);
         lv_obj_set_user_data(btn, (void*)(intptr_t)drive);
         lv_obj_add_event_cb(btn, drive_btn_event_cb, LV_EVENT_CLICKED, this);
-        styleActionButton(btn);
+        Theme::actionButton(btn);
         if (!enabled) lv_obj_add_state(btn, LV_STATE_DISABLED);
         lv_obj_t* lbl = lv_label_create(btn);
         lv_label_set_text(lbl, label);
-        lv_obj_set_style_text_font(lbl, FontManager::iconFont(), 0);
-        lv_obj_set_style_text_color(lbl, lv_color_hex(0xFFFFFF), 0);
+        Theme::iconLabel(lbl);
         lv_obj_center(lbl);
 
         if (drive == 'L') drive_btn_l = btn;
@@ -893,45 +1212,34 @@ private:
 
     void updateDriveButtonStyles() {
         if (drive_btn_l) {
-            lv_obj_set_style_bg_color(
-                drive_btn_l,
-                (active_drive == 'L') ? lv_color_hex(0x5CB8FF) : lv_color_hex(0x1E1E1E),
-                LV_STATE_DEFAULT
-            );
-            lv_obj_set_style_border_color(
-                drive_btn_l,
-                (active_drive == 'L') ? lv_color_hex(0x8ED1FF) : lv_color_hex(0x404040),
-                LV_STATE_DEFAULT
-            );
+            if (active_drive == 'L') lv_obj_add_state(drive_btn_l, LV_STATE_CHECKED);
+            else lv_obj_remove_state(drive_btn_l, LV_STATE_CHECKED);
         }
         if (drive_btn_d) {
-            lv_obj_set_style_bg_color(
-                drive_btn_d,
-                (active_drive == 'D') ? lv_color_hex(0x5CB8FF) : lv_color_hex(0x1E1E1E),
-                LV_STATE_DEFAULT
-            );
-            lv_obj_set_style_border_color(
-                drive_btn_d,
-                (active_drive == 'D') ? lv_color_hex(0x8ED1FF) : lv_color_hex(0x404040),
-                LV_STATE_DEFAULT
-            );
+            if (active_drive == 'D') lv_obj_add_state(drive_btn_d, LV_STATE_CHECKED);
+            else lv_obj_remove_state(drive_btn_d, LV_STATE_CHECKED);
         }
     }
 
     lv_obj_t* addMenuAction(lv_obj_t* parent, const char* label, lv_event_cb_t cb) {
         lv_obj_t* btn = lv_button_create(parent);
         lv_obj_set_size(btn, lv_pct(100), 30);
-        styleActionButton(btn);
+        Theme::actionButton(btn);
         lv_obj_add_event_cb(btn, cb, LV_EVENT_CLICKED, this);
         lv_obj_t* lbl = lv_label_create(btn);
         lv_label_set_text(lbl, label);
-        lv_obj_set_style_text_font(lbl, FontManager::iconFont(), 0);
-        lv_obj_set_style_text_color(lbl, lv_color_hex(0xFFFFFF), 0);
+        Theme::iconLabel(lbl);
         lv_obj_center(lbl);
         return btn;
     }
 
     void refreshUi() {
+        if (search_mode) {
+            startSearch();
+            updateUpButtonState();
+            updateFsUsageUi();
+            return;
+        }
         rebuildBreadcrumb();
         reloadEntries();
         refreshSelectionHighlight();
@@ -942,7 +1250,7 @@ private:
     void updateUpButtonState() {
         if (!up_btn_ref) return;
         bool at_root = (current_path == "/");
-        bool disable = at_root && !remove_mode;
+        bool disable = at_root && !remove_mode && !search_mode;
         if (disable) {
             lv_obj_add_state(up_btn_ref, LV_STATE_DISABLED);
             lv_obj_set_style_bg_color(up_btn_ref, lv_color_hex(0x101010), LV_STATE_DEFAULT);
@@ -954,6 +1262,143 @@ private:
         }
     }
 
+    // Replaces the breadcrumb with a search box for the active drive.
+    void enterSearch() {
+        if (search_mode || !breadcrumb_wrap) return;
+        leaveRunningScan();
+        cancelPrefetch();
+        search_mode = true;
+        clearBreadcrumb();
+        search_input = lv_textarea_create(breadcrumb_wrap);
+        lv_obj_set_height(search_input, lv_pct(100));
+        lv_obj_set_flex_grow(search_input, 1);
+        lv_textarea_set_one_line(search_input, true);
+        lv_obj_set_style_pad_ver(search_input, 2, 0);
+        lv_obj_set_style_pad_hor(search_input, 4, 0);
+        lv_obj_set_style_bg_color(search_input, lv_color_hex(0x101010), 0);
+        lv_obj_set_style_text_color(search_input, lv_color_hex(0xFFFFFF), 0);
+        lv_obj_set_style_border_color(search_input, lv_color_hex(0x404040), 0);
+        lv_obj_set_style_text_font(search_input, FontManager::textFont(), 0);
+        lv_obj_set_style_text_color(search_input, lv_color_hex(0x808080), LV_PART_TEXTAREA_PLACEHOLDER);
+        lv_obj_set_style_bg_color(search_input, lv_color_hex(0xFFFFFF), LV_PART_CURSOR);
+        lv_obj_set_style_bg_opa(search_input, LV_OPA_70, LV_PART_CURSOR);
+        lv_obj_set_style_width(search_input, 1, LV_PART_CURSOR);
+        lv_obj_add_event_cb(search_input, search_input_event_cb, LV_EVENT_FOCUSED, this);
+        lv_obj_add_event_cb(search_input, search_input_event_cb, LV_EVENT_CLICKED, this);
+        lv_obj_add_event_cb(search_input, search_input_event_cb, LV_EVENT_VALUE_CHANGED, this);
+        lv_obj_add_event_cb(search_input, search_input_event_cb, LV_EVENT_READY, this);
+        lv_obj_add_event_cb(search_input, search_input_event_cb, LV_EVENT_CANCEL, this);
+        lv_obj_add_event_cb(search_input, dialog_input_cursor_anchor_event_cb, LV_EVENT_CLICKED, this);
+        lv_obj_add_event_cb(search_input, dialog_input_cursor_anchor_event_cb, LV_EVENT_VALUE_CHANGED, this);
+        if (search_btn_ref) lv_obj_add_state(search_btn_ref, LV_STATE_CHECKED);
+        dialog_input = search_input;
+        updateUpButtonState();
+        startSearch();
+        openDialogIME();
+    }
+
+    // Back to browsing current_path; refresh=false when the caller navigates itself.
+    void exitSearch(bool refresh) {
+        if (!search_mode) return;
+        stopSearchTimer();
+        closeDialogIME();
+        if (dialog_input == search_input) dialog_input = nullptr;
+        search_mode = false;
+        search_wait_index = false;
+        search_query = FileIndex::Query();
+        search_batch.clear();
+        search_text = "";
+        clearBreadcrumb();
+        search_input = nullptr;
+        if (search_btn_ref) lv_obj_remove_state(search_btn_ref, LV_STATE_CHECKED);
+        clearList();
+        reset_scroll_pending = true;
+        updateScanIndicator();
+        if (refresh) refreshUi();
+    }
+
+    void stopSearchTimer() {
+        if (search_timer) {
+            lv_timer_del(search_timer);
+            search_timer = nullptr;
+        }
+    }
+
+    // Restarts the query from the search box; matches stream in from search_timer.
+    void startSearch() {
+        if (!search_mode || !search_input || list_suspended_for_dialog) return;
+        String hint = String("Find on ") + active_drive + ":";
+        lv_textarea_set_placeholder_text(search_input, hint.c_str());
+        search_text = lv_textarea_get_text(search_input);
+        search_text.trim();
+        search_query = FileIndex::Query();
+        search_batch.clear();
+        clearList();
+        list_drive = active_drive;
+        list_path = "";
+        lv_obj_scroll_to_y(file_list, 0, LV_ANIM_OFF);
+        if (search_text.length() < FileIndex::MIN_QUERY) {
+            stopSearchTimer();
+            search_wait_index = false;
+            showEmptyState(search_text.length() == 0 ? "(type a name)" : "(type 3 or more letters)");
+            updateSearchIndicator();
+            return;
+        }
+        search_wait_index = true;
+        if (!search_timer) search_timer = lv_timer_create(search_timer_cb, 10, this);
+        stepSearchView();
+    }
+
+    void stepSearchView() {
+        if (!search_mode) {
+            stopSearchTimer();
+            return;
+        }
+        FileIndex* index = FileIndex::getInstance();
+        if (search_wait_index) {
+            if (!index->beginSearch(list_drive, search_text, search_query)) {
+                showEmptyState("(indexing...)");
+                return;
+            }
+            search_wait_index = false;
+            lv_obj_add_flag(empty_label, LV_OBJ_FLAG_HIDDEN);
+        }
+        index->stepSearch(search_query, search_batch, SEARCH_STEP_MS);
+        if (!search_batch.empty()) {
+            std::sort(search_batch.begin(), search_batch.end(), EntryOrder(SORT_BY_NAME));
+            list_items.mergeSorted(search_batch, EntryOrder(SORT_BY_NAME), &list_marked);
+            search_batch.clear();
+            showListedItems();
+        }
+        if (search_query.stale) {
+            // Index rebuilt or card gone mid-query: start over on the new index.
+            clearList();
+            search_query = FileIndex::Query();
+            search_wait_index = true;
+            return;
+        }
+        if (!search_query.active) {
+            stopSearchTimer();
+            if (list_items.empty()) showEmptyState("(no match)");
+        }
+        updateSearchIndicator();
+    }
+
+    void updateSearchIndicator() {
+        if (!scan_label) return;
+        size_t n = list_items.size();
+        if (!search_query.active && n == 0) {
+            lv_obj_add_flag(scan_label, LV_OBJ_FLAG_HIDDEN);
+            return;
+        }
+        String txt;
+        if (search_query.active) txt = "searching... " + String((unsigned long)n);
+        else txt = String((unsigned long)n) + (n >= SEARCH_MAX_RESULTS ? "+ found" : " found");
+        lv_label_set_text(scan_label, txt.c_str());
+        lv_obj_remove_flag(scan_label, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_move_foreground(scan_label);
+    }
+
     void rebuildBreadcrumb() {
         clearBreadcrumb();
         addCrumbButton(String(active_drive) + ":/", "/");
@@ -998,12 +1443,11 @@ private:
         lv_obj_t* btn = lv_button_create(breadcrumb_wrap);
         lv_obj_set_height(btn, 22);
         lv_obj_set_style_pad_hor(btn, 4, 0);
-        styleActionButton(btn);
+        Theme::actionButton(btn);
         lv_obj_set_style_radius(btn, 0, 0);
         lv_obj_t* lbl = lv_label_create(btn);
         lv_label_set_text(lbl, label.c_str());
-        lv_obj_set_style_text_color(lbl, lv_color_hex(0xFFFFFF), 0);
-        lv_obj_set_style_text_font(lbl, FontManager::iconFont(), 0);
+        Theme::iconLabel(lbl);
         lv_obj_center(lbl);
 
         CrumbMeta* meta = new CrumbMeta();
@@ -1029,104 +1473,443 @@ private:
         lv_obj_center(empty_label);
     }
 
+    // Takes the scan result as the shown listing. Only the pooled rows near the
+    // viewport exist as LVGL objects; the spacer provides the full scroll height.
     void applyScanItemsToList(bool ok) {
         clearList();
-        bool has_items = false;
-        if (ok) {
-            sortEntryItems(fs_worker_scan_items);
-            for (size_t i = 0; i < fs_worker_scan_items.size(); i++) {
-                addEntryButton(fs_worker_scan_items[i].name, fs_worker_scan_items[i].is_dir);
-            }
-            has_items = !fs_worker_scan_items.empty();
+        if (ok) list_items.swap(fs_worker_scan_items);
+        fs_worker_scan_items.release();
+        list_marked.assign(list_items.size(), false);
+        list_drive = active_drive;
+        list_path = current_path;
+        if (list_items.empty()) {
+            showEmptyState(remove_mode ? "(remove mode, no items)" : "(empty)");
+            return;
+        }
+        showListedItems();
+    }
+
+    // Sizes the spacer to list_items and rebinds the rows in view.
+    void showListedItems() {
+        if (list_items.empty()) {
+            if (list_spacer) lv_obj_set_height(list_spacer, 0);
+            return;
         }
-        if (!has_items) showEmptyState(remove_mode ? "(remove mode, no items)" : "(empty)");
-        else lv_obj_add_flag(empty_label, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_add_flag(empty_label, LV_OBJ_FLAG_HIDDEN);
+        ensureRowPool();
+        lv_obj_set_height(list_spacer, (int32_t)list_items.size() * row_pitch - LIST_ROW_GAP);
+        lv_obj_update_layout(file_list);
+        // A shorter listing than before may leave the old offset past the end.
+        int32_t overshoot = -lv_obj_get_scroll_bottom(file_list);
+        if (overshoot > 0) lv_obj_scroll_by(file_list, 0, overshoot, LV_ANIM_OFF);
+        bindVisibleRows(true);
     }
 
+    // A restored offset waits for the complete listing; until then the list sits at
+    // the top like any other folder.
     void applyResetScrollIfNeeded() {
+        if (restore_scroll_y >= 0 && !scan_in_progress) {
+            lv_obj_scroll_to_y(file_list, restore_scroll_y, LV_ANIM_OFF);
+            restore_scroll_y = -1;
+            reset_scroll_pending = false;
+            bindVisibleRows(false);
+            return;
+        }
         if (!reset_scroll_pending) return;
         lv_obj_scroll_to_y(file_list, 0, LV_ANIM_OFF);
         reset_scroll_pending = false;
+        bindVisibleRows(false);
     }
 
     void reloadEntries() {
         if (!file_list || !empty_label) return;
+        DirListingCache* cache = DirListingCache::getInstance();
+        String v = String(active_drive) + ":" + current_path;
+
+        if (scan_result_ready) {
+            bool rescan = scan_rescan_pending;
+            scan_rescan_pending = false;
+            scan_result_ready = false;
+            pumpScanPipe();
+            scan_pipe.reset();
+            finishScan(scan_result_ok);
+            if (fs_worker_scan_vpath == v && !rescan) return;
+        }
+        if (scan_in_progress && fs_worker_scan_vpath != v) leaveRunningScan();
+        if (scan_in_progress) {
+            // The folder may have changed after the scan read it: list it again afterwards.
+            scan_rescan_pending = true;
+            return;
+        }
+        cancelPrefetch();
+
+        // Cached listings stay valid until one of our own mutations invalidates them.
+        if (cache->get(v, fs_worker_scan_items)) {
+            applyScanItemsToList(true);
+            fs_worker_scan_items.release();
+            applyResetScrollIfNeeded();
+            schedulePrefetch();
+            return;
+        }
 
         if (active_drive == 'D') {
-            fs_worker_scan_items.clear();
-            bool ok = scanDirectoryIntoWorker(String('D') + ":" + current_path);
+            if (startSdScan(v)) return;
+            // Scanner could not start (unusual layout): one blocking pass instead.
+            uint32_t gen = cache->generation();
+            std::vector<FileListItem> scanned;
+            bool ok = scanDirectory(v, scanned, nullptr, nullptr, sort_order);
+            if (ok) {
+                sortEntryItems(scanned);
+                fs_worker_scan_items.assign(scanned);
+                cache->put(v, fs_worker_scan_items, gen);
+            }
             applyScanItemsToList(ok);
-            fs_worker_scan_items.clear();
+            fs_worker_scan_items.release();
             applyResetScrollIfNeeded();
+            if (ok) schedulePrefetch();
             return;
         }
 
-        if (scan_result_ready) {
-            applyScanItemsToList(scan_result_ok);
-            scan_result_ready = false;
-            fs_worker_scan_items.clear();
+        if (!startScanJob(v)) {
+            if (list_items.empty()) showEmptyState(remove_mode ? "(remove mode, no items)" : "(empty)");
+        }
+    }
+
+    // A scan of a folder other than the one on screen streams into the list as it
+    // runs; a rescan of the folder on screen is staged and swapped in when complete,
+    // so the current rows never flash.
+    void beginScanView(const String& v) {
+        fs_worker_scan_items.release();
+        bool same = !list_items.empty() && driveOf(v) == list_drive && innerPath(v) == list_path;
+        scan_live = !same;
+        if (scan_live) {
+            clearList();
+            list_drive = driveOf(v);
+            list_path = innerPath(v);
+            showEmptyState("");
             applyResetScrollIfNeeded();
-            return;
         }
+        updateScanIndicator();
+    }
 
+    void updateScanIndicator() {
+        if (!scan_label) return;
         if (!scan_in_progress) {
-            String v = String(active_drive) + ":" + current_path;
-            if (!startScanJob(v)) {
-                if (lv_obj_get_child_count(file_list) <= 1) showEmptyState(remove_mode ? "(remove mode, no items)" : "(empty)");
+            lv_obj_add_flag(scan_label, LV_OBJ_FLAG_HIDDEN);
+            return;
+        }
+        size_t n = scan_live ? list_items.size() : fs_worker_scan_items.size();
+        String txt = "scanning... " + String((unsigned long)n);
+        lv_label_set_text(scan_label, txt.c_str());
+        lv_obj_remove_flag(scan_label, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_move_foreground(scan_label);
+    }
+
+    // Batches arrive sorted (by the worker for L:, by stepSdScan for D:), so the
+    // UI task only merges them into the arena.
+    void deliverScanBatch(std::vector<FileListItem>& batch) {
+        if (batch.empty()) return;
+        if (scan_live) {
+            list_items.mergeSorted(batch, EntryOrder(sort_order), &list_marked);
+            showListedItems();
+        } else {
+            fs_worker_scan_items.mergeSorted(batch, EntryOrder(sort_order));
+        }
+        batch.clear();
+        updateScanIndicator();
+    }
+
+    void pumpScanPipe() {
+        if (!scan_pipe) return;
+        std::vector<FileListItem> batch;
+        if (scan_pipe->drain(batch)) deliverScanBatch(batch);
+    }
+
+    // Ends the scan in fs_worker_scan_vpath: caches the listing and, for a staged
+    // rescan of the folder on screen, swaps it in.
+    void finishScan(bool ok) {
+        scan_in_progress = false;
+        updateScanIndicator();
+        DirListingCache* cache = DirListingCache::getInstance();
+        String v = fs_worker_scan_vpath;
+        bool on_screen = (v == String(active_drive) + ":" + current_path);
+        if (scan_live) {
+            scan_live = false;
+            if (!ok) {
+                clearList();
+                if (on_screen) showEmptyState(remove_mode ? "(remove mode, no items)" : "(empty)");
                 return;
             }
-            // Keep old list visible while background scan is running.
-            if (lv_obj_get_child_count(file_list) <= 1) {
-                showEmptyState("");
+            cache->put(v, list_items, scan_cache_gen);
+            if (list_items.empty() && on_screen) showEmptyState(remove_mode ? "(remove mode, no items)" : "(empty)");
+            if (on_screen) {
+                applyResetScrollIfNeeded();
+                schedulePrefetch();
+            }
+            return;
+        }
+        if (!ok) {
+            // Staged rescan failed: the rows on screen are still the last good listing.
+            Serial.println("[SCAN] rescan failed: " + v);
+            fs_worker_scan_items.release();
+            return;
+        }
+        cache->put(v, fs_worker_scan_items, scan_cache_gen);
+        if (on_screen) {
+            applyScanItemsToList(true);
+            applyResetScrollIfNeeded();
+            schedulePrefetch();
+        }
+        fs_worker_scan_items.release();
+    }
+
+    // Drops the running scan (user left the folder, or a dialog freed the list).
+    void leaveRunningScan() {
+        if (!scan_in_progress) return;
+        if (driveOf(fs_worker_scan_vpath) == 'D') {
+            closeSdScan();
+        } else {
+            if (scan_token) scan_token->cancel();
+            scan_token.reset();
+            scan_pipe.reset();
+            scan_job_id = 0;
+        }
+        scan_in_progress = false;
+        scan_rescan_pending = false;
+        if (scan_live) clearList();
+        scan_live = false;
+        fs_worker_scan_items.release();
+        updateScanIndicator();
+    }
+
+    // D: scans run on the UI task (SD rule) in SD_SCAN_CHUNKS_PER_TICK steps; the
+    // first step runs right away so the first rows paint in this frame.
+    bool startSdScan(const String& v) {
+        if (!sd_ready || !StorageHelper::getInstance()->isInitialized()) return false;
+        SdFs& fs = StorageHelper::getInstance()->getFs();
+        String p = innerPath(v);
+        sd_scan_dir = fs.open(p.c_str(), O_RDONLY);
+        if (!sd_scan_dir.isOpen() || !sd_scan_dir.isDir()) {
+            closeSdScan();
+            return false;
+        }
+        sd_scanner.reset(new SdDirScanner(fs.fatType()));
+        if (!sd_scanner->begin(sd_scan_dir)) {
+            closeSdScan();
+            return false;
+        }
+        fs_worker_scan_vpath = v;
+        scan_cache_gen = DirListingCache::getInstance()->generation();
+        scan_in_progress = true;
+        beginScanView(v);
+        stepSdScan();
+        if (scan_in_progress && !sd_scan_timer) sd_scan_timer = lv_timer_create(sd_scan_timer_cb, 10, this);
+        return true;
+    }
+
+    static void sd_scan_timer_cb(lv_timer_t* t) {
+        FileManager* fm = (FileManager*)lv_timer_get_user_data(t);
+        if (!fm) return;
+        fm->stepSdScan();
+    }
+
+    void stepSdScan() {
+        if (!scan_in_progress || !sd_scanner) return;
+        std::vector<FileListItem> batch;
+        int rc = sd_scanner->step(sd_scan_dir, batch, SD_SCAN_CHUNKS_PER_TICK);
+        if (rc < 0) {
+            // Layout the raw decoder rejects: redo it with openNext() in one pass.
+            closeSdScan();
+            if (scan_live) clearList();
+            scan_live = false;
+            std::vector<FileListItem> scanned;
+            bool ok = scanDirectory(fs_worker_scan_vpath, scanned, nullptr, nullptr, sort_order);
+            if (ok) {
+                sortEntryItems(scanned);
+                fs_worker_scan_items.assign(scanned);
+            }
+            endSdScan(ok);
+            return;
+        }
+        hideTrashEntry(innerPath(fs_worker_scan_vpath), batch);
+        sortEntryItems(batch);
+        deliverScanBatch(batch);
+        if (rc > 0) {
+            closeSdScan();
+            endSdScan(true);
+        }
+    }
+
+    void endSdScan(bool ok) {
+        finishScan(ok);
+        if (!scan_rescan_pending) return;
+        scan_rescan_pending = false;
+        reloadEntries();
+    }
+
+    void closeSdScan() {
+        if (sd_scan_dir.isOpen()) sd_scan_dir.close();
+        sd_scanner.reset();
+        if (sd_scan_timer) {
+            lv_timer_del(sd_scan_timer);
+            sd_scan_timer = nullptr;
+        }
+    }
+
+    // Restarts the prefetch delay; the selected folder may have changed.
+    void schedulePrefetch() {
+        cancelPrefetch();
+        prefetch_due_ms = millis() + PREFETCH_DELAY_MS;
+        if (prefetch_due_ms == 0) prefetch_due_ms = 1;
+    }
+
+    // An L: job stops within 16 entries; its DONE event clears prefetch_job_id.
+    void cancelPrefetch() {
+        prefetch_due_ms = 0;
+        if (prefetch_token) prefetch_token->cancel();
+        prefetch_token.reset();
+        prefetch_sd_queue.clear();
+        prefetch_scanner.reset();
+        prefetch_items.clear();
+    }
+
+    // Selected subfolder first, then the leading folders of the listing (folders sort
+    // first), skipping ones already cached; at most PREFETCH_MAX_DIRS.
+    void collectPrefetchTargets(std::vector<String>& out) {
+        out.clear();
+        if (scan_in_progress || list_items.empty()) return;
+        if (list_drive != active_drive || list_path != current_path) return;
+        if (list_drive == 'D' && !isSdFsReady()) return;
+        DirListingCache* cache = DirListingCache::getInstance();
+        String prefix = String(list_drive) + ":" + joinPath(list_path, "");
+        String sel;
+        if (selected_vpath.startsWith(prefix)) {
+            sel = selected_vpath.substring(prefix.length());
+            if (sel.indexOf('/') >= 0) sel = "";
+        }
+        bool sel_done = sel.length() == 0;
+        std::vector<String> rest;
+        for (size_t i = 0; i < list_items.size() && list_items.isDir(i); i++) {
+            if (!sel_done && sel == list_items.name(i)) {
+                String v = prefix + sel;
+                if (!cache->contains(v)) out.push_back(v);
+                sel_done = true;
+            } else if (rest.size() < PREFETCH_MAX_DIRS) {
+                String v = prefix + list_items.name(i);
+                if (!cache->contains(v)) rest.push_back(v);
             }
+            if (sel_done && rest.size() >= PREFETCH_MAX_DIRS) break;
         }
+        for (size_t i = 0; i < rest.size() && out.size() < PREFETCH_MAX_DIRS; i++) out.push_back(rest[i]);
     }
 
-    static uint8_t sortRankChar(uint8_t c) {
-        if (c >= '0' && c <= '9') return 0;
-        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) return 1;
-        if (c < 0x80) return 2;   // ASCII symbols
-        return 3;                 // non-ASCII bytes (UTF-8)
+    // D: prefetch, UI task only (SD rule). The folder is reopened each poll and the
+    // scan resumed from prefetch_pos, so no SD handle is held between loop passes.
+    void stepSdPrefetch() {
+        if (!isSdFsReady()) {
+            cancelPrefetch();
+            return;
+        }
+        const String v = prefetch_sd_queue.front();
+        String p = innerPath(v);
+        SdFs& fs = sdFs();
+        FsFile dir = fs.open(p.c_str(), O_RDONLY);
+        int rc = -1;
+        if (dir.isOpen() && dir.isDir()) {
+            if (!prefetch_scanner) {
+                prefetch_scanner.reset(new SdDirScanner(fs.fatType()));
+                prefetch_items.clear();
+                prefetch_gen = DirListingCache::getInstance()->generation();
+                rc = prefetch_scanner->begin(dir) ? 0 : -1;
+            } else {
+                rc = dir.seekSet(prefetch_pos) ? 0 : -1;
+            }
+            if (rc == 0) rc = prefetch_scanner->step(dir, prefetch_items, PREFETCH_SD_CHUNKS);
+            prefetch_pos = dir.curPosition();
+        }
+        if (dir.isOpen()) dir.close();
+        if (rc == 0) return;
+        // rc < 0 (a layout the raw decoder rejects) is left to the regular scan's fallback.
+        if (rc > 0) {
+            hideTrashEntry(p, prefetch_items);
+            sortEntryItems(prefetch_items);
+            EntryArena arena;
+            arena.assign(prefetch_items);
+            DirListingCache::getInstance()->put(v, arena, prefetch_gen);
+        }
+        prefetch_scanner.reset();
+        prefetch_items.clear();
+        prefetch_sd_queue.erase(prefetch_sd_queue.begin());
     }
 
-    bool scanDirectoryIntoWorker(const String& vpath) {
-        fs_worker_scan_items.clear();
+    // Entries carry their collation key. pipe: publish sorted batches as they are
+    // read (L: worker scans), growing so the UI does only a few merges per folder.
+    // order: which sort the caller will apply; only size/date orders need a stat on L:.
+    bool scanDirectory(const String& vpath, std::vector<FileListItem>& out, const CancelToken* cancel = nullptr,
+                       BatchPipe<FileListItem>* pipe = nullptr, uint8_t order = SORT_BY_NAME) {
+        out.clear();
         char d = driveOf(vpath);
         String p = innerPath(vpath);
         if (d == 'L') {
-            File dir = LittleFS.open(p.c_str(), "r");
-            if (!dir || !dir.isDirectory()) return false;
+            LfsDirIter dir(p);
+            if (!dir.isOpen()) return false;
             uint32_t iter = 0;
-            while (true) {
-                File entry = dir.openNextFile();
-                if (!entry) break;
-                String name = baseName(entry.name());
-                if (name.length() > 0) {
-                    FileListItem it;
-                    it.name = name;
-                    it.is_dir = entry.isDirectory();
-                    fs_worker_scan_items.push_back(it);
+            size_t publish_at = SCAN_FIRST_BATCH;
+            const bool want_stat = order != SORT_BY_NAME;
+            FileListItem it;
+            while (dir.next(it.name, it.is_dir)) {
+                if (!TrashBin::isHiddenEntry(p, it.name)) {
+                    NameCollation::setKey(it);
+                    it.size = 0;
+                    it.mtime = 0;
+                    if (want_stat && !it.is_dir) dir.stat(it.size, &it.mtime);
+                    out.push_back(it);
+                }
+                if (pipe && out.size() >= publish_at) {
+                    std::sort(out.begin(), out.end(), EntryOrder(order));
+                    pipe->publish(out);
+                    if (publish_at < SCAN_PUBLISH_MAX) publish_at *= 2;
+                }
+                if ((++iter & 0x0F) == 0) {
+                    if (cancel && cancel->isCancelled()) return false;
+                    delay(0);
                 }
-                entry.close();
-                if ((++iter & 0x0F) == 0) delay(0);
             }
-            dir.close();
+            if (pipe) {
+                std::sort(out.begin(), out.end(), EntryOrder(order));
+                pipe->publish(out);
+            }
             return true;
         }
         if (d == 'D') {
             if (!sd_ready || !StorageHelper::getInstance()->isInitialized()) return false;
-            FsFile dir = StorageHelper::getInstance()->getFs().open(p.c_str(), O_RDONLY);
+            SdFs& fs = StorageHelper::getInstance()->getFs();
+            FsFile dir = fs.open(p.c_str(), O_RDONLY);
             if (!dir || !dir.isDir()) return false;
+            // Fast path: decode the directory's own entries without opening children.
+            SdDirScanner raw(fs.fatType());
+            if (raw.scan(dir, out)) {
+                dir.close();
+                hideTrashEntry(p, out);
+                return true;
+            }
+            out.clear();
+            dir.rewind();
             uint32_t iter = 0;
             FsFile entry;
             while (entry.openNext(&dir, O_RDONLY)) {
                 char name[256];
                 entry.getName(name, sizeof(name));
-                if (name[0] != '\0') {
+                if (name[0] != '\0' && !TrashBin::isHiddenEntry(p, String(name))) {
                     FileListItem it;
                     it.name = String(name);
                     it.is_dir = entry.isDir();
-                    fs_worker_scan_items.push_back(it);
+                    it.size = it.is_dir ? 0 : entry.fileSize();
+                    uint16_t mdate = 0;
+                    uint16_t mtime = 0;
+                    if (entry.getModifyDateTime(&mdate, &mtime)) it.mtime = SdDirScanner::dosToEpoch(mdate, mtime);
+                    NameCollation::setKey(it);
+                    out.push_back(it);
                 }
                 entry.close();
                 if ((++iter & 0x0F) == 0) delay(0);
@@ -1137,6 +1920,14 @@ private:
         return false;
     }
 
+    static void hideTrashEntry(const String& dir_inner, std::vector<FileListItem>& items) {
+        for (size_t i = 0; i < items.size(); i++) {
+            if (!TrashBin::isHiddenEntry(dir_inner, items[i].name)) continue;
+            items.erase(items.begin() + i);
+            return;
+        }
+    }
+
     bool usesSdPath(const String& vpath) const {
         return driveOf(vpath) == 'D';
     }
@@ -1148,142 +1939,129 @@ private:
         return false;
     }
 
-    static bool lessName09az(const String& a, const String& b) {
-        const size_t la = a.length();
-        const size_t lb = b.length();
-        const size_t n = (la < lb) ? la : lb;
-        for (size_t i = 0; i < n; i++) {
-            uint8_t ca = (uint8_t)a.charAt((unsigned int)i);
-            uint8_t cb = (uint8_t)b.charAt((unsigned int)i);
-            uint8_t ra = sortRankChar(ca);
-            uint8_t rb = sortRankChar(cb);
-            if (ra != rb) return ra < rb;
-
-            if (ra == 1) { // letters: case-insensitive compare
-                ca = (uint8_t)tolower((int)ca);
-                cb = (uint8_t)tolower((int)cb);
-            }
-            if (ca != cb) return ca < cb;
+    void sortEntryItems(std::vector<FileListItem>& items) const {
+        std::sort(items.begin(), items.end(), EntryOrder(sort_order));
+    }
+
+    // Enough rows to cover the tallest possible viewport plus the margins.
+    void ensureRowPool() {
+        if (!row_pool.empty()) return;
+        int32_t row_h = lv_font_get_line_height(FontManager::textFont()) + 2 * Theme::LIST_ROW_PAD_V + 2;
+        row_pitch = row_h + LIST_ROW_GAP;
+        int32_t view_h = (SCREEN_WIDTH > SCREEN_HEIGHT) ? SCREEN_WIDTH : SCREEN_HEIGHT;
+        size_t count = (size_t)(view_h / row_pitch) + 1 + 2 * LIST_ROW_MARGIN;
+        for (size_t slot = 0; slot < count; slot++) {
+            lv_obj_t* row = lv_button_create(file_list);
+            lv_obj_set_size(row, lv_pct(100), row_h);
+            Theme::listRow(row);
+            lv_obj_set_flex_flow(row, LV_FLEX_FLOW_ROW);
+            lv_obj_set_flex_align(row, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_CENTER);
+            lv_obj_set_user_data(row, (void*)(uintptr_t)slot);
+            lv_obj_add_event_cb(row, file_item_event_cb, LV_EVENT_CLICKED, this);
+            lv_obj_add_flag(row, LV_OBJ_FLAG_HIDDEN);
+
+            lv_obj_t* lbl = lv_label_create(row);
+            lv_label_set_text(lbl, "");
+            lv_label_set_long_mode(lbl, LV_LABEL_LONG_DOT);
+            lv_obj_set_flex_grow(lbl, 1);
+            lv_obj_set_width(lbl, lv_pct(100));
+            Theme::listRowLabel(lbl);
+            row_pool.push_back(row);
+            row_bound.push_back(-1);
         }
-        return la < lb;
     }
 
-    static void sortEntryItems(std::vector<FileListItem>& items) {
-        std::sort(items.begin(), items.end(), [](const FileListItem& a, const FileListItem& b) {
-            if (a.is_dir != b.is_dir) return a.is_dir && !b.is_dir; // folders first, then files
-            return lessName09az(a.name, b.name);
-        });
+    // Deletes the pooled rows (frees LVGL memory while a dialog is open).
+    void releaseRowPool() {
+        for (size_t i = 0; i < row_pool.size(); i++) lv_obj_del(row_pool[i]);
+        row_pool.clear();
+        row_bound.clear();
+    }
+
+    // Item idx always lands in pool slot idx % pool, so scrolling only rebinds the
+    // rows that just left the window.
+    void bindVisibleRows(bool force) {
+        size_t pool = row_pool.size();
+        if (!file_list || pool == 0 || row_pitch <= 0) return;
+        size_t n = list_items.size();
+        int32_t top = lv_obj_get_scroll_y(file_list);
+        size_t first = top > 0 ? (size_t)(top / row_pitch) : 0;
+        first = (first > LIST_ROW_MARGIN) ? first - LIST_ROW_MARGIN : 0;
+        if (first + pool > n) first = (n > pool) ? n - pool : 0;
+        for (size_t idx = first; idx < first + pool; idx++) {
+            size_t slot = idx % pool;
+            int32_t want = (idx < n) ? (int32_t)idx : -1;
+            if (!force && row_bound[slot] == want) continue;
+            bindRow(slot, want);
+        }
     }
 
-    void addEntryButton(const String& name, bool is_dir) {
-        lv_obj_t* row = lv_button_create(file_list);
-        lv_obj_set_width(row, lv_pct(100));
-        lv_obj_set_height(row, LV_SIZE_CONTENT);
-        lv_obj_set_style_radius(row, 4, 0);
-        lv_obj_set_style_bg_color(row, lv_color_hex(0x101010), LV_STATE_DEFAULT);
-        lv_obj_set_style_bg_color(row, lv_color_hex(0x173248), LV_STATE_PRESSED);
-        lv_obj_set_style_bg_color(row, lv_color_hex(0x1E4B6D), LV_STATE_FOCUSED);
-        lv_obj_set_style_bg_opa(row, LV_OPA_COVER, 0);
-        lv_obj_set_style_border_color(row, lv_color_hex(0x2C2C2C), 0);
-        lv_obj_set_style_border_width(row, 1, 0);
-        lv_obj_set_style_shadow_width(row, 0, 0);
-        lv_obj_set_style_pad_hor(row, 4, 0);
-        lv_obj_set_style_pad_ver(row, 2, 0);
-        lv_obj_set_flex_flow(row, LV_FLEX_FLOW_ROW);
-        lv_obj_set_flex_align(row, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_CENTER);
-
-        EntryMeta* meta = new EntryMeta();
-        meta->name = name;
-        meta->is_dir = is_dir;
-        meta->vpath = String(active_drive) + ":" + joinPath(current_path, name);
-        meta->marked = false;
-        meta->checkbox = nullptr;
-        meta->label = nullptr;
-        lv_obj_set_user_data(row, meta);
-        lv_obj_add_event_cb(row, file_item_event_cb, LV_EVENT_CLICKED, this);
-
-        lv_obj_t* lbl = lv_label_create(row);
-        String text = formatEntryLabel(*meta);
-        lv_label_set_text(lbl, text.c_str());
-        lv_label_set_long_mode(lbl, LV_LABEL_LONG_WRAP);
-        lv_obj_set_flex_grow(lbl, 1);
-        lv_obj_set_width(lbl, lv_pct(100));
-        lv_obj_set_style_pad_top(lbl, 0, 0);
-        lv_obj_set_style_pad_bottom(lbl, 0, 0);
-        lv_obj_set_style_text_line_space(lbl, -2, 0);
-        lv_obj_set_style_text_color(lbl, lv_color_hex(0xFFFFFF), 0);
-        lv_obj_set_style_text_font(lbl, FontManager::textFont(), 0);
-        meta->label = lbl;
-    }
-
-    String formatEntryLabel(const EntryMeta& meta) const {
-        String base = meta.is_dir ? (String(LV_SYMBOL_DIRECTORY) + " " + meta.name)
-                                  : (String(LV_SYMBOL_FILE) + " " + meta.name);
-        return base;
+    void bindRow(size_t slot, int32_t idx) {
+        lv_obj_t* row = row_pool[slot];
+        row_bound[slot] = idx;
+        if (idx < 0) {
+            lv_obj_add_flag(row, LV_OBJ_FLAG_HIDDEN);
+            return;
+        }
+        String text = formatEntryLabel((size_t)idx);
+        lv_label_set_text(lv_obj_get_child(row, 0), text.c_str());
+        lv_obj_set_pos(row, 0, idx * row_pitch);
+        lv_obj_remove_state(row, LV_STATE_FOCUSED);
+        applyRowHighlight(slot);
+        lv_obj_remove_flag(row, LV_OBJ_FLAG_HIDDEN);
     }
 
-    void refreshSelectionHighlight() {
-        if (!file_list) return;
-        uint32_t count = lv_obj_get_child_count(file_list);
-        for (uint32_t i = 0; i < count; i++) {
-            lv_obj_t* child = lv_obj_get_child(file_list, i);
-            if (child == empty_label) continue;
-            EntryMeta* meta = (EntryMeta*)lv_obj_get_user_data(child);
-            if (!meta) continue;
-            bool selected = (meta->vpath == selected_vpath);
-            bool multi_selected = remove_mode ? meta->marked : selected;
-            lv_obj_set_style_bg_color(child, multi_selected ? lv_color_hex(0x1E4B6D) : lv_color_hex(0x101010), LV_STATE_DEFAULT);
-            lv_obj_set_style_border_color(child, multi_selected ? lv_color_hex(0x8ED1FF) : lv_color_hex(0x2C2C2C), LV_STATE_DEFAULT);
-        }
+    String entryVPath(size_t idx) const {
+        if (search_mode) return String(list_drive) + ":" + list_items.name(idx);
+        return String(list_drive) + ":" + joinPath(list_path, String(list_items.name(idx)));
+    }
+
+    // Search results show the name first and the folder it is in after it.
+    String formatEntryLabel(size_t idx) const {
+        String label = list_items.isDir(idx) ? LV_SYMBOL_DIRECTORY " " : LV_SYMBOL_FILE " ";
+        if (!search_mode) return label + list_items.name(idx);
+        String path = list_items.name(idx);
+        int slash = path.lastIndexOf('/');
+        String parent = slash > 0 ? path.substring(0, slash) : String("/");
+        return label + path.substring(slash + 1) + "  " + parent;
+    }
+
+    void applyRowHighlight(size_t slot) {
+        int32_t idx = row_bound[slot];
+        if (idx < 0) return;
+        bool multi_selected = remove_mode ? (bool)list_marked[(size_t)idx] : (entryVPath((size_t)idx) == selected_vpath);
+        if (multi_selected) lv_obj_add_state(row_pool[slot], LV_STATE_CHECKED);
+        else lv_obj_remove_state(row_pool[slot], LV_STATE_CHECKED);
     }
 
-    void styleActionButton(lv_obj_t* btn) {
-        lv_obj_set_style_radius(btn, 4, 0);
-        lv_obj_set_style_bg_color(btn, lv_color_hex(0x1E1E1E), LV_STATE_DEFAULT);
-        lv_obj_set_style_bg_color(btn, lv_color_hex(0x5CB8FF), LV_STATE_PRESSED);
-        lv_obj_set_style_bg_color(btn, lv_color_hex(0x8ED1FF), LV_STATE_FOCUSED);
-        lv_obj_set_style_border_color(btn, lv_color_hex(0x404040), LV_STATE_DEFAULT);
-        lv_obj_set_style_border_color(btn, lv_color_hex(0x8ED1FF), LV_STATE_PRESSED);
-        lv_obj_set_style_border_color(btn, lv_color_hex(0x8ED1FF), LV_STATE_FOCUSED);
-        lv_obj_set_style_text_color(btn, lv_color_hex(0xFFFFFF), 0);
-        lv_obj_set_style_shadow_width(btn, 0, 0);
+    void refreshSelectionHighlight() {
+        for (size_t slot = 0; slot < row_pool.size(); slot++) applyRowHighlight(slot);
     }
 
+
     void updateFsUsageUi() {
         if (!fs_bar || !fs_label) return;
         bool fs_busy = copy_in_progress || delete_in_progress || fs_job_in_progress || scan_in_progress;
 
-        // SD usage probing can be expensive (freeClusterCount scan). Throttle it.
-        if (active_drive == 'D') {
-            if (fs_busy) {
-                if (fs_usage_last_valid) {
-                    lv_bar_set_value(fs_bar, fs_usage_last_pct, LV_ANIM_OFF);
-                    char quick[16];
-                    lv_snprintf(quick, sizeof(quick), "%d\n%%", fs_usage_last_pct);
-                    lv_label_set_text(fs_label, quick);
-                }
-                return;
-            }
-            uint32_t now = millis();
-            if (fs_usage_last_valid && (now - fs_usage_last_ms) < 1500) {
+        fs_usage_rev = SdSpaceTracker::getInstance()->revision();
+
+        uint64_t total = 0;
+        uint64_t used = 0;
+
+        if (active_drive == 'L') {
+            if (fs_busy && fs_usage_last_valid) {
                 lv_bar_set_value(fs_bar, fs_usage_last_pct, LV_ANIM_OFF);
                 char quick[16];
                 lv_snprintf(quick, sizeof(quick), "%d\n%%", fs_usage_last_pct);
                 lv_label_set_text(fs_label, quick);
                 return;
             }
-            fs_usage_last_ms = now;
-        }
-
-        uint64_t total = 0;
-        uint64_t used = 0;
-
-        if (active_drive == 'L') {
-            total = (uint64_t)LittleFS.totalBytes();
-            used = (uint64_t)LittleFS.usedBytes();
-        } else if (active_drive == 'D' && sd_ready && StorageHelper::getInstance()->isInitialized()) {
-            total = StorageHelper::getInstance()->totalBytes();
-            used = StorageHelper::getInstance()->usedBytes();
+            total = (uint64_t)LittleFS.totalBytes();
+            used = (uint64_t)LittleFS.usedBytes();
+        } else if (active_drive == 'D' && sd_ready && StorageHelper::getInstance()->usageKnown()) {
+            // Cached counter kept by SdSpaceTracker; never scans the FAT here.
+            total = StorageHelper::getInstance()->totalBytes();
+            used = StorageHelper::getInstance()->usedBytes();
         }
 
         int pct = 0;
@@ -1301,15 +2079,13 @@ private:
     }
 
     void clearList() {
-        if (!file_list) return;
-        uint32_t count = lv_obj_get_child_count(file_list);
-        for (int32_t i = (int32_t)count - 1; i >= 0; i--) {
-            lv_obj_t* child = lv_obj_get_child(file_list, (uint32_t)i);
-            if (child == empty_label) continue;
-            EntryMeta* meta = (EntryMeta*)lv_obj_get_user_data(child);
-            if (meta) delete meta;
-            lv_obj_del(child);
+        list_items.release();
+        list_marked.clear();
+        for (size_t slot = 0; slot < row_pool.size(); slot++) {
+            row_bound[slot] = -1;
+            lv_obj_add_flag(row_pool[slot], LV_OBJ_FLAG_HIDDEN);
         }
+        if (list_spacer) lv_obj_set_height(list_spacer, 0);
     }
 
     void closeMenuPanel() {
@@ -1332,8 +2108,9 @@ private:
             else lv_obj_add_state(menu_paste_btn, LV_STATE_DISABLED);
         }
         if (menu_paste_label) {
-            if (moved_vpath.length() > 0) lv_label_set_text(menu_paste_label, LV_SYMBOL_PASTE " Move here");
-            else lv_label_set_text(menu_paste_label, LV_SYMBOL_PASTE " Paste");
+            String txt = String(LV_SYMBOL_PASTE) + (moved_vpath.length() > 0 ? " Move here" : " Paste");
+            if (clip_batch.size() > 1) txt += " (" + String((unsigned long)clip_batch.size()) + ")";
+            lv_label_set_text(menu_paste_label, txt.c_str());
         }
         if (menu_copy_cancel_btn) {
             if (copy_in_progress) lv_obj_clear_state(menu_copy_cancel_btn, LV_STATE_DISABLED);
@@ -1343,7 +2120,9 @@ private:
 
     void suspendListForDialog() {
         if (list_suspended_for_dialog) return;
+        leaveRunningScan();
         clearList();
+        releaseRowPool();
         list_suspended_for_dialog = true;
     }
 
@@ -1371,7 +2150,57 @@ private:
     void goUp() {
         if (current_path == "/") return;
         int idx = current_path.lastIndexOf('/');
-        current_path = (idx <= 0) ? "/" : current_path.substring(0, idx);
+        navigateTo(active_drive, (idx <= 0) ? "/" : current_path.substring(0, idx));
+    }
+
+    static bool isSameOrBelow(const String& vpath, const String& root) {
+        if (root.endsWith("/")) return vpath.startsWith(root);
+        return vpath == root || vpath.startsWith(root + "/");
+    }
+
+    // Moves to drive:path. Going down pushes the folder being left (scroll offset,
+    // selection) and pins its cached listing; coming back to a folder on the stack
+    // restores both, with no storage I/O unless something in it changed meanwhile.
+    void navigateTo(char drive, const String& path) {
+        DirListingCache* cache = DirListingCache::getInstance();
+        String from = String(active_drive) + ":" + current_path;
+        String to = String(drive) + ":" + path;
+        if (to != from && isSameOrBelow(to, from)) {
+            NavEntry e;
+            e.vpath = from;
+            bool shown = file_list && list_drive == active_drive && list_path == current_path;
+            e.scroll_y = shown ? lv_obj_get_scroll_y(file_list) : 0;
+            e.selected = selected_vpath;
+            nav_stack.push_back(e);
+            cache->pin(from);
+            if (nav_stack.size() > NAV_BACK_DEPTH) {
+                cache->unpin(nav_stack.front().vpath);
+                nav_stack.erase(nav_stack.begin());
+            }
+        } else {
+            while (!nav_stack.empty() && !isSameOrBelow(to, nav_stack.back().vpath)) {
+                cache->unpin(nav_stack.back().vpath);
+                nav_stack.pop_back();
+            }
+        }
+        active_drive = drive;
+        current_path = path;
+        selected_vpath = "";
+        reset_scroll_pending = true;
+        restore_scroll_y = -1;
+        if (!nav_stack.empty() && nav_stack.back().vpath == to) {
+            restore_scroll_y = nav_stack.back().scroll_y;
+            selected_vpath = nav_stack.back().selected;
+            reset_scroll_pending = false;
+            cache->unpin(to);
+            nav_stack.pop_back();
+        }
+    }
+
+    void clearNavStack() {
+        DirListingCache* cache = DirListingCache::getInstance();
+        for (size_t i = 0; i < nav_stack.size(); i++) cache->unpin(nav_stack[i].vpath);
+        nav_stack.clear();
     }
 
     void openInputDialog(DialogMode mode, const char* title, const char* initial) {
@@ -1436,20 +2265,20 @@ private:
 
             dialog_new_file_btn = lv_button_create(type_row);
             lv_obj_set_size(dialog_new_file_btn, 76, 28);
-            styleActionButton(dialog_new_file_btn);
+            Theme::actionButton(dialog_new_file_btn);
             lv_obj_add_event_cb(dialog_new_file_btn, new_type_file_event_cb, LV_EVENT_CLICKED, this);
             lv_obj_t* file_lbl = lv_label_create(dialog_new_file_btn);
             lv_label_set_text(file_lbl, LV_SYMBOL_FILE " File");
-            lv_obj_set_style_text_font(file_lbl, FontManager::iconFont(), 0);
+            Theme::iconLabel(file_lbl);
             lv_obj_center(file_lbl);
 
             dialog_new_dir_btn = lv_button_create(type_row);
             lv_obj_set_size(dialog_new_dir_btn, 86, 28);
-            styleActionButton(dialog_new_dir_btn);
+            Theme::actionButton(dialog_new_dir_btn);
             lv_obj_add_event_cb(dialog_new_dir_btn, new_type_dir_event_cb, LV_EVENT_CLICKED, this);
             lv_obj_t* dir_lbl = lv_label_create(dialog_new_dir_btn);
             lv_label_set_text(dir_lbl, LV_SYMBOL_DIRECTORY " Folder");
-            lv_obj_set_style_text_font(dir_lbl, FontManager::iconFont(), 0);
+            Theme::iconLabel(dir_lbl);
             lv_obj_center(dir_lbl);
 
             updateNewTypeButtons();
@@ -1495,20 +2324,20 @@ private:
 
         lv_obj_t* cancel_btn = lv_button_create(row);
         lv_obj_set_size(cancel_btn, 70, 30);
-        styleActionButton(cancel_btn);
+        Theme::actionButton(cancel_btn);
         lv_obj_add_event_cb(cancel_btn, dialog_cancel_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* cancel_lbl = lv_label_create(cancel_btn);
         lv_label_set_text(cancel_lbl, "Cancel");
-        lv_obj_set_style_text_font(cancel_lbl, FontManager::iconFont(), 0);
+        Theme::iconLabel(cancel_lbl);
         lv_obj_center(cancel_lbl);
 
         lv_obj_t* ok_btn = lv_button_create(row);
         lv_obj_set_size(ok_btn, 54, 30);
-        styleActionButton(ok_btn);
+        Theme::actionButton(ok_btn);
         lv_obj_add_event_cb(ok_btn, dialog_ok_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* ok_lbl = lv_label_create(ok_btn);
         lv_label_set_text(ok_lbl, "OK");
-        lv_obj_set_style_text_font(ok_lbl, FontManager::iconFont(), 0);
+        Theme::iconLabel(ok_lbl);
         lv_obj_center(ok_lbl);
 
     }
@@ -1554,36 +2383,13 @@ private:
         dialog_ime = lv_ime_pinyin_create(dialog_ime_container);
         lv_obj_set_width(dialog_ime, lv_pct(100));
         lv_obj_set_height(dialog_ime, IME_CANDIDATE_H);
-        lv_obj_set_style_bg_color(dialog_ime, lv_color_hex(0x000000), 0);
-        lv_obj_set_style_text_color(dialog_ime, lv_color_hex(0xFFFFFF), 0);
-        lv_obj_set_style_bg_color(dialog_ime, lv_color_hex(0x111111), LV_PART_ITEMS);
-        lv_obj_set_style_text_color(dialog_ime, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_DEFAULT);
-        lv_obj_set_style_text_color(dialog_ime, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_FOCUSED);
-        lv_obj_set_style_text_color(dialog_ime, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_PRESSED);
-        lv_obj_set_style_text_color(dialog_ime, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_CHECKED);
         lv_obj_set_style_text_font(dialog_ime, FontManager::imeFont(), LV_PART_MAIN);
         lv_obj_set_style_text_font(dialog_ime, FontManager::imeFont(), LV_PART_ITEMS);
 
         dialog_keyboard = lv_keyboard_create(dialog_ime_container);
         lv_obj_set_width(dialog_keyboard, lv_pct(100));
         lv_obj_set_height(dialog_keyboard, IME_KEYBOARD_H);
-        lv_obj_set_style_bg_color(dialog_keyboard, lv_color_hex(0x000000), 0);
-        lv_obj_set_style_text_color(dialog_keyboard, lv_color_hex(0xFFFFFF), 0);
-        lv_obj_set_style_bg_color(dialog_keyboard, lv_color_hex(0x1A1A1A), LV_PART_ITEMS | LV_STATE_DEFAULT);
-        lv_obj_set_style_bg_color(dialog_keyboard, lv_color_hex(0x222222), LV_PART_ITEMS | LV_STATE_FOCUSED);
-        lv_obj_set_style_bg_color(dialog_keyboard, lv_color_hex(0x2A2A2A), LV_PART_ITEMS | LV_STATE_PRESSED);
-        lv_obj_set_style_bg_color(dialog_keyboard, lv_color_hex(0x202020), LV_PART_ITEMS | LV_STATE_CHECKED);
-        lv_obj_set_style_bg_color(dialog_keyboard, lv_color_hex(0x111111), LV_PART_ITEMS | LV_STATE_DISABLED);
-        lv_obj_set_style_text_color(dialog_keyboard, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_DEFAULT);
-        lv_obj_set_style_text_color(dialog_keyboard, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_FOCUSED);
-        lv_obj_set_style_text_color(dialog_keyboard, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_PRESSED);
-        lv_obj_set_style_text_color(dialog_keyboard, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_CHECKED);
-        lv_obj_set_style_text_color(dialog_keyboard, lv_color_hex(0xB8B8B8), LV_PART_ITEMS | LV_STATE_DISABLED);
-        lv_obj_set_style_border_color(dialog_keyboard, lv_color_hex(0x303030), LV_PART_ITEMS | LV_STATE_DEFAULT);
-        lv_obj_set_style_border_color(dialog_keyboard, lv_color_hex(0x3A3A3A), LV_PART_ITEMS | LV_STATE_FOCUSED);
-        lv_obj_set_style_border_color(dialog_keyboard, lv_color_hex(0x4A4A4A), LV_PART_ITEMS | LV_STATE_PRESSED);
-        lv_obj_set_style_border_color(dialog_keyboard, lv_color_hex(0x3A3A3A), LV_PART_ITEMS | LV_STATE_CHECKED);
-        lv_obj_set_style_border_color(dialog_keyboard, lv_color_hex(0x242424), LV_PART_ITEMS | LV_STATE_DISABLED);
+        Theme::keyboard(dialog_keyboard);
         lv_obj_set_style_text_font(dialog_keyboard, FontManager::imeFont(), LV_PART_MAIN);
         lv_obj_set_style_text_font(dialog_keyboard, FontManager::imeFont(), LV_PART_ITEMS);
         lv_keyboard_set_textarea(dialog_keyboard, dialog_input);
@@ -1591,23 +2397,8 @@ private:
         lv_ime_pinyin_set_dict(dialog_ime, g_pinyin_dict_plus);
         lv_ime_pinyin_set_mode(dialog_ime, LV_IME_PINYIN_MODE_K26);
         lv_obj_t* cand_panel = lv_ime_pinyin_get_cand_panel(dialog_ime);
-        if (cand_panel) {
-            lv_obj_set_style_bg_color(cand_panel, lv_color_hex(0x000000), LV_PART_MAIN);
-            lv_obj_set_style_bg_color(cand_panel, lv_color_hex(0x111111), LV_PART_ITEMS | LV_STATE_DEFAULT);
-            lv_obj_set_style_bg_color(cand_panel, lv_color_hex(0x1A1A1A), LV_PART_ITEMS | LV_STATE_FOCUSED);
-            lv_obj_set_style_bg_color(cand_panel, lv_color_hex(0x202020), LV_PART_ITEMS | LV_STATE_PRESSED);
-            lv_obj_set_style_bg_color(cand_panel, lv_color_hex(0x151515), LV_PART_ITEMS | LV_STATE_CHECKED);
-            lv_obj_set_style_bg_opa(cand_panel, LV_OPA_TRANSP, LV_PART_MAIN);
-            lv_obj_set_style_bg_opa(cand_panel, LV_OPA_TRANSP, LV_PART_ITEMS);
-            lv_obj_set_style_border_width(cand_panel, 0, LV_PART_MAIN);
-            lv_obj_set_style_border_width(cand_panel, 0, LV_PART_ITEMS);
-            lv_obj_set_style_text_color(cand_panel, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
-            lv_obj_set_style_text_color(cand_panel, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_DEFAULT);
-            lv_obj_set_style_text_color(cand_panel, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_FOCUSED);
-            lv_obj_set_style_text_color(cand_panel, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_PRESSED);
-            lv_obj_set_style_text_color(cand_panel, lv_color_hex(0xFFFFFF), LV_PART_ITEMS | LV_STATE_CHECKED);
-            dialog_ime_cand_src = cand_panel;
-        }
+        Theme::imeCandidates(dialog_ime, cand_panel);
+        if (cand_panel) dialog_ime_cand_src = cand_panel;
 
         lv_obj_add_state(dialog_input, LV_STATE_FOCUSED);
         lv_obj_scroll_to_view(dialog_input, LV_ANIM_OFF);
@@ -1725,7 +2516,7 @@ private:
 
         lv_obj_t* close_btn = lv_button_create(row);
         lv_obj_set_size(close_btn, 56, 28);
-        styleActionButton(close_btn);
+        Theme::actionButton(close_btn);
         lv_obj_add_event_cb(close_btn, dialog_cancel_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* close_lbl = lv_label_create(close_btn);
         lv_label_set_text(close_lbl, "Close");
@@ -1733,7 +2524,7 @@ private:
 
         share_action_btn = lv_button_create(row);
         lv_obj_set_size(share_action_btn, 72, 28);
-        styleActionButton(share_action_btn);
+        Theme::actionButton(share_action_btn);
         lv_obj_add_event_cb(share_action_btn, share_action_event_cb, LV_EVENT_CLICKED, this);
         share_action_label = lv_label_create(share_action_btn);
         lv_label_set_text(share_action_label, "Start AP");
@@ -1780,20 +2571,30 @@ private:
         } else if (active_drive == 'D') {
             if (!sd_ready || !StorageHelper::getInstance()->isInitialized()) {
                 lv_snprintf(info, sizeof(info), "Drive: D:\nSD unavailable");
+            } else if (!StorageHelper::getInstance()->usageKnown()) {
+                lv_snprintf(
+                    info, sizeof(info),
+                    "Drive: D:\nFS: %s\nCard: %s\nSize: %s\nUsed: counting...\nSectors: %u",
+                    StorageHelper::getInstance()->fsTypeString().c_str(),
+                    StorageHelper::getInstance()->cardTypeString().c_str(),
+                    formatBytesHuman(StorageHelper::getInstance()->totalBytes()).c_str(),
+                    (unsigned)StorageHelper::getInstance()->sectorCount()
+                );
             } else {
                 uint64_t total = StorageHelper::getInstance()->totalBytes();
                 uint64_t used = StorageHelper::getInstance()->usedBytes();
                 uint64_t free_b = (total > used) ? (total - used) : 0;
                 lv_snprintf(
                     info, sizeof(info),
-                    "Drive: D:\nFS: %s\nCard: %s\nUsed: %s / %s (%d%%)\nFree: %s\nSectors: %u",
+                    "Drive: D:\nFS: %s\nCard: %s\nUsed: %s / %s (%d%%)\nFree: %s\nSectors: %u\nBus: %uMHz",
                     StorageHelper::getInstance()->fsTypeString().c_str(),
                     StorageHelper::getInstance()->cardTypeString().c_str(),
                     formatBytesHuman(used).c_str(),
                     formatBytesHuman(total).c_str(),
                     (total > 0) ? (int)((used * 100) / total) : 0,
                     formatBytesHuman(free_b).c_str(),
-                    (unsigned)StorageHelper::getInstance()->sectorCount()
+                    (unsigned)StorageHelper::getInstance()->sectorCount(),
+                    (unsigned)StorageHelper::getInstance()->busMhz()
                 );
             }
         } else {
@@ -1824,7 +2625,7 @@ private:
 
         lv_obj_t* ok = lv_button_create(row);
         lv_obj_set_size(ok, 56, 28);
-        styleActionButton(ok);
+        Theme::actionButton(ok);
         lv_obj_add_event_cb(ok, dialog_cancel_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* ok_lbl = lv_label_create(ok);
         lv_label_set_text(ok_lbl, "OK");
@@ -1899,7 +2700,7 @@ private:
 
         lv_obj_t* ok = lv_button_create(row);
         lv_obj_set_size(ok, 56, 28);
-        styleActionButton(ok);
+        Theme::actionButton(ok);
         lv_obj_add_event_cb(ok, dialog_cancel_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* ok_lbl = lv_label_create(ok);
         lv_label_set_text(ok_lbl, "OK");
@@ -1956,7 +2757,7 @@ private:
 
         lv_obj_t* cancel_btn = lv_button_create(row);
         lv_obj_set_size(cancel_btn, 62, 28);
-        styleActionButton(cancel_btn);
+        Theme::actionButton(cancel_btn);
         lv_obj_add_event_cb(cancel_btn, dialog_cancel_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* cancel_lbl = lv_label_create(cancel_btn);
         lv_label_set_text(cancel_lbl, "Cancel");
@@ -1964,7 +2765,7 @@ private:
 
         lv_obj_t* open_btn = lv_button_create(row);
         lv_obj_set_size(open_btn, 56, 28);
-        styleActionButton(open_btn);
+        Theme::actionButton(open_btn);
         lv_obj_add_event_cb(open_btn, large_open_confirm_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* open_lbl = lv_label_create(open_btn);
         lv_label_set_text(open_lbl, "Open");
@@ -2016,15 +2817,21 @@ private:
 
     void applyRemoveMarked(bool force_delete) {
         if (!file_list || delete_in_progress || copy_in_progress) return;
-        uint32_t count = lv_obj_get_child_count(file_list);
+        std::vector<BatchItem> marked;
+        collectMarkedItems(marked);
         fs_worker_delete_paths.clear();
-        for (uint32_t i = 0; i < count; i++) {
-            lv_obj_t* row = lv_obj_get_child(file_list, i);
-            EntryMeta* meta = (EntryMeta*)lv_obj_get_user_data(row);
-            if (meta && meta->marked) {
-                fs_worker_delete_paths.push_back(meta->vpath);
+        for (size_t i = 0; i < marked.size(); i++) fs_worker_delete_paths.push_back(marked[i].src);
+#if TRASH_ENABLED
+        if (force_delete) {
+            // Renaming into the drive's trash is O(1); whatever cannot be trashed
+            // (already in trash, rename failure) falls through to a real delete.
+            std::vector<String> rest;
+            for (size_t i = 0; i < fs_worker_delete_paths.size(); i++) {
+                if (!trashPath(fs_worker_delete_paths[i])) rest.push_back(fs_worker_delete_paths[i]);
             }
+            fs_worker_delete_paths.swap(rest);
         }
+#endif
         if (fs_worker_delete_paths.empty()) {
             selected_vpath = "";
             remove_mode = false;
@@ -2033,36 +2840,28 @@ private:
             return;
         }
 
-        if (hasAnySdPath(fs_worker_delete_paths) || !ensureFsWorkerTask()) {
-            // Fallback to sync delete if worker creation fails.
-            uint32_t removed = 0;
-            for (size_t i = 0; i < fs_worker_delete_paths.size(); i++) {
-                if (deletePath(fs_worker_delete_paths[i], force_delete)) removed++;
-                delay(0);
-            }
-            selected_vpath = "";
-            remove_mode = false;
-            closeMenuPanel();
-            if (removed) delay(0);
-            refreshUi();
-            fs_worker_delete_paths.clear();
-            return;
-        }
-
+        // SD stays on this task: SD (or worker-less) deletes are stepped from delete_timer.
+        delete_on_ui_task = hasAnySdPath(fs_worker_delete_paths) || !ensureFsWorkerTask();
         fs_worker_delete_force = force_delete;
         fs_worker_delete_total = fs_worker_delete_paths.size();
         fs_worker_delete_done = 0;
         fs_worker_delete_removed = 0;
-        fs_worker_ok = false;
-        fs_worker_done = false;
+        delete_job_done = false;
+        if (!delete_on_ui_task) {
+            FsJob job;
+            job.type = FS_WORK_DELETE_BATCH;
+            job.priority = FS_PRIO_BULK;
+            job.force = force_delete;
+            job.paths = std::make_shared<std::vector<String>>(fs_worker_delete_paths);
+            delete_job_id = submitWorkerJob(job);
+            if (delete_job_id == 0) delete_on_ui_task = true;
+        }
         delete_in_progress = true;
         selected_vpath = "";
         remove_mode = false;
         closeMenuPanel();
         updateMenuActionStates();
         if (!delete_timer) delete_timer = lv_timer_create(delete_timer_cb, 25, this);
-        fs_worker_job = FS_WORK_DELETE_BATCH;
-        xTaskNotifyGive(fs_worker_task);
         refreshUi();
     }
 
@@ -2087,18 +2886,21 @@ private:
             copy_started_ms = millis();
             fs_worker_src_vpath = copied_vpath;
             fs_worker_dst_vpath = dest_v;
-            fs_worker_ok = false;
-            fs_worker_done = false;
             updateMenuActionStates();
             if (menu_panel) lv_obj_remove_flag(menu_panel, LV_OBJ_FLAG_HIDDEN);
             showCopyProgressOnPaste();
             if (involve_sd || !ensureFsWorkerTask()) {
+                StorageHelper::getInstance()->beginBatch();
                 bool ok = copyDirectoryRecursive(copied_vpath, dest_v);
+                if (!StorageHelper::getInstance()->endBatch()) ok = false;
                 if (!ok) {
-                    deletePath(dest_v, true);
-                } else if (copy_total_bytes > 0) {
-                    copy_done_files = copy_total_files;
-                    updateCopyProgressOnPaste(copy_total_bytes, copy_total_bytes);
+                    dropFailedCopy(dest_v);
+                } else {
+                    indexAdded(dest_v);
+                    if (copy_total_bytes > 0) {
+                        copy_done_files = copy_total_files;
+                        updateCopyProgressOnPaste(copy_total_bytes, copy_total_bytes);
+                    }
                 }
                 copy_in_progress = false;
                 copy_cancel_requested = false;
@@ -2109,11 +2911,8 @@ private:
                 refreshUi();
                 return;
             }
-            fs_worker_job = FS_WORK_COPY_DIR;
-            xTaskNotifyGive(fs_worker_task);
             if (!copy_timer) copy_timer = lv_timer_create(copy_timer_cb, 8, this);
             if (!copy_timer) {
-                copy_cancel_requested = true;
                 copy_in_progress = false;
                 copy_dir_worker_mode = false;
                 updateMenuActionStates();
@@ -2121,7 +2920,25 @@ private:
                 closeMenuPanel();
                 list_suspended_for_dialog = false;
                 refreshUi();
+                return;
             }
+            FsJob job;
+            job.type = FS_WORK_COPY_DIR;
+            job.priority = FS_PRIO_BULK;
+            job.a1 = copied_vpath;
+            job.a2 = dest_v;
+            copy_token = std::make_shared<CancelToken>();
+            job.token = copy_token;
+            copy_job_done = false;
+            copy_job_ok = false;
+            copy_job_id = submitWorkerJob(job);
+            if (copy_job_id == 0) {
+                finishCopyJob(false);
+                return;
+            }
+            // Progress lives in the menu panel; the list stays browsable meanwhile.
+            list_suspended_for_dialog = false;
+            refreshUi();
             return;
         }
 
@@ -2140,10 +2957,6 @@ private:
         if (moved_vpath.length() == 0) return;
         char src_drive = driveOf(moved_vpath);
         char dst_drive = active_drive;
-        if (src_drive != dst_drive) {
-            Serial.println("[MOVE] cross-drive move is not supported");
-            return;
-        }
 
         String src_inner = innerPath(moved_vpath);
         String src_name = baseName(src_inner);
@@ -2159,6 +2972,10 @@ private:
         }
 
         String dst_v = nextAvailableVPath(dst_base_v);
+        if (src_drive != dst_drive) {
+            beginCrossMove(moved_vpath, dst_v);
+            return;
+        }
         if (isDirectoryPath(moved_vpath)) {
             String dst_inner = innerPath(dst_v);
             if (dst_inner.startsWith(src_inner + "/")) {
@@ -2179,6 +2996,427 @@ private:
         updateMenuActionStates();
     }
 
+    // L: <-> D: move, stepped from copy_timer with the paste progress bar.
+    void beginCrossMove(const String& src_v, const String& dst_v) {
+        std::vector<BatchItem> plan;
+        plan.push_back(BatchItem(src_v, dst_v, isDirectoryPath(src_v)));
+        beginCrossMoves(plan);
+    }
+
+    // Runs the items one CrossDriveMove after another under one combined progress bar.
+    void beginCrossMoves(const std::vector<BatchItem>& plan) {
+        CrossDriveMove* xm = CrossDriveMove::getInstance();
+        if (plan.empty()) return;
+        if (copy_in_progress || xm->isActive()) {
+            Serial.println("[MOVE] another move is still running");
+            return;
+        }
+        xmove_queue = plan;
+        xmove_next = 0;
+        xmove_base_bytes = 0;
+        xmove_base_files = 0;
+        size_t total_bytes = 0;
+        size_t total_files = 0;
+        sumBatchTotals(xmove_queue, total_bytes, total_files);
+        copy_total_bytes = total_bytes;
+        copy_total_files = total_files;
+        copy_done_bytes = 0;
+        copy_done_files = 0;
+        copy_is_dir_job = plan.size() > 1 || plan[0].is_dir;
+        copy_cancel_requested = false;
+        copy_started_ms = millis();
+        if (!startNextCrossMove()) {
+            Serial.println("[MOVE] cross-drive move could not start");
+            xmove_queue.clear();
+            return;
+        }
+        xmove_in_progress = true;
+        copy_in_progress = true;
+        moved_vpath = "";
+        selected_vpath = "";
+        updateMenuActionStates();
+        if (menu_panel) lv_obj_remove_flag(menu_panel, LV_OBJ_FLAG_HIDDEN);
+        showCopyProgressOnPaste();
+        if (!copy_timer) copy_timer = lv_timer_create(copy_timer_cb, 8, this);
+        if (!copy_timer) {
+            xm->cancel();
+            finishCrossMove(false);
+        }
+    }
+
+    // Starts the first remaining queued item that CrossDriveMove accepts.
+    bool startNextCrossMove() {
+        CrossDriveMove* xm = CrossDriveMove::getInstance();
+        while (xmove_next < xmove_queue.size()) {
+            const BatchItem& it = xmove_queue[xmove_next];
+            if (xm->begin(normalizeVPath(it.src), normalizeVPath(it.dst))) {
+                invalidateListing(it.src);
+                invalidateListing(it.dst);
+                return true;
+            }
+            Serial.println("[MOVE] cannot move " + it.src);
+            xmove_next++;
+        }
+        return false;
+    }
+
+    void stepCrossMove() {
+        CrossDriveMove* xm = CrossDriveMove::getInstance();
+        if (copy_cancel_requested) {
+            xm->cancel();
+            finishCrossMove(false);
+            return;
+        }
+        CrossDriveMove::Status st = xm->step(XMOVE_BYTES_PER_TICK);
+        copy_done_bytes = xmove_base_bytes + (size_t)xm->doneBytes();
+        copy_done_files = xmove_base_files + xm->doneFiles();
+        if (st == CrossDriveMove::XM_RUNNING) {
+            if (copy_total_bytes > 0) updateCopyProgressOnPaste(copy_done_bytes, copy_total_bytes);
+            return;
+        }
+        if (st == CrossDriveMove::XM_DONE) {
+            xmove_base_bytes = copy_done_bytes;
+            xmove_base_files = copy_done_files;
+            invalidateCurrentCrossMove();
+            xmove_next++;
+            if (startNextCrossMove()) return;
+        }
+        finishCrossMove(st == CrossDriveMove::XM_DONE);
+    }
+
+    void invalidateCurrentCrossMove() {
+        if (xmove_next >= xmove_queue.size()) return;
+        invalidateListing(xmove_queue[xmove_next].src);
+        invalidateListing(xmove_queue[xmove_next].dst);
+    }
+
+    void finishCrossMove(bool ok) {
+        if (!ok) Serial.println("[MOVE] cross-drive move stopped");
+        xmove_in_progress = false;
+        invalidateCurrentCrossMove();
+        xmove_queue.clear();
+        xmove_next = 0;
+        cancelCopyJob(false);
+        hideCopyProgressOnPaste();
+        closeMenuPanel();
+        refreshUi();
+    }
+
+    // In mark mode, Copy/Move take every marked row instead of the single selection.
+    void pickMarkedForClipboard() {
+        clip_batch.clear();
+        if (remove_mode) collectMarkedItems(clip_batch);
+    }
+
+    // Marked rows of the current listing, in list order.
+    void collectMarkedItems(std::vector<BatchItem>& out) {
+        out.clear();
+        for (size_t i = 0; i < list_items.size(); i++) {
+            if (list_marked[i]) out.push_back(BatchItem(entryVPath(i), "", list_items.isDir(i)));
+        }
+    }
+
+    // FAT names compare case-insensitively; LittleFS names are exact.
+    static String nameKey(char drive, const String& name) {
+        if (drive != 'D') return name;
+        String k = name;
+        k.toLowerCase();
+        return k;
+    }
+
+    // Picks a destination in the current directory for every clipboard item from one
+    // listing of that directory, instead of probing pathExists per candidate name.
+    bool planBatch(const std::vector<BatchItem>& items, bool is_move, std::vector<BatchItem>& plan) {
+        plan.clear();
+        String dst_dir_v = String(active_drive) + ":" + current_path;
+        EntryArena listing;
+        if (!DirListingCache::getInstance()->get(dst_dir_v, listing)) {
+            std::vector<FileListItem> scanned;
+            if (!scanDirectory(dst_dir_v, scanned)) {
+                Serial.println("[PASTE] cannot list " + dst_dir_v);
+                return false;
+            }
+            listing.assign(scanned);
+        }
+        std::vector<String> taken;
+        taken.reserve(listing.size() + items.size());
+        for (size_t i = 0; i < listing.size(); i++) taken.push_back(nameKey(active_drive, String(listing.name(i))));
+        std::sort(taken.begin(), taken.end());
+
+        for (size_t i = 0; i < items.size(); i++) {
+            const BatchItem& it = items[i];
+            char src_drive = driveOf(it.src);
+            String src_inner = innerPath(it.src);
+            if (src_drive == active_drive) {
+                if (is_move && parentPath(src_inner) == current_path) continue;  // already here
+                if (it.is_dir && (current_path == src_inner || current_path.startsWith(src_inner + "/"))) {
+                    Serial.println("[PASTE] cannot put a directory inside itself: " + it.src);
+                    continue;
+                }
+            }
+            String name = baseName(src_inner);
+            String pick = name;
+            std::vector<String>::iterator pos = std::lower_bound(taken.begin(), taken.end(), nameKey(active_drive, pick));
+            for (int idx = 1; idx < 1000 && pos != taken.end() && *pos == nameKey(active_drive, pick); idx++) {
+                pick = appendIndexToName(name, idx);
+                pos = std::lower_bound(taken.begin(), taken.end(), nameKey(active_drive, pick));
+            }
+            if (pos != taken.end() && *pos == nameKey(active_drive, pick)) {
+                Serial.println("[PASTE] no free name for " + it.src);
+                continue;
+            }
+            taken.insert(pos, nameKey(active_drive, pick));
+            plan.push_back(BatchItem(it.src, String(active_drive) + ":" + joinPath(current_path, pick), it.is_dir));
+        }
+        return true;
+    }
+
+    void sumBatchTotals(const std::vector<BatchItem>& plan, size_t& bytes, size_t& files) {
+        bytes = 0;
+        files = 0;
+        for (size_t i = 0; i < plan.size(); i++) {
+            if (plan[i].is_dir) {
+                bytes += calcDirectoryTotalBytes(plan[i].src);
+                files += calcDirectoryFileCount(plan[i].src);
+            } else {
+                bytes += getFileSize(plan[i].src);
+                files++;
+            }
+        }
+    }
+
+    bool batchTouchesSd(const std::vector<BatchItem>& plan) const {
+        for (size_t i = 0; i < plan.size(); i++) {
+            if (usesSdPath(plan[i].src) || (plan[i].dst.length() > 0 && usesSdPath(plan[i].dst))) return true;
+        }
+        return false;
+    }
+
+    void pasteBatch(bool is_move) {
+        if (clip_batch.empty() || copy_in_progress) return;
+        std::vector<BatchItem> plan;
+        bool planned = planBatch(clip_batch, is_move, plan);
+        if (is_move) {
+            clip_batch.clear();
+            moved_vpath = "";
+        }
+        if (!planned || plan.empty()) {
+            updateMenuActionStates();
+            closeMenuPanel();
+            refreshUi();
+            return;
+        }
+        if (is_move) moveBatch(plan);
+        else copyBatch(plan);
+    }
+
+    // Same-drive items are renames; cross-drive items queue for CrossDriveMove.
+    void moveBatch(const std::vector<BatchItem>& plan) {
+        std::vector<BatchItem> cross;
+        bool sd_batch = false;
+        for (size_t i = 0; i < plan.size(); i++) {
+            if (driveOf(plan[i].src) != driveOf(plan[i].dst)) {
+                cross.push_back(plan[i]);
+                continue;
+            }
+            if (driveOf(plan[i].src) == 'D' && !sd_batch) {
+                StorageHelper::getInstance()->beginBatch();
+                sd_batch = true;
+            }
+            if (!renamePath(plan[i].src, plan[i].dst)) Serial.println("[MOVE] rename/move failed: " + plan[i].src);
+        }
+        if (sd_batch) StorageHelper::getInstance()->endBatch();
+        selected_vpath = "";
+        if (!cross.empty()) {
+            beginCrossMoves(cross);
+            if (xmove_in_progress) return;
+        }
+        updateMenuActionStates();
+        closeMenuPanel();
+        refreshUi();
+    }
+
+    bool copyBatchItem(const BatchItem& it) {
+        bool ok = it.is_dir ? copyDirectoryRecursive(it.src, it.dst)
+                            : copyFile(it.src, it.dst, copy_total_bytes, !copy_dir_worker_mode);
+        if (!ok) dropFailedCopy(it.dst);
+        else indexAdded(it.dst);
+        return ok;
+    }
+
+    void copyBatch(const std::vector<BatchItem>& plan) {
+        suspendListForDialog();
+        copy_total_bytes = 0;
+        copy_done_bytes = 0;
+        copy_total_files = 0;
+        copy_done_files = 0;
+        copy_is_dir_job = true;
+        copy_cancel_requested = false;
+        copy_in_progress = true;
+        copy_started_ms = millis();
+        fs_worker_src_vpath = "";
+        fs_worker_dst_vpath = "";  // failed items are cleaned up per item
+        updateMenuActionStates();
+        if (menu_panel) lv_obj_remove_flag(menu_panel, LV_OBJ_FLAG_HIDDEN);
+        showCopyProgressOnPaste();
+
+        if (batchTouchesSd(plan) || !ensureFsWorkerTask()) {
+            beginSteppedBatch(plan);
+            return;
+        }
+
+        // The worker copies L: only, where walking the trees for totals is quick.
+        size_t total_bytes = 0;
+        size_t total_files = 0;
+        sumBatchTotals(plan, total_bytes, total_files);
+        copy_total_bytes = total_bytes;
+        copy_total_files = total_files;
+        copy_dir_worker_mode = true;
+        if (!copy_timer) copy_timer = lv_timer_create(copy_timer_cb, 8, this);
+        FsJob job;
+        job.type = FS_WORK_COPY_BATCH;
+        job.priority = FS_PRIO_BULK;
+        job.batch = std::make_shared<std::vector<BatchItem>>(plan);
+        copy_token = std::make_shared<CancelToken>();
+        job.token = copy_token;
+        copy_job_done = false;
+        copy_job_ok = false;
+        copy_job_id = copy_timer ? submitWorkerJob(job) : 0;
+        if (copy_job_id == 0) {
+            finishCopyJob(false);
+            return;
+        }
+        list_suspended_for_dialog = false;
+        refreshUi();
+    }
+
+    void beginSteppedBatch(const std::vector<BatchItem>& plan) {
+        copy_dir_worker_mode = false;
+        copy_batch_plan = plan;
+        copy_batch_next = 0;
+        copy_batch_work.clear();
+        copy_batch_count.clear();
+        for (size_t i = 0; i < plan.size(); i++) {
+            if (plan[i].is_dir) {
+                copy_batch_count.push_back(plan[i].src);
+            } else {
+                copy_total_bytes += getFileSize(plan[i].src);
+                copy_total_files++;
+            }
+        }
+        copy_batch_counting = !copy_batch_count.empty();
+        copy_batch_stepped = true;
+        copy_lease = ScratchPool::getInstance()->lease(COPY_IO_CHUNK);
+        if (!copy_timer) copy_timer = lv_timer_create(copy_timer_cb, 8, this);
+        if (!copy_lease || !copy_timer) {
+            Serial.println("[PASTE] cannot start batch copy");
+            finishSteppedBatch(false);
+            return;
+        }
+        list_suspended_for_dialog = false;
+        refreshUi();
+    }
+
+    // One unit per tick: count one directory, copy chunks of the open file, or take the
+    // next entry. SD metadata writes are batched within the tick only.
+    void stepSteppedBatch() {
+        StorageHelper* sh = StorageHelper::getInstance();
+        sh->beginBatch();
+        bool ok = true;
+        bool done = false;
+        if (copy_batch_counting) {
+            countBatchDirectory();
+        } else if (copyFilesOpen()) {
+            int r = pumpCopyChunks();
+            if (r < 0) ok = false;
+            else if (r == 0) closeBatchFile();
+        } else {
+            ok = startBatchEntry(done);
+        }
+        if (!sh->endBatch()) ok = false;
+        if (!ok || done) {
+            finishSteppedBatch(ok);
+            return;
+        }
+        if (copy_total_bytes > 0) updateCopyProgressOnPaste(copy_done_bytes, copy_total_bytes);
+    }
+
+    void countBatchDirectory() {
+        String v = copy_batch_count.back();
+        copy_batch_count.pop_back();
+        std::vector<FileListItem> items;
+        // SORT_BY_SIZE makes the L: scan stat each file for its size.
+        if (scanDirectory(v, items, nullptr, nullptr, SORT_BY_SIZE)) {
+            char d = driveOf(v);
+            String p = innerPath(v);
+            for (size_t i = 0; i < items.size(); i++) {
+                if (items[i].is_dir) {
+                    copy_batch_count.push_back(String(d) + ":" + joinPath(p, items[i].name));
+                } else {
+                    copy_total_bytes += (size_t)items[i].size;
+                    copy_total_files++;
+                }
+            }
+        }
+        if (copy_batch_count.empty()) copy_batch_counting = false;
+    }
+
+    // Makes a directory and queues its entries, or opens the next file pair.
+    bool startBatchEntry(bool& done) {
+        if (copy_batch_work.empty()) {
+            if (copy_batch_next > 0) indexAdded(copy_batch_plan[copy_batch_next - 1].dst);
+            if (copy_batch_next >= copy_batch_plan.size()) {
+                done = true;
+                return true;
+            }
+            copy_batch_work.push_back(copy_batch_plan[copy_batch_next++]);
+        }
+        BatchItem it = copy_batch_work.back();
+        copy_batch_work.pop_back();
+        if (!it.is_dir) {
+            copy_file_base = copy_done_bytes;
+            return openCopyFiles(it.src, it.dst);
+        }
+        if (!makeDir(it.dst)) return false;
+        std::vector<FileListItem> items;
+        if (!scanDirectory(it.src, items)) return false;
+        String sp = innerPath(it.src);
+        String dp = innerPath(it.dst);
+        for (size_t i = items.size(); i-- > 0;) {
+            copy_batch_work.push_back(BatchItem(String(driveOf(it.src)) + ":" + joinPath(sp, items[i].name),
+                                                String(driveOf(it.dst)) + ":" + joinPath(dp, items[i].name),
+                                                items[i].is_dir));
+        }
+        return true;
+    }
+
+    void closeBatchFile() {
+        closeCopyFiles();
+        if (copy_dst_drive == 'D') SdSpaceTracker::getInstance()->noteAllocated(copy_done_bytes - copy_file_base);
+        invalidateListing(String(copy_dst_drive) + ":" + copy_dst_inner);
+        copy_dst_inner = "";  // complete: cancelCopyJob() must not remove it
+        copy_done_files++;
+    }
+
+    void finishSteppedBatch(bool ok) {
+        closeCopyFiles();
+        if (!ok && copy_batch_next > 0) {
+            dropFailedCopy(copy_batch_plan[copy_batch_next - 1].dst);
+        }
+        if (!ok) Serial.println("[PASTE] batch copy stopped");
+        else if (copy_total_bytes > 0) updateCopyProgressOnPaste(copy_total_bytes, copy_total_bytes);
+        copy_dst_inner = "";
+        cancelCopyJob(false);
+        hideCopyProgressOnPaste();
+        closeMenuPanel();
+        list_suspended_for_dialog = false;
+        refreshUi();
+    }
+
+    String normalizeVPath(const String& vpath) const {
+        return String(driveOf(vpath)) + ":" + normalizeInner(innerPath(vpath));
+    }
+
     bool isDirectoryPath(const String& vpath) {
         char d = driveOf(vpath);
         String p = innerPath(vpath);
@@ -2207,21 +3445,19 @@ private:
         String p = innerPath(vpath);
 
         if (d == 'L') {
-            File dir = LittleFS.open(p.c_str(), "r");
-            if (!dir || !dir.isDirectory()) return 0;
-            while (true) {
-                File entry = dir.openNextFile();
-                if (!entry) break;
-                String name = baseName(String(entry.name()));
-                bool is_dir = entry.isDirectory();
-                size_t sz = (size_t)entry.size();
-                entry.close();
-                if (name.length() == 0) continue;
-                String child_v = String('L') + ":" + joinPath(p, name);
-                total += is_dir ? calcDirectoryTotalBytes(child_v) : sz;
+            LfsDirIter dir(p);
+            if (!dir.isOpen()) return 0;
+            String name;
+            bool is_dir = false;
+            while (dir.next(name, is_dir)) {
+                if (is_dir) {
+                    total += calcDirectoryTotalBytes(String('L') + ":" + joinPath(p, name));
+                } else {
+                    uint64_t sz = 0;
+                    if (dir.stat(sz)) total += (size_t)sz;
+                }
                 delay(0);
             }
-            dir.close();
             return total;
         }
 
@@ -2258,20 +3494,14 @@ private:
         String p = innerPath(vpath);
 
         if (d == 'L') {
-            File dir = LittleFS.open(p.c_str(), "r");
-            if (!dir || !dir.isDirectory()) return 0;
-            while (true) {
-                File entry = dir.openNextFile();
-                if (!entry) break;
-                String name = baseName(String(entry.name()));
-                bool is_dir = entry.isDirectory();
-                entry.close();
-                if (name.length() == 0) continue;
-                String child_v = String('L') + ":" + joinPath(p, name);
-                total += is_dir ? calcDirectoryFileCount(child_v) : 1;
+            LfsDirIter dir(p);
+            if (!dir.isOpen()) return 0;
+            String name;
+            bool is_dir = false;
+            while (dir.next(name, is_dir)) {
+                total += is_dir ? calcDirectoryFileCount(String('L') + ":" + joinPath(p, name)) : 1;
                 delay(0);
             }
-            dir.close();
             return total;
         }
 
@@ -2300,7 +3530,7 @@ private:
     }
 
     bool copyDirectoryRecursive(const String& src_vpath, const String& dst_vpath) {
-        if (copy_cancel_requested) return false;
+        if (copyCancelled()) return false;
         if (!makeDir(dst_vpath)) return false;
 
         char src_drive = driveOf(src_vpath);
@@ -2309,20 +3539,18 @@ private:
         String dst_inner = innerPath(dst_vpath);
 
         if (src_drive == 'L') {
-            File dir = LittleFS.open(src_inner.c_str(), "r");
-            if (!dir || !dir.isDirectory()) return false;
+            LfsDirIter dir(src_inner);
+            if (!dir.isOpen()) return false;
+            String name;
+            bool is_dir = false;
             while (true) {
                 delay(0);
-                if (copy_cancel_requested) {
+                serviceUrgentJobs();
+                if (copyCancelled()) {
                     dir.close();
                     return false;
                 }
-                File entry = dir.openNextFile();
-                if (!entry) break;
-                String name = baseName(String(entry.name()));
-                bool is_dir = entry.isDirectory();
-                entry.close();
-                if (name.length() == 0) continue;
+                if (!dir.next(name, is_dir)) break;
 
                 String child_src_v = String(src_drive) + ":" + joinPath(src_inner, name);
                 String child_dst_v = String(dst_drive) + ":" + joinPath(dst_inner, name);
@@ -2344,7 +3572,7 @@ private:
             FsFile entry;
             while (entry.openNext(&dir, O_RDONLY)) {
                 delay(0);
-                if (copy_cancel_requested) {
+                if (copyCancelled()) {
                     entry.close();
                     dir.close();
                     return false;
@@ -2375,10 +3603,6 @@ private:
 
     bool beginCopyJob(const String& src_vpath, const String& dst_vpath, size_t total_bytes) {
         if (copy_in_progress) return false;
-        copy_src_drive = driveOf(src_vpath);
-        copy_dst_drive = driveOf(dst_vpath);
-        copy_src_inner = innerPath(src_vpath);
-        copy_dst_inner = innerPath(dst_vpath);
         copy_total_bytes = total_bytes;
         copy_done_bytes = 0;
         copy_total_files = 0;
@@ -2387,21 +3611,50 @@ private:
         copy_dir_worker_mode = false;
         copy_cancel_requested = false;
         copy_started_ms = millis();
+        copy_lease = ScratchPool::getInstance()->lease(COPY_IO_CHUNK);
+        if (!copy_lease) {
+            Serial.println("[COPY] no buffer memory");
+            cancelCopyJob(false);
+            return false;
+        }
+        if (!openCopyFiles(src_vpath, dst_vpath)) {
+            cancelCopyJob(false);
+            return false;
+        }
 
+        copy_in_progress = true;
+        updateMenuActionStates();
+        if (menu_panel) lv_obj_remove_flag(menu_panel, LV_OBJ_FLAG_HIDDEN);
+        copy_timer = lv_timer_create(copy_timer_cb, 8, this);
+        if (!copy_timer) {
+            cancelCopyJob(true);
+            return false;
+        }
+        return true;
+    }
+
+    // Opens the copy_src_*/copy_dst_* pair that timer-driven copies step through.
+    bool openCopyFiles(const String& src_vpath, const String& dst_vpath) {
+        copy_src_drive = driveOf(src_vpath);
+        copy_dst_drive = driveOf(dst_vpath);
+        copy_src_inner = innerPath(src_vpath);
+        copy_dst_inner = innerPath(dst_vpath);
         bool src_ok = false;
         if (copy_src_drive == 'L') {
             copy_src_lfs = LittleFS.open(copy_src_inner.c_str(), "r");
             src_ok = (copy_src_lfs && !copy_src_lfs.isDirectory());
+            if (src_ok && copy_dst_drive != 'L') src_ok = openNoteDecoder(copy_src_lfs, copy_src_note);
         } else if (copy_src_drive == 'D' && isSdFsReady()) {
             copy_src_sdfs = sdFs().open(copy_src_inner.c_str(), O_RDONLY);
             src_ok = (copy_src_sdfs && !copy_src_sdfs.isDir());
         }
         if (!src_ok) {
-            cancelCopyJob(false);
+            closeCopyFiles();
             return false;
         }
 
         bool dst_ok = false;
+        invalidateListing(dst_vpath);
         if (copy_dst_drive == 'L') {
             copy_dst_lfs = LittleFS.open(copy_dst_inner.c_str(), "w");
             dst_ok = (bool)copy_dst_lfs;
@@ -2410,36 +3663,61 @@ private:
             dst_ok = (bool)copy_dst_sdfs;
         }
         if (!dst_ok) {
-            cancelCopyJob(false);
+            closeCopyFiles();
             return false;
         }
+        return true;
+    }
 
-        copy_in_progress = true;
-        updateMenuActionStates();
-        if (menu_panel) lv_obj_remove_flag(menu_panel, LV_OBJ_FLAG_HIDDEN);
-        copy_timer = lv_timer_create(copy_timer_cb, 8, this);
-        if (!copy_timer) {
-            cancelCopyJob(true);
-            return false;
+    bool copyFilesOpen() {
+        return copy_dst_lfs || copy_dst_sdfs.isOpen();
+    }
+
+    void closeCopyFiles() {
+        copy_src_note.end();
+        if (copy_src_lfs) copy_src_lfs.close();
+        if (copy_dst_lfs) copy_dst_lfs.close();
+        if (copy_src_sdfs) copy_src_sdfs.close();
+        if (copy_dst_sdfs) copy_dst_sdfs.close();
+    }
+
+    // Copies up to COPY_CHUNKS_PER_TICK chunks of the open pair: 1 = more to copy,
+    // 0 = source fully copied, -1 = failed.
+    int pumpCopyChunks() {
+        for (uint8_t i = 0; i < COPY_CHUNKS_PER_TICK; i++) {
+            int n = -1;
+            if (copy_src_note.isActive()) n = copy_src_note.read(copy_lease.data(), copy_lease.size());
+            else if (copy_src_drive == 'L') n = copy_src_lfs.read(copy_lease.data(), copy_lease.size());
+            else if (copy_src_drive == 'D') n = copy_src_sdfs.read(copy_lease.data(), copy_lease.size());
+            if (n < 0) return -1;
+            if (n == 0) return 0;
+
+            int w = -1;
+            if (copy_dst_drive == 'L') w = (int)copy_dst_lfs.write(copy_lease.data(), (size_t)n);
+            else if (copy_dst_drive == 'D') w = (int)copy_dst_sdfs.write(copy_lease.data(), (size_t)n);
+            if (w != n) return -1;
+            copy_done_bytes += (size_t)n;
         }
-        return true;
+        return 1;
     }
 
     void cancelCopyJob(bool remove_partial) {
+        if (copy_token) copy_token->cancel();
         if (copy_timer) {
             lv_timer_del(copy_timer);
             copy_timer = nullptr;
         }
-        if (copy_src_lfs) copy_src_lfs.close();
-        if (copy_dst_lfs) copy_dst_lfs.close();
-        if (copy_src_sdfs) copy_src_sdfs.close();
-        if (copy_dst_sdfs) copy_dst_sdfs.close();
+        closeCopyFiles();
+        copy_lease.release();
         if (remove_partial && copy_dst_inner.length() > 0) {
             if (copy_dst_drive == 'L') LittleFS.remove(copy_dst_inner.c_str());
             else if (copy_dst_drive == 'D' && isSdFsReady()) {
                 sdFs().remove(copy_dst_inner.c_str());
+                SdSpaceTracker::getInstance()->requestResync();
             }
         }
+        // The destination is closed (or gone) now; drop anything listed while it was written.
+        if (copy_dst_inner.length() > 0) invalidateListing(String(copy_dst_drive) + ":" + copy_dst_inner);
         copy_in_progress = false;
         copy_cancel_requested = false;
         copy_src_inner = "";
@@ -2450,20 +3728,31 @@ private:
         copy_done_files = 0;
         copy_is_dir_job = false;
         copy_dir_worker_mode = false;
+        copy_batch_stepped = false;
+        copy_batch_counting = false;
+        copy_batch_plan.clear();
+        copy_batch_work.clear();
+        copy_batch_count.clear();
+        copy_batch_next = 0;
         updateMenuActionStates();
     }
 
     void finishCopyJob(bool success) {
-        if (!success && fs_worker_dst_vpath.length() > 0 &&
-            (fs_worker_job == FS_WORK_COPY_DIR || fs_worker_job == FS_WORK_COPY_FILE)) {
-            deletePath(fs_worker_dst_vpath, true);
+        if (success && copy_dst_drive == 'D' && copy_dst_sdfs) {
+            SdSpaceTracker::getInstance()->noteAllocated(copy_done_bytes);
+        }
+        if (success && copy_dst_inner.length() > 0) indexAdded(String(copy_dst_drive) + ":" + copy_dst_inner);
+        else if (success && fs_worker_dst_vpath.length() > 0) indexAdded(fs_worker_dst_vpath);
+        if (!success && copy_job_id != 0 && fs_worker_dst_vpath.length() > 0) {
+            dropFailedCopy(fs_worker_dst_vpath);
         }
         cancelCopyJob(!success);
         fs_worker_src_vpath = "";
         fs_worker_dst_vpath = "";
-        fs_worker_job = FS_WORK_NONE;
-        fs_worker_done = false;
-        fs_worker_ok = false;
+        copy_job_id = 0;
+        copy_job_done = false;
+        copy_job_ok = false;
+        copy_token.reset();
         hideCopyProgressOnPaste();
         closeMenuPanel();
         list_suspended_for_dialog = false;
@@ -2476,65 +3765,69 @@ private:
             lv_timer_del(delete_timer);
             delete_timer = nullptr;
         }
+        if (delete_on_ui_task) {
+            sd_deleter.cancel();
+            delete_on_ui_task = false;
+        }
+        // A reload may have cached a half-deleted directory while the job ran.
+        for (size_t i = 0; i < fs_worker_delete_paths.size(); i++) {
+            invalidateListing(fs_worker_delete_paths[i]);
+            indexChanged(fs_worker_delete_paths[i]);
+        }
         fs_worker_delete_paths.clear();
         fs_worker_delete_total = 0;
         fs_worker_delete_done = 0;
         fs_worker_delete_removed = 0;
-        fs_worker_done = false;
-        fs_worker_ok = false;
-        fs_worker_job = FS_WORK_NONE;
+        delete_job_id = 0;
+        delete_job_done = false;
         updateMenuActionStates();
         refreshUi();
     }
 
     void stepCopyJob() {
         if (!copy_in_progress) return;
+        if (xmove_in_progress) {
+            stepCrossMove();
+            return;
+        }
+        if (copy_batch_stepped) {
+            if (copy_cancel_requested) finishSteppedBatch(false);
+            else stepSteppedBatch();
+            return;
+        }
+        if (copy_job_id != 0) pumpWorkerEvents();
         if (copy_cancel_requested) {
-            if (fs_worker_job == FS_WORK_COPY_DIR || fs_worker_job == FS_WORK_COPY_FILE) {
-                // Worker observes cancel flag and exits soon; poll until done.
-                if (fs_worker_done) finishCopyJob(false);
+            if (copy_job_id != 0) {
+                // Worker observes the cancel token and exits soon; poll until done.
+                if (copy_job_done) finishCopyJob(false);
                 return;
             }
             finishCopyJob(false);
             return;
         }
 
-        if (fs_worker_job == FS_WORK_COPY_DIR || fs_worker_job == FS_WORK_COPY_FILE) {
+        if (copy_job_id != 0) {
             if (copy_total_bytes > 0) updateCopyProgressOnPaste(copy_done_bytes, copy_total_bytes);
-            if (fs_worker_done) {
-                if (fs_worker_ok && copy_total_bytes > 0) {
+            if (copy_job_done) {
+                if (copy_job_ok && copy_total_bytes > 0) {
                     copy_done_files = copy_total_files;
                     updateCopyProgressOnPaste(copy_total_bytes, copy_total_bytes);
                 }
-                finishCopyJob(fs_worker_ok);
+                finishCopyJob(copy_job_ok);
             }
             return;
         }
 
-        for (uint8_t i = 0; i < COPY_CHUNKS_PER_TICK; i++) {
-            int n = -1;
-            if (copy_src_drive == 'L') n = copy_src_lfs.read(copy_buf, COPY_IO_CHUNK);
-            else if (copy_src_drive == 'D') n = copy_src_sdfs.read(copy_buf, COPY_IO_CHUNK);
-            if (n < 0) {
-                finishCopyJob(false);
-                return;
-            }
-            if (n == 0) {
-                updateCopyProgressOnPaste(copy_total_bytes, copy_total_bytes);
-                finishCopyJob(true);
-                return;
-            }
-
-            int w = -1;
-            if (copy_dst_drive == 'L') w = (int)copy_dst_lfs.write(copy_buf, (size_t)n);
-            else if (copy_dst_drive == 'D') w = (int)copy_dst_sdfs.write(copy_buf, (size_t)n);
-            if (w != n) {
-                finishCopyJob(false);
-                return;
-            }
-            copy_done_bytes += (size_t)n;
+        int r = pumpCopyChunks();
+        if (r < 0) {
+            finishCopyJob(false);
+            return;
+        }
+        if (r == 0) {
+            updateCopyProgressOnPaste(copy_total_bytes, copy_total_bytes);
+            finishCopyJob(true);
+            return;
         }
-
         updateCopyProgressOnPaste(copy_done_bytes, copy_total_bytes);
     }
 
@@ -2581,6 +3874,21 @@ private:
         return p.substring(0, idx);
     }
 
+    void invalidateListing(const String& vpath) const {
+        DirListingCache::getInstance()->invalidatePath(String(driveOf(vpath)) + ":" + normalizeInner(innerPath(vpath)));
+    }
+
+    // Search index upkeep; queued here, applied by FileIndex::step() on the loop task.
+    void indexAdded(const String& vpath) const {
+        FileIndex::getInstance()->noteAdded(driveOf(vpath), normalizeInner(innerPath(vpath)));
+    }
+    void indexRemoved(const String& vpath) const {
+        FileIndex::getInstance()->noteRemoved(driveOf(vpath), normalizeInner(innerPath(vpath)));
+    }
+    void indexChanged(const String& vpath) const {
+        FileIndex::getInstance()->noteChanged(driveOf(vpath), normalizeInner(innerPath(vpath)));
+    }
+
     bool isSdFsReady() const {
         return sd_ready && StorageHelper::getInstance()->isInitialized();
     }
@@ -2600,38 +3908,66 @@ private:
     bool writeTextFile(const String& vpath, const String& data) {
         char d = driveOf(vpath);
         String p = innerPath(vpath);
+        bool ok = false;
         if (d == 'L') {
             File f = LittleFS.open(p.c_str(), "w");
-            if (!f) return false;
-            f.write((const uint8_t*)data.c_str(), data.length());
-            f.close();
-            return true;
+            if (f) {
+                ok = f.write((const uint8_t*)data.c_str(), data.length()) == data.length();
+                f.close();
+            }
+        } else if (d == 'D' && isSdFsReady()) {
+            ok = StorageHelper::getInstance()->writeFile(p.c_str(), data);
         }
-        if (d == 'D' && isSdFsReady()) return StorageHelper::getInstance()->writeFile(p.c_str(), data);
-        return false;
+        invalidateListing(vpath);
+        return ok;
     }
 
     bool makeDir(const String& vpath) {
         char d = driveOf(vpath);
         String p = normalizeInner(innerPath(vpath));
         if (p == "/") return false;
-        if (d == 'L') return LittleFS.mkdir(p.c_str());
-        if (d == 'D' && isSdFsReady()) return sdFs().mkdir(p.c_str(), true);
-        return false;
+        bool ok = false;
+        if (d == 'L') ok = LittleFS.mkdir(p.c_str());
+        else if (d == 'D' && isSdFsReady()) {
+            ok = sdFs().mkdir(p.c_str(), true);
+            if (ok) SdSpaceTracker::getInstance()->noteDirCreated();
+        }
+        invalidateListing(vpath);
+        return ok;
+    }
+
+    bool trashPath(const String& vpath) {
+        char d = driveOf(vpath);
+        String p = normalizeInner(innerPath(vpath));
+        if (d == 'D' && !isSdFsReady()) return false;
+        if (!TrashBin::getInstance()->moveToTrash(d, p)) return false;
+        invalidateListing(vpath);
+        return true;
+    }
+
+    // Removes what a failed copy left behind. Part of it was never counted as
+    // allocated, so the D: free count is retaken instead of trusting noteFreed().
+    void dropFailedCopy(const String& vpath) {
+        deletePath(vpath, true);
+        if (driveOf(vpath) == 'D') SdSpaceTracker::getInstance()->requestResync();
     }
 
     bool deletePath(const String& vpath, bool force_delete) {
         char d = driveOf(vpath);
         String p = normalizeInner(innerPath(vpath));
         if (p == "/") return false;
+        // Before (hide the listing while a tree is removed) and after (drop any read meanwhile).
+        invalidateListing(vpath);
+        bool ok = false;
         if (!force_delete) {
-            if (d == 'L') return deleteLittleFsPathSimple(p);
-            if (d == 'D' && isSdFsReady()) return deleteSdPathSimple(p);
-            return false;
+            if (d == 'L') ok = deleteLittleFsPathSimple(p);
+            else if (d == 'D' && isSdFsReady()) ok = deleteSdPathSimple(p);
+        } else {
+            if (d == 'L') ok = deleteLittleFsPathRecursive(p);
+            else if (d == 'D' && isSdFsReady()) ok = deleteSdPathRecursive(p);
         }
-        if (d == 'L') return deleteLittleFsPathRecursive(p);
-        if (d == 'D' && isSdFsReady()) return deleteSdPathRecursive(p);
-        return false;
+        invalidateListing(vpath);
+        return ok;
     }
 
     bool deleteLittleFsPathSimple(const String& path) {
@@ -2652,22 +3988,14 @@ private:
             return LittleFS.remove(path.c_str());
         }
 
+        node.close();
         bool ok = true;
         std::vector<String> children;
-        while (true) {
-            File entry = node.openNextFile();
-            if (!entry) break;
-            String name = baseName(String(entry.name()));
-            entry.close();
-
-            if (name.length() == 0 || name == "." || name == "..") {
-                ok = false;
-                continue;
-            }
-            String child = joinPath(path, name);
-            children.push_back(child);
-        }
-        node.close();
+        LfsDirIter dir(path);
+        String name;
+        bool child_dir = false;
+        while (dir.next(name, child_dir)) children.push_back(joinPath(path, name));
+        dir.close();
 
         for (size_t i = 0; i < children.size(); i++) {
             if (!deleteLittleFsPathRecursive(children[i])) ok = false;
@@ -2679,77 +4007,10 @@ private:
     }
 
     bool deleteSdPathRecursive(const String& path) {
-        SdFs& fs = StorageHelper::getInstance()->getFs();
-        struct Node {
-            String p;
-            bool expanded;
-        };
-
-        // Iterative post-order delete to avoid deep recursion stack overflow.
-        std::vector<Node> stack;
-        stack.push_back({path, false});
-
-        bool ok = true;
-        uint32_t ops = 0;
-        const uint32_t MAX_OPS = 60000;  // safety guard for malformed trees
-
-        while (!stack.empty()) {
-            Node cur = stack.back();
-            stack.pop_back();
-
-            FsFile node = fs.open(cur.p.c_str(), O_RDONLY);
-            if (!node) {
-                ok = false;
-                continue;
-            }
-
-            if (!node.isDir()) {
-                node.close();
-                if (!fs.remove(cur.p.c_str())) {
-                    ok = false;
-                }
-                if ((++ops & 0x0F) == 0) delay(0);
-                if (ops > MAX_OPS) {
-                    return false;
-                }
-                continue;
-            }
-
-            if (cur.expanded) {
-                node.close();
-                if (!fs.rmdir(cur.p.c_str())) {
-                    ok = false;
-                }
-                if ((++ops & 0x0F) == 0) delay(0);
-                if (ops > MAX_OPS) {
-                    return false;
-                }
-                continue;
-            }
-
-            // First visit: re-push this dir as expanded, then children.
-            stack.push_back({cur.p, true});
-
-            FsFile entry;
-            while (entry.openNext(&node, O_RDONLY)) {
-                char name[256];
-                entry.getName(name, sizeof(name));
-                entry.close();
-
-                if (name[0] == '\0') continue;
-                if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
-
-                String child = joinPath(cur.p, String(name));
-                if (child == cur.p) continue;
-                stack.push_back({child, false});
-            }
-            node.close();
-
-            if ((++ops & 0x0F) == 0) delay(0);
-            if (ops > MAX_OPS) {
-                return false;
-            }
-        }
+        // One metadata flush for the whole tree instead of one per removed entry.
+        StorageHelper::getInstance()->beginBatch();
+        bool ok = sd_deleter.begin(StorageHelper::getInstance()->getFs(), path) && sd_deleter.runToEnd();
+        if (!StorageHelper::getInstance()->endBatch()) ok = false;
         return ok;
     }
 
@@ -2758,22 +4019,24 @@ private:
         FsFile node = fs.open(path.c_str(), O_RDONLY);
         if (!node) return false;
         bool is_dir = node.isDir();
+        uint64_t size = is_dir ? 0 : node.fileSize();
         node.close();
-        if (is_dir) return fs.rmdir(path.c_str());
-        return fs.remove(path.c_str());
+        if (is_dir) {
+            if (!fs.rmdir(path.c_str())) return false;
+            SdSpaceTracker::getInstance()->noteDirRemoved();
+            return true;
+        }
+        if (!fs.remove(path.c_str())) return false;
+        SdSpaceTracker::getInstance()->noteFreed(size);
+        return true;
     }
 
     void countMarkedEntries(uint32_t& files, uint32_t& dirs) {
         files = 0;
         dirs = 0;
-        if (!file_list) return;
-        uint32_t count = lv_obj_get_child_count(file_list);
-        for (uint32_t i = 0; i < count; i++) {
-            lv_obj_t* row = lv_obj_get_child(file_list, i);
-            if (row == empty_label) continue;
-            EntryMeta* meta = (EntryMeta*)lv_obj_get_user_data(row);
-            if (!meta || !meta->marked) continue;
-            if (meta->is_dir) dirs++;
+        for (size_t i = 0; i < list_items.size(); i++) {
+            if (!list_marked[i]) continue;
+            if (list_items.isDir(i)) dirs++;
             else files++;
         }
     }
@@ -2807,7 +4070,11 @@ private:
         char msg[192];
         lv_snprintf(
             msg, sizeof(msg),
+#if TRASH_ENABLED
+            "Selected: %u files, %u dirs\nNormal: non-empty folders fail.\nForce: move to trash.",
+#else
             "Selected: %u files, %u dirs\nNormal: non-empty folders fail.\nForce: recursive delete.",
+#endif
             (unsigned)file_cnt, (unsigned)dir_cnt
         );
         lv_label_set_text(txt, msg);
@@ -2834,7 +4101,7 @@ private:
 
         lv_obj_t* cancel_btn = lv_button_create(row);
         lv_obj_set_size(cancel_btn, 60, 28);
-        styleActionButton(cancel_btn);
+        Theme::actionButton(cancel_btn);
         lv_obj_add_event_cb(cancel_btn, dialog_cancel_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* cancel_lbl = lv_label_create(cancel_btn);
         lv_label_set_text(cancel_lbl, "Cancel");
@@ -2842,7 +4109,7 @@ private:
 
         lv_obj_t* normal_btn = lv_button_create(row);
         lv_obj_set_size(normal_btn, 60, 28);
-        styleActionButton(normal_btn);
+        Theme::actionButton(normal_btn);
         lv_obj_add_event_cb(normal_btn, remove_normal_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* normal_lbl = lv_label_create(normal_btn);
         lv_label_set_text(normal_lbl, "Normal");
@@ -2850,7 +4117,7 @@ private:
 
         lv_obj_t* force_btn = lv_button_create(row);
         lv_obj_set_size(force_btn, 52, 28);
-        styleActionButton(force_btn);
+        Theme::actionButton(force_btn);
         lv_obj_add_event_cb(force_btn, remove_force_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* force_lbl = lv_label_create(force_btn);
         lv_label_set_text(force_lbl, "Force");
@@ -2862,9 +4129,16 @@ private:
         if (d != driveOf(to_vpath)) return false;
         String from = innerPath(from_vpath);
         String to = innerPath(to_vpath);
-        if (d == 'L') return LittleFS.rename(from.c_str(), to.c_str());
-        if (d == 'D' && isSdFsReady()) return sdFs().rename(from.c_str(), to.c_str());
-        return false;
+        bool ok = false;
+        if (d == 'L') ok = LittleFS.rename(from.c_str(), to.c_str());
+        else if (d == 'D' && isSdFsReady()) ok = sdFs().rename(from.c_str(), to.c_str());
+        invalidateListing(from_vpath);
+        invalidateListing(to_vpath);
+        if (ok) {
+            indexRemoved(from_vpath);
+            indexAdded(to_vpath);
+        }
+        return ok;
     }
 
     String formatEta(uint32_t seconds) const {
@@ -2951,15 +4225,39 @@ private:
         }
     }
 
+    // Copies leaving L: carry the note's text, not its LZSS blob: starts reader on a
+    // compressed note (left inactive for plain files). False on a probe/memory failure.
+    bool openNoteDecoder(File& in, NoteCodec::Reader<File>& reader) {
+        bool compressed = false;
+        uint32_t raw_len = 0;
+        if (!NoteCodec::probe(in, (uint64_t)in.size(), compressed, raw_len)) return false;
+        return !compressed || reader.begin(in, raw_len);
+    }
+
+    // Listings are invalidated before (no stale entry while the copy runs) and after
+    // (a reload meanwhile may have cached the half-written file).
     bool copyFile(const String& src_vpath, const String& dst_vpath, size_t total_bytes = 0, bool show_progress = false) {
+        invalidateListing(dst_vpath);
+        bool ok = copyFileData(src_vpath, dst_vpath, total_bytes, show_progress);
+        invalidateListing(dst_vpath);
+        return ok;
+    }
+
+    bool copyFileData(const String& src_vpath, const String& dst_vpath, size_t total_bytes, bool show_progress) {
         char sd = driveOf(src_vpath);
         char dd = driveOf(dst_vpath);
         String sp = innerPath(src_vpath);
         String dp = innerPath(dst_vpath);
-        static constexpr size_t CHUNK = 1024;
-        uint8_t buf[CHUNK];
+        ScratchLease lease = ScratchPool::getInstance()->lease(COPY_FILE_CHUNK);
+        if (!lease) {
+            Serial.println("[COPY] no buffer memory");
+            return false;
+        }
+        uint8_t* buf = lease.data();
+        const size_t CHUNK = lease.size();
         size_t copied = 0;
         uint32_t chunks = 0;
+        const bool on_worker = onWorkerTask();
 
         auto transferLoop = [&](const std::function<int(uint8_t*, size_t)>& read_fn,
                                 const std::function<int(const uint8_t*, size_t)>& write_fn,
@@ -2967,27 +4265,40 @@ private:
                                 const std::function<void()>& remove_partial_fn) -> bool {
             while (true) {
                 delay(0);
-                if (copy_cancel_requested) {
+                int n = copyCancelled() ? -1 : read_fn(buf, CHUNK);
+                if (n < 0) {
                     close_fn();
                     remove_partial_fn();
+                    if (dd == 'D') SdSpaceTracker::getInstance()->requestResync();
                     return false;
                 }
-                int n = read_fn(buf, CHUNK);
-                if (n <= 0) break;
+                if (n == 0) break;
                 if (write_fn(buf, (size_t)n) != n) {
                     close_fn();
+                    if (dd == 'D') SdSpaceTracker::getInstance()->requestResync();
                     return false;
                 }
                 copied += (size_t)n;
-                copy_done_bytes += (size_t)n;
-                if (show_progress && ((++chunks & 0x03) == 0)) {
-                    updateCopyProgressOnPaste(copy_done_bytes, total_bytes);
-                    lv_refr_now(NULL);
+                if (on_worker) {
+                    worker_done_bytes += (size_t)n;
+                    if ((++chunks & 0x0F) == 0) postWorkerEvent(FS_EVT_PROGRESS, true, worker_done_files, 0);
+                } else {
+                    copy_done_bytes += (size_t)n;
+                    if (show_progress && ((++chunks & 0x03) == 0)) {
+                        updateCopyProgressOnPaste(copy_done_bytes, total_bytes);
+                        lv_refr_now(NULL);
+                    }
                 }
                 delay(0);
             }
             close_fn();
-            if (copy_is_dir_job) copy_done_files++;
+            if (dd == 'D') SdSpaceTracker::getInstance()->noteAllocated(copied);
+            if (on_worker) {
+                worker_done_files++;
+                postWorkerEvent(FS_EVT_PROGRESS, true, worker_done_files, 0);
+            } else if (copy_is_dir_job) {
+                copy_done_files++;
+            }
             if (show_progress) updateCopyProgressOnPaste(copy_done_bytes, total_bytes);
             return true;
         };
@@ -3020,11 +4331,13 @@ private:
         if (sd == 'L' && dd == 'D' && isSdFsReady()) {
             File in = LittleFS.open(sp.c_str(), "r");
             if (!in || in.isDirectory()) return false;
+            NoteCodec::Reader<File> note;
+            if (!openNoteDecoder(in, note)) { in.close(); return false; }
             SdFs& fs = sdFs();
             FsFile out = fs.open(dp.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
             if (!out) { in.close(); return false; }
             return transferLoop(
-                [&](uint8_t* b, size_t s) -> int { return in.read(b, s); },
+                [&](uint8_t* b, size_t s) -> int { return note.isActive() ? note.read(b, s) : (int)in.read(b, s); },
                 [&](const uint8_t* b, size_t s) -> int { return (int)out.write(b, s); },
                 [&]() { in.close(); out.close(); },
                 [&]() { fs.remove(dp.c_str()); }
@@ -3053,15 +4366,17 @@ private:
         if (d == 'L') {
             File f = LittleFS.open(p.c_str(), "r");
             if (!f) return false;
-            while (f.available()) {
-                int c = f.read();
-                if (c < 0) break;
-                out += (char)c;
-            }
+            bool ok = NoteCodec::readAll(f, (size_t)f.size(), out);
             f.close();
-            return true;
+            return ok;
+        }
+        if (d == 'D' && isSdFsReady()) {
+            FsFile f = StorageHelper::getInstance()->getFs().open(p.c_str(), O_RDONLY);
+            if (!f.isOpen()) return false;
+            bool ok = NoteCodec::readAll(f, (size_t)f.fileSize(), out);
+            f.close();
+            return ok;
         }
-        if (d == 'D' && isSdFsReady()) return StorageHelper::getInstance()->readFile(p.c_str(), out);
         return false;
     }
 
@@ -3087,35 +4402,222 @@ private:
 
     void stepDeleteJob() {
         if (!delete_in_progress) return;
-        if (!fs_worker_done) return;
+        if (delete_on_ui_task) {
+            // One metadata flush per tick: nothing deferred is left for a card pull.
+            StorageHelper::getInstance()->beginBatch();
+            stepUiDeleteJob();
+            StorageHelper::getInstance()->endBatch();
+            return;
+        }
+        pumpWorkerEvents();
+        if (!delete_job_done) return;
         finishDeleteJob();
     }
 
+    // One timer tick of a delete batch run on the UI task. Forced SD deletes advance
+    // sd_deleter a bounded number of entries per tick; everything else is one path per tick.
+    void stepUiDeleteJob() {
+        if (sd_deleter.isRunning()) {
+            if (sd_deleter.step(SD_DELETE_OPS_PER_TICK) == SdTreeDeleter::DEL_RUNNING) return;
+            if (sd_deleter.succeeded()) fs_worker_delete_removed++;
+            fs_worker_delete_done++;
+            return;
+        }
+        if (fs_worker_delete_done >= fs_worker_delete_paths.size()) {
+            finishDeleteJob();
+            return;
+        }
+        const String& vpath = fs_worker_delete_paths[fs_worker_delete_done];
+        if (fs_worker_delete_force && driveOf(vpath) == 'D' && isSdFsReady()) {
+            String p = normalizeInner(innerPath(vpath));
+            invalidateListing(vpath);
+            if (p != "/" && sd_deleter.begin(StorageHelper::getInstance()->getFs(), p)) {
+                if (sd_deleter.isRunning()) return;
+                fs_worker_delete_removed++;
+            }
+            fs_worker_delete_done++;
+            return;
+        }
+        if (deletePath(vpath, fs_worker_delete_force)) fs_worker_delete_removed++;
+        fs_worker_delete_done++;
+    }
+
     void finishFsJob() {
         fs_job_in_progress = false;
-        if (fs_job_timer) {
-            lv_timer_del(fs_job_timer);
-            fs_job_timer = nullptr;
-        }
-        fs_worker_job = FS_WORK_NONE;
-        fs_worker_arg1 = "";
-        fs_worker_arg2 = "";
-        fs_worker_done = false;
-        fs_worker_ok = false;
+        op_job_id = 0;
+        op_job_done = false;
         list_suspended_for_dialog = false;
         updateMenuActionStates();
         refreshUi();
     }
 
+    // fs_job_timer: drains worker events and retires finished jobs; the timer lives
+    // while any worker job is outstanding.
     void stepFsJob() {
-        if (!fs_job_in_progress) return;
-        if (!fs_worker_done) return;
-        if (fs_worker_job == FS_WORK_SCAN_DIR) {
+        pumpWorkerEvents();
+        if (scan_in_progress && scan_live) pumpScanPipe();
+        if (op_job_id != 0 && op_job_done) finishFsJob();
+        if (scan_refresh_pending) {
+            scan_refresh_pending = false;
+            if (!list_suspended_for_dialog) refreshUi();
+        }
+        if (copy_job_id == 0 && delete_job_id == 0 && op_job_id == 0 && scan_job_id == 0 && prefetch_job_id == 0 &&
+            fs_job_timer) {
+            lv_timer_del(fs_job_timer);
+            fs_job_timer = nullptr;
+        }
+    }
+
+    // UI task is the only consumer of fs_events.
+    void pumpWorkerEvents() {
+        FsJobEvent ev;
+        while (fs_events.pop(ev)) handleWorkerEvent(ev);
+        if (!fs_done_lock) return;
+        std::vector<FsJobEvent> late;
+        xSemaphoreTake(fs_done_lock, portMAX_DELAY);
+        late.swap(fs_done_overflow);
+        xSemaphoreGive(fs_done_lock);
+        for (size_t i = 0; i < late.size(); i++) handleWorkerEvent(late[i]);
+    }
+
+    void handleWorkerEvent(const FsJobEvent& ev) {
+        if (ev.job_id == 0) return;
+        if (ev.job_id == copy_job_id) {
+            copy_done_bytes = (size_t)ev.bytes;
+            copy_done_files = ev.count;
+            if (ev.kind == FS_EVT_DONE) {
+                copy_job_done = true;
+                copy_job_ok = ev.ok;
+            }
+        } else if (ev.job_id == delete_job_id) {
+            fs_worker_delete_done = ev.count;
+            fs_worker_delete_removed = ev.aux;
+            if (ev.kind == FS_EVT_DONE) delete_job_done = true;
+        } else if (ev.job_id == op_job_id) {
+            if (ev.kind == FS_EVT_DONE) op_job_done = true;
+        } else if (ev.job_id == prefetch_job_id && ev.kind == FS_EVT_DONE) {
+            prefetch_job_id = 0;
+        } else if (ev.job_id == scan_job_id && ev.kind == FS_EVT_DONE) {
+            // The last batch was published before this event; reloadEntries drains it.
+            scan_token.reset();
+            scan_job_id = 0;
             scan_in_progress = false;
-            scan_result_ok = fs_worker_ok;
+            scan_result_ok = ev.ok;
             scan_result_ready = true;
+            scan_refresh_pending = true;
         }
-        finishFsJob();
+    }
+
+    bool onWorkerTask() const {
+        return fs_worker_task && xTaskGetCurrentTaskHandle() == fs_worker_task;
+    }
+
+    bool copyCancelled() const {
+        if (onWorkerTask()) return worker_token && worker_token->isCancelled();
+        return copy_cancel_requested;
+    }
+
+    // Worker task only. Progress may be dropped if the UI lags; DONE never is: when the
+    // ring is full it goes to fs_done_overflow instead of waiting on the UI.
+    void postWorkerEvent(FsJobEventKind kind, bool ok, uint32_t count, uint32_t aux) {
+        FsJobEvent ev;
+        ev.job_id = worker_job_id;
+        ev.kind = kind;
+        ev.ok = ok;
+        ev.count = count;
+        ev.aux = aux;
+        ev.bytes = worker_done_bytes;
+        if (kind != FS_EVT_DONE) {
+            fs_events.push(ev);
+            return;
+        }
+        if (fs_events.push(ev) || !fs_done_lock) return;
+        xSemaphoreTake(fs_done_lock, portMAX_DELAY);
+        fs_done_overflow.push_back(ev);
+        xSemaphoreGive(fs_done_lock);
+    }
+
+    // Runs queued jobs that outrank the current one (e.g. a scan the user is waiting
+    // on) between units of a bulk job, never while a destination file is open (the
+    // scan would list it half-written). No-op off the worker task.
+    void serviceUrgentJobs() {
+        if (!onWorkerTask()) return;
+        FsJob job;
+        while (fs_jobs.popAtLeast((int)worker_priority + 1, job)) runWorkerJob(job);
+    }
+
+    // Worker task only; re-entered from serviceUrgentJobs() when a job is preempted.
+    void runWorkerJob(FsJob& job) {
+        uint32_t prev_id = worker_job_id;
+        uint8_t prev_priority = worker_priority;
+        std::shared_ptr<CancelToken> prev_token = worker_token;
+        uint64_t prev_bytes = worker_done_bytes;
+        uint32_t prev_files = worker_done_files;
+        worker_job_id = job.id;
+        worker_priority = job.priority;
+        worker_token = job.token;
+        worker_done_bytes = 0;
+        worker_done_files = 0;
+
+        bool ok = false;
+        uint32_t count = 0;
+        uint32_t removed = 0;
+        if (!job.token || !job.token->isCancelled()) {
+            if (job.type == FS_WORK_COPY_DIR) {
+                ok = copyDirectoryRecursive(job.a1, job.a2);
+            } else if (job.type == FS_WORK_COPY_BATCH && job.batch) {
+                ok = true;
+                for (size_t i = 0; ok && i < job.batch->size(); i++) {
+                    ok = copyBatchItem((*job.batch)[i]);
+                    serviceUrgentJobs();
+                }
+            } else if (job.type == FS_WORK_DELETE_BATCH && job.paths) {
+                ok = true;
+                for (size_t i = 0; i < job.paths->size(); i++) {
+                    if (deletePath((*job.paths)[i], job.force)) removed++;
+                    count = (uint32_t)(i + 1);
+                    postWorkerEvent(FS_EVT_PROGRESS, true, count, removed);
+                    serviceUrgentJobs();
+                    delay(0);
+                }
+            } else if (job.type == FS_WORK_CREATE_FILE) {
+                ok = writeTextFile(job.a1, "");
+                if (ok) indexAdded(job.a1);
+            } else if (job.type == FS_WORK_CREATE_DIR) {
+                ok = makeDir(job.a1);
+                if (ok) indexAdded(job.a1);
+            } else if (job.type == FS_WORK_RENAME) {
+                ok = renamePath(job.a1, job.a2);
+            } else if (job.type == FS_WORK_SCAN_DIR && job.pipe) {
+                std::vector<FileListItem> part;
+                ok = scanDirectory(job.a1, part, job.token.get(), job.pipe.get(), job.order);
+            } else if (job.type == FS_WORK_PREFETCH && job.paths) {
+                // Same scan as FS_WORK_SCAN_DIR, straight into the cache; the generation
+                // check drops a listing that a mutation invalidated meanwhile.
+                DirListingCache* cache = DirListingCache::getInstance();
+                std::vector<FileListItem> items;
+                EntryArena arena;
+                ok = true;
+                for (size_t i = 0; i < job.paths->size() && !job.token->isCancelled(); i++) {
+                    const String& v = (*job.paths)[i];
+                    if (cache->contains(v)) continue;
+                    uint32_t gen = cache->generation();
+                    if (!scanDirectory(v, items, job.token.get(), nullptr, job.order)) continue;
+                    std::sort(items.begin(), items.end(), EntryOrder(job.order));
+                    arena.assign(items);
+                    cache->put(v, arena, gen);
+                    count++;
+                }
+            }
+        }
+        if (job.type != FS_WORK_DELETE_BATCH) count = worker_done_files;
+        postWorkerEvent(FS_EVT_DONE, ok, count, removed);
+
+        worker_job_id = prev_id;
+        worker_priority = prev_priority;
+        worker_token = prev_token;
+        worker_done_bytes = prev_bytes;
+        worker_done_files = prev_files;
     }
 
     bool ensureFsWorkerTask() {
@@ -3132,8 +4634,21 @@ private:
         return rc == pdPASS;
     }
 
+    // Queues a job for fm_fs_worker (L: only; SD stays on this task). Returns its id, 0 on failure.
+    // Anything above idle priority cancels a running prefetch so the worker is free for it.
+    uint32_t submitWorkerJob(FsJob& job) {
+        if (!ensureFsWorkerTask()) return 0;
+        if (job.priority > FS_PRIO_IDLE) cancelPrefetch();
+        if (!job.token) job.token = std::make_shared<CancelToken>();
+        uint32_t id = fs_jobs.push(job);
+        if (!fs_job_timer) fs_job_timer = lv_timer_create(fs_job_timer_cb, 20, this);
+        xTaskNotifyGive(fs_worker_task);
+        return id;
+    }
+
     bool startFsJob(FsWorkerJobType job, const String& a1, const String& a2, bool refresh_after) {
-        if (fs_job_in_progress || copy_in_progress || delete_in_progress) return false;
+        if (fs_job_in_progress || delete_in_progress) return false;
+        if (job == FS_WORK_RENAME && copy_in_progress) return false;
         bool touch_sd = false;
         if (job == FS_WORK_CREATE_FILE || job == FS_WORK_CREATE_DIR) touch_sd = usesSdPath(a1);
         else if (job == FS_WORK_RENAME) touch_sd = usesSdPath(a1) || usesSdPath(a2);
@@ -3142,35 +4657,51 @@ private:
             if (job == FS_WORK_CREATE_FILE) ok = writeTextFile(a1, "");
             else if (job == FS_WORK_CREATE_DIR) ok = makeDir(a1);
             else if (job == FS_WORK_RENAME) ok = renamePath(a1, a2);
+            if (ok && job != FS_WORK_RENAME) indexAdded(a1);
             if (refresh_after) refreshUi();
             return ok;
         }
-        if (!ensureFsWorkerTask()) return false;
         LV_UNUSED(refresh_after);
-        fs_worker_arg1 = a1;
-        fs_worker_arg2 = a2;
-        fs_worker_ok = false;
-        fs_worker_done = false;
-        fs_worker_job = job;
+        FsJob j;
+        j.type = job;
+        j.priority = FS_PRIO_NORMAL;
+        j.a1 = a1;
+        j.a2 = a2;
+        uint32_t id = submitWorkerJob(j);
+        if (id == 0) return false;
+        op_job_id = id;
+        op_job_done = false;
         fs_job_in_progress = true;
         updateMenuActionStates();
-        if (!fs_job_timer) fs_job_timer = lv_timer_create(fs_job_timer_cb, 20, this);
-        xTaskNotifyGive(fs_worker_task);
         return true;
     }
 
+    // Interactive priority: runs ahead of (and between chunks of) a bulk copy/delete.
+    // A scan for a directory the user already left is cancelled.
     bool startScanJob(const String& vpath) {
-        if (scan_in_progress || fs_job_in_progress || copy_in_progress || delete_in_progress) return false;
-        if (!ensureFsWorkerTask()) return false;
-        fs_worker_scan_items.clear();
+        if (scan_in_progress && fs_worker_scan_vpath == vpath) return true;
+        leaveRunningScan();
+        uint32_t gen = DirListingCache::getInstance()->generation();
+        FsJob job;
+        job.type = FS_WORK_SCAN_DIR;
+        job.priority = FS_PRIO_INTERACTIVE;
+        job.a1 = vpath;
+        job.token = std::make_shared<CancelToken>();
+        job.pipe = std::make_shared<BatchPipe<FileListItem>>();
+        job.order = sort_order;
+        uint32_t id = submitWorkerJob(job);
+        if (id == 0) {
+            scan_in_progress = false;
+            scan_job_id = 0;
+            return false;
+        }
+        scan_job_id = id;
+        scan_token = job.token;
+        scan_pipe = job.pipe;
         fs_worker_scan_vpath = vpath;
-        fs_worker_ok = false;
-        fs_worker_done = false;
-        fs_worker_job = FS_WORK_SCAN_DIR;
+        scan_cache_gen = gen;
         scan_in_progress = true;
-        fs_job_in_progress = true;
-        if (!fs_job_timer) fs_job_timer = lv_timer_create(fs_job_timer_cb, 20, this);
-        xTaskNotifyGive(fs_worker_task);
+        beginScanView(vpath);
         return true;
     }
 
@@ -3190,15 +4721,15 @@ private:
                 node.close();
                 return true;
             }
+            node.close();
+            LfsDirIter dir(p);
             uint32_t iter = 0;
-            while (true) {
-                File e = node.openNextFile();
-                if (!e) break;
-                if (!e.isDirectory()) file_count++;
-                e.close();
+            String name;
+            bool child_dir = false;
+            while (dir.next(name, child_dir)) {
+                if (!child_dir) file_count++;
                 if ((++iter & 0x0F) == 0) delay(0);
             }
-            node.close();
             return true;
         }
 
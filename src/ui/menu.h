@@ -3,6 +3,7 @@
 
 #include <lvgl.h>
 #include "../config.h"
+#include "theme.h"
 
 enum MenuAction {
     MENU_SAVE,
@@ -89,18 +90,10 @@ private:
         lv_obj_t* btn = lv_btn_create(menu_list);
         lv_obj_set_size(btn, 150, 30);
         lv_obj_set_flex_grow(btn, 0);
-        lv_obj_set_style_radius(btn, 4, 0);
-        lv_obj_set_style_bg_color(btn, lv_color_hex(0x1E1E1E), LV_STATE_DEFAULT);
-        lv_obj_set_style_bg_color(btn, lv_color_hex(0x5CB8FF), LV_STATE_PRESSED);
-        lv_obj_set_style_bg_color(btn, lv_color_hex(0x8ED1FF), LV_STATE_FOCUSED);
-        lv_obj_set_style_border_color(btn, lv_color_hex(0x404040), LV_STATE_DEFAULT);
-        lv_obj_set_style_border_color(btn, lv_color_hex(0x8ED1FF), LV_STATE_PRESSED);
-        lv_obj_set_style_border_color(btn, lv_color_hex(0x8ED1FF), LV_STATE_FOCUSED);
-        lv_obj_set_style_shadow_width(btn, 0, 0);
+        Theme::actionButton(btn);
         
         lv_obj_t* lbl = lv_label_create(btn);
         lv_label_set_text(lbl, label);
-        lv_obj_set_style_text_color(lbl, lv_color_hex(0xFFFFFF), 0);
         lv_obj_center(lbl);
         
         // Set different styles for different buttons
@@ -0,0 +1,229 @@
+#ifndef THEME_H
+#define THEME_H
+
+#include <lvgl.h>
+#include "fonts.h"
+
+// Theme - shared lv_style_t objects for widgets every screen builds the same way.
+// One style is initialised once and referenced by each object through
+// lv_obj_add_style(), instead of each object carrying its own copy of the same local
+// properties. Built on first use, after FontManager::init().
+class Theme {
+public:
+    static constexpr int32_t LIST_ROW_PAD_V = 2;
+
+private:
+    static bool ready;
+    static lv_style_t btn;
+    static lv_style_t btn_pressed;
+    static lv_style_t btn_focused;
+    static lv_style_t btn_active;
+    static lv_style_t icon_label;
+    static lv_style_t row;
+    static lv_style_t row_pressed;
+    static lv_style_t row_focused;
+    static lv_style_t row_marked;
+    static lv_style_t row_label;
+    static lv_style_t kb;
+    static lv_style_t kb_key;
+    static lv_style_t kb_key_focused;
+    static lv_style_t kb_key_pressed;
+    static lv_style_t kb_key_checked;
+    static lv_style_t kb_key_disabled;
+    static lv_style_t cand;
+    static lv_style_t cand_items;
+    static lv_style_t cand_panel;
+    static lv_style_t cand_panel_items;
+    static lv_style_t cand_panel_focused;
+    static lv_style_t cand_panel_pressed;
+    static lv_style_t cand_panel_checked;
+    static lv_style_t text_white;
+
+    static void init() {
+        if (ready) return;
+        ready = true;
+
+        lv_style_init(&btn);
+        lv_style_set_radius(&btn, 4);
+        lv_style_set_bg_color(&btn, lv_color_hex(0x1E1E1E));
+        lv_style_set_border_color(&btn, lv_color_hex(0x404040));
+        lv_style_set_text_color(&btn, lv_color_hex(0xFFFFFF));
+        lv_style_set_shadow_width(&btn, 0);
+        lv_style_init(&btn_pressed);
+        lv_style_set_bg_color(&btn_pressed, lv_color_hex(0x5CB8FF));
+        lv_style_set_border_color(&btn_pressed, lv_color_hex(0x8ED1FF));
+        lv_style_init(&btn_focused);
+        lv_style_set_bg_color(&btn_focused, lv_color_hex(0x8ED1FF));
+        lv_style_set_border_color(&btn_focused, lv_color_hex(0x8ED1FF));
+        lv_style_init(&btn_active);
+        lv_style_set_bg_color(&btn_active, lv_color_hex(0x5CB8FF));
+        lv_style_set_border_color(&btn_active, lv_color_hex(0x8ED1FF));
+        lv_style_set_text_color(&btn_active, lv_color_hex(0xFFFFFF));
+
+        lv_style_init(&icon_label);
+        lv_style_set_text_font(&icon_label, FontManager::iconFont());
+        lv_style_set_text_color(&icon_label, lv_color_hex(0xFFFFFF));
+
+        lv_style_init(&row);
+        lv_style_set_radius(&row, 4);
+        lv_style_set_bg_color(&row, lv_color_hex(0x101010));
+        lv_style_set_bg_opa(&row, LV_OPA_COVER);
+        lv_style_set_border_color(&row, lv_color_hex(0x2C2C2C));
+        lv_style_set_border_width(&row, 1);
+        lv_style_set_shadow_width(&row, 0);
+        lv_style_set_pad_hor(&row, 4);
+        lv_style_set_pad_ver(&row, LIST_ROW_PAD_V);
+        lv_style_init(&row_pressed);
+        lv_style_set_bg_color(&row_pressed, lv_color_hex(0x173248));
+        lv_style_init(&row_focused);
+        lv_style_set_bg_color(&row_focused, lv_color_hex(0x1E4B6D));
+        lv_style_init(&row_marked);
+        lv_style_set_bg_color(&row_marked, lv_color_hex(0x1E4B6D));
+        lv_style_set_border_color(&row_marked, lv_color_hex(0x8ED1FF));
+        lv_style_init(&row_label);
+        lv_style_set_pad_top(&row_label, 0);
+        lv_style_set_pad_bottom(&row_label, 0);
+        lv_style_set_text_color(&row_label, lv_color_hex(0xFFFFFF));
+        lv_style_set_text_font(&row_label, FontManager::textFont());
+
+        lv_style_init(&kb);
+        lv_style_set_bg_color(&kb, lv_color_hex(0x000000));
+        lv_style_set_text_color(&kb, lv_color_hex(0xFFFFFF));
+        lv_style_init(&kb_key);
+        lv_style_set_bg_color(&kb_key, lv_color_hex(0x1A1A1A));
+        lv_style_set_text_color(&kb_key, lv_color_hex(0xFFFFFF));
+        lv_style_set_border_color(&kb_key, lv_color_hex(0x303030));
+        lv_style_init(&kb_key_focused);
+        lv_style_set_bg_color(&kb_key_focused, lv_color_hex(0x222222));
+        lv_style_set_text_color(&kb_key_focused, lv_color_hex(0xFFFFFF));
+        lv_style_set_border_color(&kb_key_focused, lv_color_hex(0x3A3A3A));
+        lv_style_init(&kb_key_pressed);
+        lv_style_set_bg_color(&kb_key_pressed, lv_color_hex(0x2A2A2A));
+        lv_style_set_text_color(&kb_key_pressed, lv_color_hex(0xFFFFFF));
+        lv_style_set_border_color(&kb_key_pressed, lv_color_hex(0x4A4A4A));
+        lv_style_init(&kb_key_checked);
+        lv_style_set_bg_color(&kb_key_checked, lv_color_hex(0x202020));
+        lv_style_set_text_color(&kb_key_checked, lv_color_hex(0xFFFFFF));
+        lv_style_set_border_color(&kb_key_checked, lv_color_hex(0x3A3A3A));
+        lv_style_init(&kb_key_disabled);
+        lv_style_set_bg_color(&kb_key_disabled, lv_color_hex(0x111111));
+        lv_style_set_text_color(&kb_key_disabled, lv_color_hex(0xB8B8B8));
+        lv_style_set_border_color(&kb_key_disabled, lv_color_hex(0x242424));
+
+        lv_style_init(&cand);
+        lv_style_set_bg_color(&cand, lv_color_hex(0x000000));
+        lv_style_set_text_color(&cand, lv_color_hex(0xFFFFFF));
+        lv_style_init(&cand_items);
+        lv_style_set_bg_color(&cand_items, lv_color_hex(0x111111));
+        lv_style_set_text_color(&cand_items, lv_color_hex(0xFFFFFF));
+        lv_style_init(&cand_panel);
+        lv_style_set_bg_color(&cand_panel, lv_color_hex(0x000000));
+        lv_style_set_bg_opa(&cand_panel, LV_OPA_TRANSP);
+        lv_style_set_border_width(&cand_panel, 0);
+        lv_style_set_text_color(&cand_panel, lv_color_hex(0xFFFFFF));
+        lv_style_init(&cand_panel_items);
+        lv_style_set_bg_color(&cand_panel_items, lv_color_hex(0x111111));
+        lv_style_set_bg_opa(&cand_panel_items, LV_OPA_TRANSP);
+        lv_style_set_border_width(&cand_panel_items, 0);
+        lv_style_set_text_color(&cand_panel_items, lv_color_hex(0xFFFFFF));
+        lv_style_init(&cand_panel_focused);
+        lv_style_set_bg_color(&cand_panel_focused, lv_color_hex(0x1A1A1A));
+        lv_style_set_text_color(&cand_panel_focused, lv_color_hex(0xFFFFFF));
+        lv_style_init(&cand_panel_pressed);
+        lv_style_set_bg_color(&cand_panel_pressed, lv_color_hex(0x202020));
+        lv_style_set_text_color(&cand_panel_pressed, lv_color_hex(0xFFFFFF));
+        lv_style_init(&cand_panel_checked);
+        lv_style_set_bg_color(&cand_panel_checked, lv_color_hex(0x151515));
+        lv_style_set_text_color(&cand_panel_checked, lv_color_hex(0xFFFFFF));
+
+        // State-specific theme styles outrank a default-state one, so text colour is
+        // repeated for the states the built-in theme recolours.
+        lv_style_init(&text_white);
+        lv_style_set_text_color(&text_white, lv_color_hex(0xFFFFFF));
+    }
+
+public:
+    // Dark toolbar/menu/dialog button; LV_STATE_CHECKED marks the active choice.
+    static void actionButton(lv_obj_t* obj) {
+        init();
+        lv_obj_add_style(obj, &btn, 0);
+        lv_obj_add_style(obj, &btn_pressed, LV_STATE_PRESSED);
+        lv_obj_add_style(obj, &btn_focused, LV_STATE_FOCUSED);
+        lv_obj_add_style(obj, &btn_active, LV_STATE_CHECKED);
+    }
+
+    // White label in the icon font, for symbols and short button captions.
+    static void iconLabel(lv_obj_t* obj) {
+        init();
+        lv_obj_add_style(obj, &icon_label, 0);
+    }
+
+    // File list row; LV_STATE_CHECKED shows the selection / remove-mode mark.
+    static void listRow(lv_obj_t* obj) {
+        init();
+        lv_obj_add_style(obj, &row, 0);
+        lv_obj_add_style(obj, &row_pressed, LV_STATE_PRESSED);
+        lv_obj_add_style(obj, &row_focused, LV_STATE_FOCUSED);
+        lv_obj_add_style(obj, &row_marked, LV_STATE_CHECKED);
+    }
+
+    static void listRowLabel(lv_obj_t* obj) {
+        init();
+        lv_obj_add_style(obj, &row_label, 0);
+    }
+
+    static void keyboard(lv_obj_t* obj) {
+        init();
+        lv_obj_add_style(obj, &kb, 0);
+        lv_obj_add_style(obj, &kb_key, LV_PART_ITEMS);
+        lv_obj_add_style(obj, &kb_key_focused, LV_PART_ITEMS | LV_STATE_FOCUSED);
+        lv_obj_add_style(obj, &kb_key_pressed, LV_PART_ITEMS | LV_STATE_PRESSED);
+        lv_obj_add_style(obj, &kb_key_checked, LV_PART_ITEMS | LV_STATE_CHECKED);
+        lv_obj_add_style(obj, &kb_key_disabled, LV_PART_ITEMS | LV_STATE_DISABLED);
+    }
+
+    // Pinyin IME object and its candidate panel.
+    static void imeCandidates(lv_obj_t* ime, lv_obj_t* panel) {
+        init();
+        lv_obj_add_style(ime, &cand, 0);
+        lv_obj_add_style(ime, &cand_items, LV_PART_ITEMS);
+        lv_obj_add_style(ime, &text_white, LV_PART_ITEMS | LV_STATE_FOCUSED);
+        lv_obj_add_style(ime, &text_white, LV_PART_ITEMS | LV_STATE_PRESSED);
+        lv_obj_add_style(ime, &text_white, LV_PART_ITEMS | LV_STATE_CHECKED);
+        if (!panel) return;
+        lv_obj_add_style(panel, &cand_panel, 0);
+        lv_obj_add_style(panel, &cand_panel_items, LV_PART_ITEMS);
+        lv_obj_add_style(panel, &cand_panel_focused, LV_PART_ITEMS | LV_STATE_FOCUSED);
+        lv_obj_add_style(panel, &cand_panel_pressed, LV_PART_ITEMS | LV_STATE_PRESSED);
+        lv_obj_add_style(panel, &cand_panel_checked, LV_PART_ITEMS | LV_STATE_CHECKED);
+        lv_obj_add_style(panel, &text_white, LV_PART_ITEMS | LV_STATE_DISABLED);
+    }
+};
+
+bool Theme::ready = false;
+lv_style_t Theme::btn;
+lv_style_t Theme::btn_pressed;
+lv_style_t Theme::btn_focused;
+lv_style_t Theme::btn_active;
+lv_style_t Theme::icon_label;
+lv_style_t Theme::row;
+lv_style_t Theme::row_pressed;
+lv_style_t Theme::row_focused;
+lv_style_t Theme::row_marked;
+lv_style_t Theme::row_label;
+lv_style_t Theme::kb;
+lv_style_t Theme::kb_key;
+lv_style_t Theme::kb_key_focused;
+lv_style_t Theme::kb_key_pressed;
+lv_style_t Theme::kb_key_checked;
+lv_style_t Theme::kb_key_disabled;
+lv_style_t Theme::cand;
+lv_style_t Theme::cand_items;
+lv_style_t Theme::cand_panel;
+lv_style_t Theme::cand_panel_items;
+lv_style_t Theme::cand_panel_focused;
+lv_style_t Theme::cand_panel_pressed;
+lv_style_t Theme::cand_panel_checked;
+lv_style_t Theme::text_white;
+
+#endif
@@ -6,6 +6,7 @@
 #include <functional>
 #include "../config.h"
 #include "fonts.h"
+#include "theme.h"
 
 class ImageViewer {
 private:
@@ -61,14 +62,13 @@ public:
 
         back_btn = lv_btn_create(screen);
         lv_obj_set_size(back_btn, 28, 26);
-        styleActionButton(back_btn);
+        Theme::actionButton(back_btn);
         lv_obj_set_style_bg_opa(back_btn, LV_OPA_40, LV_STATE_DEFAULT);
         lv_obj_align(back_btn, LV_ALIGN_TOP_LEFT, 4, 4);
         lv_obj_add_event_cb(back_btn, back_btn_event_cb, LV_EVENT_CLICKED, this);
         lv_obj_t* back_label = lv_label_create(back_btn);
         lv_label_set_text(back_label, LV_SYMBOL_LEFT);
-        lv_obj_set_style_text_font(back_label, FontManager::iconFont(), 0);
-        lv_obj_set_style_text_color(back_label, lv_color_hex(0xFFFFFF), 0);
+        Theme::iconLabel(back_label);
         lv_obj_center(back_label);
         lv_obj_move_foreground(back_btn);
     }
@@ -108,16 +108,6 @@ public:
     }
 
 private:
-    void styleActionButton(lv_obj_t* btn) {
-        lv_obj_set_style_radius(btn, 4, 0);
-        lv_obj_set_style_bg_color(btn, lv_color_hex(0x1E1E1E), LV_STATE_DEFAULT);
-        lv_obj_set_style_bg_color(btn, lv_color_hex(0x5CB8FF), LV_STATE_PRESSED);
-        lv_obj_set_style_bg_color(btn, lv_color_hex(0x8ED1FF), LV_STATE_FOCUSED);
-        lv_obj_set_style_border_color(btn, lv_color_hex(0x404040), LV_STATE_DEFAULT);
-        lv_obj_set_style_border_color(btn, lv_color_hex(0x8ED1FF), LV_STATE_PRESSED);
-        lv_obj_set_style_border_color(btn, lv_color_hex(0x8ED1FF), LV_STATE_FOCUSED);
-        lv_obj_set_style_text_color(btn, lv_color_hex(0xFFFFFF), 0);
-    }
 
     static void back_btn_event_cb(lv_event_t* e) {
         ImageViewer* viewer = (ImageViewer*)lv_event_get_user_data(e);
@@ -0,0 +1,543 @@
+#ifndef BACKUP_H
+#define BACKUP_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <vector>
+#include <algorithm>
+#include "../config.h"
+#include "storage.h"
+#include "listing.h"
+#include "lfsdir.h"
+#include "sddelete.h"
+#include "trash.h"
+#include "bufpool.h"
+#include "fileindex.h"
+#include "notecodec.h"
+
+// NoteBackup - incremental mirror of L: into BACKUP_DIR on D:.
+//   current/<path>   latest copy of every L: file
+//   vNNNNN/<path>    copies replaced or deleted by run NNNNN (newest BACKUP_KEEP_VERSIONS kept)
+//   manifest.txt     "<crc32> <size> <mtime> <path>" per backed-up file
+// A file whose size and mtime match the manifest is skipped without being read; a
+// changed mtime with unchanged content (CRC32) only updates the manifest. Copies go
+// to current.part and are renamed into place, so current/ never holds a torn file.
+// Compressed notes are backed up as plain text; manifest CRCs cover that text.
+// A file that cannot be read keeps its previous copy, and a run whose walk missed a
+// directory or file removes nothing from current/.
+// Loop task only, stepped while the UI is idle; each step moves a bounded number of bytes.
+class NoteBackup {
+private:
+    static constexpr size_t BUF_SIZE = 4096;  // preferred scratch lease
+    static constexpr uint32_t BYTES_PER_STEP = 8192;
+    static constexpr uint16_t TRIM_OPS_PER_STEP = 16;
+
+    enum State {
+        ST_IDLE,
+        ST_WALK,
+        ST_HASH,
+        ST_COPY,
+        ST_PRUNE,
+        ST_TRIM
+    };
+
+    struct Entry {
+        String path;
+        uint32_t size;
+        uint32_t mtime;
+        uint32_t crc;
+        bool seen;
+        Entry() : size(0), mtime(0), crc(0), seen(false) {}
+    };
+
+    struct Pending {
+        String path;
+        uint32_t size;
+        uint32_t mtime;
+    };
+
+    State state;
+    bool ran_once;
+    bool walk_incomplete;  // some of L: went unlisted: skip the prune
+    uint32_t last_run_ms;
+    uint32_t run;
+    std::vector<Entry> manifest;   // sorted by path
+    std::vector<String> dirs;      // L: directories still to walk
+    std::vector<Pending> todo;     // new or changed files
+    size_t todo_idx;
+    size_t prune_idx;
+    File src;
+    NoteCodec::Reader<File> src_note;  // active while src is a compressed note
+    FsFile dst;
+    uint32_t crc;
+    uint32_t copied_files;
+    uint32_t hashed_files;
+    uint32_t deleted_files;
+    uint64_t copied_bytes;
+    uint32_t started_ms;
+    SdTreeDeleter trim;
+    ScratchLease lease;  // held only while a run is active
+    static NoteBackup* instance;
+
+    NoteBackup()
+        : state(ST_IDLE), ran_once(false), walk_incomplete(false), last_run_ms(0), run(0), todo_idx(0), prune_idx(0), crc(0),
+          copied_files(0), hashed_files(0), deleted_files(0), copied_bytes(0), started_ms(0) {}
+
+    static uint32_t crc32Update(uint32_t c, const uint8_t* p, size_t n) {
+        c = ~c;
+        while (n--) {
+            c ^= *p++;
+            for (uint8_t k = 0; k < 8; k++) c = (c >> 1) ^ (0xEDB88320UL & (0UL - (c & 1UL)));
+        }
+        return ~c;
+    }
+
+    static SdFs& sd() { return StorageHelper::getInstance()->getFs(); }
+
+    static String currentPath(const String& inner) { return String(BACKUP_DIR) + "/current" + inner; }
+    static String manifestPath() { return String(BACKUP_DIR) + "/manifest.txt"; }
+    static String manifestTmpPath() { return String(BACKUP_DIR) + "/manifest.tmp"; }
+    static String partPath() { return String(BACKUP_DIR) + "/current.part"; }
+
+    String versionDir(uint32_t n) const {
+        char name[16];
+        snprintf(name, sizeof(name), "/v%05lu", (unsigned long)n);
+        return String(BACKUP_DIR) + name;
+    }
+
+    static bool ensureParent(const String& path) {
+        int slash = path.lastIndexOf('/');
+        if (slash <= 0) return true;
+        String parent = path.substring(0, slash);
+        return sd().exists(parent.c_str()) || sd().mkdir(parent.c_str(), true);
+    }
+
+    int findEntry(const String& path) const {
+        size_t lo = 0;
+        size_t hi = manifest.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            int c = strcmp(manifest[mid].path.c_str(), path.c_str());
+            if (c == 0) return (int)mid;
+            if (c < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return -1;
+    }
+
+    void upsertEntry(const String& path, uint32_t size, uint32_t mtime, uint32_t file_crc) {
+        int i = findEntry(path);
+        if (i < 0) {
+            Entry e;
+            e.path = path;
+            std::vector<Entry>::iterator pos = std::lower_bound(
+                manifest.begin(), manifest.end(), e,
+                [](const Entry& a, const Entry& b) { return strcmp(a.path.c_str(), b.path.c_str()) < 0; });
+            i = (int)(pos - manifest.begin());
+            manifest.insert(pos, e);
+        }
+        manifest[i].size = size;
+        manifest[i].mtime = mtime;
+        manifest[i].crc = file_crc;
+        manifest[i].seen = true;
+    }
+
+    bool loadManifest() {
+        manifest.clear();
+        run = 0;
+        FsFile f = sd().open(manifestPath().c_str(), O_RDONLY);
+        if (!f) f = sd().open(manifestTmpPath().c_str(), O_RDONLY);  // crash between remove and rename
+        if (!f) return true;
+        char line[300];
+        uint32_t iter = 0;
+        while (true) {
+            int n = f.fgets(line, sizeof(line));
+            if (n <= 0) break;
+            if (line[n - 1] == '\n') line[--n] = '\0';
+            if (line[0] == '#') {
+                run = (uint32_t)strtoul(line + 1, nullptr, 10);
+                continue;
+            }
+            char* p = line;
+            Entry e;
+            e.crc = (uint32_t)strtoul(p, &p, 16);
+            e.size = (uint32_t)strtoul(p, &p, 10);
+            e.mtime = (uint32_t)strtoul(p, &p, 10);
+            if (*p != ' ' || p[1] != '/') continue;
+            e.path = String(p + 1);
+            manifest.push_back(e);
+            if ((++iter & 0x0F) == 0) delay(0);
+        }
+        f.close();
+        std::sort(manifest.begin(), manifest.end(),
+                  [](const Entry& a, const Entry& b) { return strcmp(a.path.c_str(), b.path.c_str()) < 0; });
+        return true;
+    }
+
+    bool saveManifest() {
+        String tmp = manifestTmpPath();
+        FsFile f = sd().open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
+        if (!f) return false;
+        f.printf("#%lu\n", (unsigned long)run);
+        for (size_t i = 0; i < manifest.size(); i++) {
+            const Entry& e = manifest[i];
+            f.printf("%08lx %lu %lu %s\n", (unsigned long)e.crc, (unsigned long)e.size, (unsigned long)e.mtime,
+                     e.path.c_str());
+        }
+        bool ok = f.close();
+        String final_path = manifestPath();
+        sd().remove(final_path.c_str());
+        return ok && sd().rename(tmp.c_str(), final_path.c_str());
+    }
+
+    // Moves the current copy of inner (if any) into this run's version folder.
+    bool retireCurrent(const String& inner) {
+        String cur = currentPath(inner);
+        if (!sd().exists(cur.c_str())) return true;
+        String ver = versionDir(run) + inner;
+        if (!ensureParent(ver)) return false;
+        sd().remove(ver.c_str());
+        return sd().rename(cur.c_str(), ver.c_str());
+    }
+
+    // Opens an L: file for reading as plain text.
+    bool openSrc(const String& path) {
+        src = LittleFS.open(path.c_str(), "r");
+        if (!src) return false;
+        bool compressed = false;
+        uint32_t raw_len = 0;
+        if (NoteCodec::probe(src, (uint64_t)src.size(), compressed, raw_len) &&
+            (!compressed || src_note.begin(src, raw_len))) {
+            return true;
+        }
+        src.close();
+        return false;
+    }
+
+    int readSrc(uint8_t* p, size_t n) {
+        return src_note.isActive() ? src_note.read(p, n) : (int)src.read(p, n);
+    }
+
+    void closeSrc() {
+        src_note.end();
+        if (src) src.close();
+    }
+
+    void closeFiles() {
+        closeSrc();
+        if (dst) dst.close();
+    }
+
+    void abort(const char* why) {
+        closeFiles();
+        lease.release();
+        trim.cancel();
+        manifest.clear();
+        dirs.clear();
+        todo.clear();
+        state = ST_IDLE;
+        last_run_ms = millis();
+        ran_once = true;
+        DirListingCache::getInstance()->invalidatePath(String("D:") + BACKUP_DIR);
+        Serial.println(String("[BACKUP] stopped: ") + why);
+    }
+
+    void start() {
+        lease = ScratchPool::getInstance()->lease(BUF_SIZE);
+        if (!lease) {
+            abort("out of memory");
+            return;
+        }
+        if (!(sd().exists(BACKUP_DIR) || sd().mkdir(BACKUP_DIR))) {
+            abort("cannot create backup folder");
+            return;
+        }
+        loadManifest();
+        run++;
+        dirs.clear();
+        dirs.push_back("/");
+        todo.clear();
+        todo_idx = 0;
+        prune_idx = 0;
+        walk_incomplete = false;
+        copied_files = 0;
+        hashed_files = 0;
+        deleted_files = 0;
+        copied_bytes = 0;
+        started_ms = millis();
+        state = ST_WALK;
+    }
+
+    // Lists one L: directory per call.
+    void stepWalk() {
+        if (dirs.empty()) {
+            state = ST_HASH;
+            return;
+        }
+        String dir_path = dirs.back();
+        dirs.pop_back();
+        LfsDirIter dir(dir_path);
+        if (!dir.isOpen()) {
+            Serial.println("[BACKUP] cannot list " + dir_path);
+            walk_incomplete = true;
+            return;
+        }
+        String name;
+        bool is_dir = false;
+        uint32_t iter = 0;
+        while (dir.next(name, is_dir)) {
+            String child = (dir_path == "/") ? ("/" + name) : (dir_path + "/" + name);
+            if (is_dir) {
+                if (!TrashBin::isTrashPath(child) && !FileIndex::isIndexPath(child)) dirs.push_back(child);
+                continue;
+            }
+            uint64_t size = 0;
+            uint32_t mtime = 0;
+            if (!dir.stat(size, &mtime)) {
+                walk_incomplete = true;
+                continue;
+            }
+            int i = findEntry(child);
+            // Without a usable mtime every file goes through the hash check.
+            if (i >= 0 && mtime != 0 && manifest[i].size == (uint32_t)size && manifest[i].mtime == mtime) {
+                manifest[i].seen = true;
+            } else {
+                Pending p;
+                p.path = child;
+                p.size = (uint32_t)size;
+                p.mtime = mtime;
+                todo.push_back(p);
+            }
+            if ((++iter & 0x0F) == 0) delay(0);
+        }
+    }
+
+    // Changed mtime: if the size still matches, hash first and skip the copy when
+    // the content is unchanged.
+    void stepHash() {
+        if (todo_idx >= todo.size()) {
+            state = ST_PRUNE;
+            return;
+        }
+        const Pending& p = todo[todo_idx];
+        int i = findEntry(p.path);
+        if (i < 0 || manifest[i].size != p.size) {
+            state = ST_COPY;
+            return;
+        }
+        if (!src) {
+            if (!openSrc(p.path)) {
+                skipUnopened(p.path);
+                return;
+            }
+            crc = 0;
+        }
+        uint32_t budget = BYTES_PER_STEP;
+        bool more = true;
+        while (budget > 0) {
+            int n = readSrc(lease.data(), lease.size());
+            if (n < 0) {
+                skipUnreadable(p.path);
+                return;
+            }
+            if (n == 0) {
+                more = false;
+                break;
+            }
+            crc = crc32Update(crc, lease.data(), (size_t)n);
+            budget = (budget > (uint32_t)n) ? budget - (uint32_t)n : 0;
+        }
+        if (more) return;
+        closeSrc();
+        if (crc == manifest[i].crc) {
+            upsertEntry(p.path, p.size, p.mtime, crc);
+            hashed_files++;
+            todo_idx++;
+            return;
+        }
+        state = ST_COPY;
+    }
+
+    // Read error mid-copy: drop the .part and keep the previous copy of this file.
+    void skipUnreadable(const String& path) {
+        closeFiles();
+        sd().remove(partPath().c_str());
+        int i = findEntry(path);
+        if (i >= 0) manifest[i].seen = true;
+        Serial.println("[BACKUP] cannot read " + path + ", skipped");
+        todo_idx++;
+        state = ST_HASH;
+    }
+
+    // openSrc() failed: only a file gone from L: since the walk loses its copy.
+    void skipUnopened(const String& path) {
+        if (LittleFS.exists(path.c_str())) {
+            skipUnreadable(path);
+            return;
+        }
+        todo_idx++;
+        state = ST_HASH;
+    }
+
+    void stepCopy() {
+        const Pending& p = todo[todo_idx];
+        if (!src) {
+            if (!openSrc(p.path)) {
+                skipUnopened(p.path);
+                return;
+            }
+            String part = partPath();
+            dst = sd().open(part.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
+            if (!dst) {
+                closeFiles();
+                abort("cannot write to SD");
+                return;
+            }
+            crc = 0;
+        }
+        uint32_t budget = BYTES_PER_STEP;
+        bool more = true;
+        while (budget > 0) {
+            int n = readSrc(lease.data(), lease.size());
+            if (n < 0) {
+                skipUnreadable(p.path);
+                return;
+            }
+            if (n == 0) {
+                more = false;
+                break;
+            }
+            if ((int)dst.write(lease.data(), (size_t)n) != n) {
+                abort("write failed");
+                return;
+            }
+            crc = crc32Update(crc, lease.data(), (size_t)n);
+            copied_bytes += (uint64_t)n;
+            budget = (budget > (uint32_t)n) ? budget - (uint32_t)n : 0;
+        }
+        if (more) return;
+        uint32_t written = (uint32_t)dst.fileSize();
+        closeSrc();
+        if (!dst.close()) {
+            abort("write failed");
+            return;
+        }
+        SdSpaceTracker::getInstance()->noteAllocated(written);
+        // Record the stat from the walk: if the note changed mid-copy the next run
+        // sees a newer mtime and copies it again.
+        String cur = currentPath(p.path);
+        if (!retireCurrent(p.path) || !ensureParent(cur) || !sd().rename(partPath().c_str(), cur.c_str())) {
+            abort("cannot place copy");
+            return;
+        }
+        upsertEntry(p.path, p.size, p.mtime, crc);
+        copied_files++;
+        todo_idx++;
+        state = ST_HASH;
+    }
+
+    // Files gone from L: move out of current/ into this run's version folder.
+    void stepPrune() {
+        uint8_t n = 0;
+        while (prune_idx < manifest.size() && n < 8) {
+            if (manifest[prune_idx].seen || walk_incomplete) {
+                prune_idx++;
+                continue;
+            }
+            retireCurrent(manifest[prune_idx].path);
+            manifest.erase(manifest.begin() + prune_idx);
+            deleted_files++;
+            n++;
+        }
+        if (prune_idx < manifest.size()) return;
+        bool changed = copied_files || hashed_files || deleted_files;
+        if (changed && !saveManifest()) {
+            abort("cannot save manifest");
+            return;
+        }
+        if (!changed) run--;  // nothing retired; reuse the number next time
+        Serial.printf("[BACKUP] run %lu: %lu copied (%llu bytes), %lu rehashed, %lu removed, %lu ms\n",
+                      (unsigned long)run, (unsigned long)copied_files, (unsigned long long)copied_bytes,
+                      (unsigned long)hashed_files, (unsigned long)deleted_files,
+                      (unsigned long)(millis() - started_ms));
+        manifest.clear();
+        todo.clear();
+        lease.release();
+        state = ST_TRIM;
+    }
+
+    // Deletes version folders older than the newest BACKUP_KEEP_VERSIONS.
+    void stepTrim() {
+        if (trim.isRunning()) {
+            if (trim.step(TRIM_OPS_PER_STEP) == SdTreeDeleter::DEL_RUNNING) return;
+        }
+        if (run > BACKUP_KEEP_VERSIONS) {
+            uint32_t floor_run = run - BACKUP_KEEP_VERSIONS;
+            FsFile root = sd().open(BACKUP_DIR, O_RDONLY);
+            FsFile entry;
+            char name[16];
+            String victim;
+            while (root && entry.openNext(&root, O_RDONLY)) {
+                name[0] = '\0';
+                entry.getName(name, sizeof(name));
+                bool is_dir = entry.isDir();
+                entry.close();
+                if (!is_dir || name[0] != 'v') continue;
+                if ((uint32_t)strtoul(name + 1, nullptr, 10) <= floor_run) {
+                    victim = String(BACKUP_DIR) + "/" + name;
+                    break;
+                }
+            }
+            if (root) root.close();
+            if (victim.length() > 0 && trim.begin(sd(), victim)) return;
+        }
+        state = ST_IDLE;
+        last_run_ms = millis();
+        ran_once = true;
+        DirListingCache::getInstance()->invalidatePath(String("D:") + BACKUP_DIR);
+    }
+
+public:
+    static NoteBackup* getInstance() {
+        if (!instance) instance = new NoteBackup();
+        return instance;
+    }
+
+    bool isRunning() const { return state != ST_IDLE; }
+
+    // Run the next backup as soon as the device is idle.
+    void requestRun() { ran_once = false; }
+
+    // SD went away: drop open handles; the next run starts over from the manifest.
+    void onSdRemoved() {
+        if (state != ST_IDLE) abort("card removed");
+    }
+
+    // Loop task, only while no file operation is running. Advances only when idle.
+    void step(bool idle, bool sd_ready) {
+        if (!BACKUP_ENABLED || !idle) return;
+        if (!sd_ready) {
+            if (state != ST_IDLE) abort("card removed");
+            return;
+        }
+        if (state == ST_IDLE) {
+            if (ran_once && (millis() - last_run_ms) < BACKUP_INTERVAL_MS) return;
+            start();
+            return;
+        }
+        StorageHelper::getInstance()->beginBatch();
+        switch (state) {
+            case ST_WALK: stepWalk(); break;
+            case ST_HASH: stepHash(); break;
+            case ST_COPY: stepCopy(); break;
+            case ST_PRUNE: stepPrune(); break;
+            case ST_TRIM: stepTrim(); break;
+            default: break;
+        }
+        StorageHelper::getInstance()->endBatch();
+    }
+};
+
+NoteBackup* NoteBackup::instance = nullptr;
+
+#endif
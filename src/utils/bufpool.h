@@ -0,0 +1,152 @@
+#ifndef BUFPOOL_H
+#define BUFPOOL_H
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "../config.h"
+
+class ScratchPool;
+
+// ScratchLease - one leased pool buffer; returned to the pool on release() or
+// destruction. Move-only.
+class ScratchLease {
+private:
+    uint8_t* ptr;
+    size_t len;
+    uint8_t cls;
+
+    friend class ScratchPool;
+    ScratchLease(uint8_t* p, size_t n, uint8_t c) : ptr(p), len(n), cls(c) {}
+
+public:
+    ScratchLease() : ptr(nullptr), len(0), cls(0) {}
+    ScratchLease(const ScratchLease&) = delete;
+    ScratchLease& operator=(const ScratchLease&) = delete;
+    ScratchLease(ScratchLease&& o) : ptr(o.ptr), len(o.len), cls(o.cls) {
+        o.ptr = nullptr;
+        o.len = 0;
+    }
+    ScratchLease& operator=(ScratchLease&& o) {
+        if (this != &o) {
+            release();
+            ptr = o.ptr;
+            len = o.len;
+            cls = o.cls;
+            o.ptr = nullptr;
+            o.len = 0;
+        }
+        return *this;
+    }
+    ~ScratchLease() { release(); }
+
+    uint8_t* data() const { return ptr; }
+    size_t size() const { return len; }
+    explicit operator bool() const { return ptr != nullptr; }
+    inline void release();
+};
+
+// ScratchPool - shared DMA-capable I/O buffers in power-of-two size classes.
+// lease(want, min) hands out the largest class <= want (at least min) that the heap
+// can spare while keeping SCRATCH_HEAP_RESERVE in its largest free block, so big
+// copies get big buffers when memory allows and still work when it is tight.
+// Released buffers up to SCRATCH_KEEP_MAX stay cached (one per class); larger ones
+// go straight back to the heap, so nothing large is held while idle.
+// Safe to use from the UI task and fm_fs_worker.
+class ScratchPool {
+private:
+    static constexpr uint8_t CLASS_COUNT = 6;
+    static constexpr size_t MIN_CLASS = 1024;  // 1, 2, 4, 8, 16, 32 KB
+
+    SemaphoreHandle_t lock;
+    uint8_t* cached[CLASS_COUNT];
+    size_t leased_bytes;
+    size_t peak_bytes;
+    static ScratchPool* instance;
+
+    ScratchPool() : lock(xSemaphoreCreateMutex()), leased_bytes(0), peak_bytes(0) {
+        for (uint8_t i = 0; i < CLASS_COUNT; i++) cached[i] = nullptr;
+    }
+
+    void take() { if (lock) xSemaphoreTake(lock, portMAX_DELAY); }
+    void give() { if (lock) xSemaphoreGive(lock); }
+
+    static size_t classSize(uint8_t c) { return MIN_CLASS << c; }
+
+    static uint8_t classFor(size_t bytes) {
+        uint8_t c = 0;
+        while (c + 1 < CLASS_COUNT && classSize(c + 1) <= bytes) c++;
+        return c;
+    }
+
+    static uint8_t* allocate(size_t bytes) {
+        if (heap_caps_get_largest_free_block(MALLOC_CAP_DMA | MALLOC_CAP_8BIT) < bytes + SCRATCH_HEAP_RESERVE) {
+            return nullptr;
+        }
+        return (uint8_t*)heap_caps_malloc(bytes, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+    }
+
+public:
+    static ScratchPool* getInstance() {
+        if (!instance) instance = new ScratchPool();
+        return instance;
+    }
+
+    // Empty lease if not even `min` bytes can be spared.
+    ScratchLease lease(size_t want, size_t min = MIN_CLASS) {
+        uint8_t hi = classFor(want);
+        uint8_t lo = classFor(min);
+        if (classSize(lo) < min && lo + 1 < CLASS_COUNT) lo++;
+        if (hi < lo) hi = lo;
+        take();
+        for (int c = hi; c >= (int)lo; c--) {
+            uint8_t* p = cached[c];
+            if (p) cached[c] = nullptr;
+            else p = allocate(classSize((uint8_t)c));
+            if (!p) continue;
+            leased_bytes += classSize((uint8_t)c);
+            if (leased_bytes > peak_bytes) peak_bytes = leased_bytes;
+            give();
+            return ScratchLease(p, classSize((uint8_t)c), (uint8_t)c);
+        }
+        give();
+        return ScratchLease();
+    }
+
+    void giveBack(uint8_t* p, uint8_t c) {
+        if (!p) return;
+        take();
+        leased_bytes -= classSize(c);
+        if (classSize(c) <= SCRATCH_KEEP_MAX && !cached[c]) {
+            cached[c] = p;
+            p = nullptr;
+        }
+        give();
+        if (p) heap_caps_free(p);
+    }
+
+    // Frees every cached buffer (e.g. before a large allocation elsewhere).
+    void trim() {
+        take();
+        for (uint8_t i = 0; i < CLASS_COUNT; i++) {
+            if (cached[i]) heap_caps_free(cached[i]);
+            cached[i] = nullptr;
+        }
+        give();
+    }
+
+    size_t leasedBytes() const { return leased_bytes; }
+    size_t peakBytes() const { return peak_bytes; }
+};
+
+ScratchPool* ScratchPool::instance = nullptr;
+
+inline void ScratchLease::release() {
+    if (!ptr) return;
+    ScratchPool::getInstance()->giveBack(ptr, cls);
+    ptr = nullptr;
+    len = 0;
+}
+
+#endif
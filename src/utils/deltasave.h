@@ -0,0 +1,136 @@
+#ifndef DELTASAVE_H
+#define DELTASAVE_H
+
+#include <Arduino.h>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "listing.h"
+
+// DeltaSaver - saves an edited note by rewriting only the blocks from the first
+// change to the end. It remembers the size/mtime and per-block hashes of the text it
+// last loaded or wrote; a save is a delta only if the file on disk still has that
+// size/mtime, and the block hashes double-check the editor's dirty offset.
+// L: only: the write goes through one VFS handle (seek, write, ftruncate, close),
+// which commits copy-on-write on close, so a power cut leaves the old or the new
+// note, never a mix. D: always takes the full write: FAT has no such commit, and its
+// modify stamp is not updated by our own writes (no FsDateTime callback), so a
+// same-size change made elsewhere could not be told apart.
+class DeltaSaver {
+public:
+    static constexpr size_t BLOCK = 4096;
+
+private:
+    static constexpr const char* LFS_VFS_BASE = "/littlefs";
+
+    String vpath;
+    uint64_t disk_size;
+    uint32_t disk_stamp;
+    std::vector<uint32_t> hashes;
+    bool valid;
+
+    static char driveOf(const String& v) { return (v.length() >= 2 && v.charAt(1) == ':') ? v.charAt(0) : 'L'; }
+    static String innerOf(const String& v) { return (v.length() >= 2 && v.charAt(1) == ':') ? v.substring(2) : v; }
+
+    static uint32_t blockHash(const char* p, size_t n) {
+        uint32_t h = 2166136261UL;  // FNV-1a
+        while (n--) {
+            h ^= (uint8_t)*p++;
+            h *= 16777619UL;
+        }
+        return h;
+    }
+
+    // Size and mtime of an L: file.
+    static bool statFile(const String& v, uint64_t& size, uint32_t& stamp) {
+        if (driveOf(v) != 'L') return false;
+        struct stat st;
+        if (::stat((String(LFS_VFS_BASE) + innerOf(v)).c_str(), &st) != 0) return false;
+        size = (uint64_t)st.st_size;
+        stamp = (uint32_t)st.st_mtime;
+        return true;
+    }
+
+    void rehashFrom(const char* data, size_t len, size_t first_block) {
+        size_t blocks = (len + BLOCK - 1) / BLOCK;
+        hashes.resize(blocks);
+        for (size_t b = first_block; b < blocks; b++) {
+            size_t off = b * BLOCK;
+            size_t n = (len - off < BLOCK) ? len - off : BLOCK;
+            hashes[b] = blockHash(data + off, n);
+        }
+    }
+
+    bool writeLfsTail(const String& inner, const char* data, size_t len, size_t from) {
+        String path = String(LFS_VFS_BASE) + inner;
+        int fd = ::open(path.c_str(), O_RDWR);
+        if (fd < 0) return false;
+        bool ok = ::lseek(fd, (off_t)from, SEEK_SET) == (off_t)from;
+        size_t off = from;
+        while (ok && off < len) {
+            ssize_t w = ::write(fd, data + off, len - off);
+            if (w <= 0) ok = false;
+            else off += (size_t)w;
+        }
+        if (ok && (uint64_t)len < disk_size) ok = ::ftruncate(fd, (off_t)len) == 0;
+        if (::close(fd) != 0) ok = false;
+        return ok;
+    }
+
+public:
+    DeltaSaver() : disk_size(0), disk_stamp(0), valid(false) {}
+
+    // Remembers what is on disk for v right after loading or fully writing data.
+    // Only L: paths are tracked.
+    void track(const String& v, const char* data, size_t len) {
+        valid = false;
+        vpath = v;
+        hashes.clear();
+        if (!statFile(v, disk_size, disk_stamp) || disk_size != (uint64_t)len) return;
+        rehashFrom(data, len, 0);
+        valid = true;
+    }
+
+    void invalidate() { valid = false; }
+
+    uint64_t trackedSize() const { return valid ? disk_size : 0; }
+
+    // Block-aligned offset to rewrite from, or false if a full write is needed.
+    // dirty_from is the editor's earliest edited byte (len if unknown but clean).
+    bool plan(const String& v, const char* data, size_t len, size_t dirty_from, size_t& from) {
+        if (!valid || v != vpath) return false;
+        uint64_t size = 0;
+        uint32_t stamp = 0;
+        if (!statFile(v, size, stamp) || size != disk_size || stamp != disk_stamp) return false;
+        size_t limit = dirty_from;
+        if (limit > len) limit = len;
+        if ((uint64_t)limit > disk_size) limit = (size_t)disk_size;
+        // Whole blocks before the dirty offset must hash the same as on disk.
+        size_t b = 0;
+        for (; (b + 1) * BLOCK <= limit && b < hashes.size(); b++) {
+            if (blockHash(data + b * BLOCK, BLOCK) != hashes[b]) break;
+        }
+        from = b * BLOCK;
+        return true;
+    }
+
+    // Rewrites [from, len) and trims the file to len; retracks on success.
+    bool writeTail(const String& v, const char* data, size_t len, size_t from) {
+        bool ok = writeLfsTail(innerOf(v), data, len, from);
+        DirListingCache::getInstance()->invalidatePath(v);
+        if (!ok) {
+            valid = false;
+            return false;
+        }
+        if (!statFile(v, disk_size, disk_stamp)) {
+            valid = false;
+            return true;
+        }
+        rehashFrom(data, len, from / BLOCK);
+        valid = disk_size == (uint64_t)len;
+        return true;
+    }
+};
+
+#endif
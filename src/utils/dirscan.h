@@ -0,0 +1,257 @@
+#ifndef DIRSCAN_H
+#define DIRSCAN_H
+
+#include <Arduino.h>
+#include <vector>
+#ifndef DISABLE_FS_H_WARNING
+#define DISABLE_FS_H_WARNING
+#endif
+#include <SdFat.h>
+#include "listing.h"
+
+// SdDirScanner - lists an SdFat directory by reading its entry stream in bulk and
+// decoding FAT (8.3 + LFN) or exFAT (file/stream/name sets) records directly, so no
+// child file is ever opened. Returns false on anything unexpected; callers then fall
+// back to openNext().
+class SdDirScanner {
+private:
+    static constexpr size_t READ_CHUNK = 1024;
+    static constexpr size_t ENTRY_SIZE = 32;
+    static constexpr uint16_t MAX_NAME = 255;
+
+    uint8_t fat_type;
+    uint16_t name16[MAX_NAME + 1];
+    uint16_t name_len;
+    // FAT LFN state
+    uint8_t lfn_expect;
+    uint8_t lfn_checksum;
+    bool lfn_valid;
+    // exFAT set state
+    uint8_t set_remaining;
+    bool set_is_dir;
+    uint8_t set_name_total;
+    uint64_t set_size;
+    uint32_t set_mtime;
+
+    static uint16_t le16(const uint8_t* p) { return (uint16_t)p[0] | ((uint16_t)p[1] << 8); }
+    static uint32_t le32(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+    static uint64_t le64(const uint8_t* p) { return (uint64_t)le32(p) | ((uint64_t)le32(p + 4) << 32); }
+
+    static uint8_t lfnChecksum(const uint8_t* sfn) {
+        uint8_t sum = 0;
+        for (uint8_t i = 0; i < 11; i++) sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + sfn[i]);
+        return sum;
+    }
+
+    static void appendUtf8(String& out, uint32_t cp) {
+        char b[5];
+        if (cp < 0x80) {
+            b[0] = (char)cp; b[1] = 0;
+        } else if (cp < 0x800) {
+            b[0] = (char)(0xC0 | (cp >> 6)); b[1] = (char)(0x80 | (cp & 0x3F)); b[2] = 0;
+        } else if (cp < 0x10000) {
+            b[0] = (char)(0xE0 | (cp >> 12)); b[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            b[2] = (char)(0x80 | (cp & 0x3F)); b[3] = 0;
+        } else {
+            b[0] = (char)(0xF0 | (cp >> 18)); b[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+            b[2] = (char)(0x80 | ((cp >> 6) & 0x3F)); b[3] = (char)(0x80 | (cp & 0x3F)); b[4] = 0;
+        }
+        out += b;
+    }
+
+    String name16ToUtf8(uint16_t len) const {
+        String out;
+        out.reserve(len + 4);
+        for (uint16_t i = 0; i < len; i++) {
+            uint32_t c = name16[i];
+            if (c == 0) break;
+            if (c >= 0xD800 && c <= 0xDBFF && i + 1 < len && name16[i + 1] >= 0xDC00 && name16[i + 1] <= 0xDFFF) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (name16[i + 1] - 0xDC00);
+                i++;
+            }
+            appendUtf8(out, c);
+        }
+        return out;
+    }
+
+    static String shortName(const uint8_t* e) {
+        // NT case bits: 0x08 lower-case base, 0x10 lower-case extension.
+        bool lower_base = (e[12] & 0x08) != 0;
+        bool lower_ext = (e[12] & 0x10) != 0;
+        char buf[13];
+        uint8_t n = 0;
+        for (uint8_t i = 0; i < 8 && e[i] != ' '; i++) {
+            char c = (char)((i == 0 && e[0] == 0x05) ? 0xE5 : e[i]);
+            buf[n++] = lower_base ? (char)tolower((uint8_t)c) : c;
+        }
+        if (e[8] != ' ') {
+            buf[n++] = '.';
+            for (uint8_t i = 8; i < 11 && e[i] != ' '; i++) buf[n++] = lower_ext ? (char)tolower(e[i]) : (char)e[i];
+        }
+        buf[n] = 0;
+        return String(buf);
+    }
+
+    // Returns 1 on end of directory, -1 on a malformed record, 0 to continue.
+    int fatEntry(const uint8_t* e, std::vector<FileListItem>& out) {
+        if (e[0] == 0x00) return 1;
+        if (e[0] == 0xE5) {
+            lfn_valid = false;
+            return 0;
+        }
+        uint8_t attr = e[11];
+        if ((attr & 0x3F) == 0x0F) {
+            uint8_t ord = e[0] & 0x1F;
+            if (ord == 0 || ord > 20) {
+                lfn_valid = false;
+                return 0;
+            }
+            if (e[0] & 0x40) {
+                lfn_valid = true;
+                lfn_expect = ord;
+                lfn_checksum = e[13];
+                name_len = (uint16_t)ord * 13;
+                if (name_len > MAX_NAME) name_len = MAX_NAME;
+            } else if (!lfn_valid || ord != lfn_expect || e[13] != lfn_checksum) {
+                lfn_valid = false;
+                return 0;
+            }
+            static const uint8_t offs[13] = {1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30};
+            uint16_t base = (uint16_t)(ord - 1) * 13;
+            for (uint8_t i = 0; i < 13; i++) {
+                uint16_t idx = base + i;
+                if (idx < MAX_NAME) name16[idx] = le16(e + offs[i]);
+            }
+            lfn_expect = ord - 1;
+            return 0;
+        }
+
+        bool have_lfn = lfn_valid && lfn_expect == 0 && lfnChecksum(e) == lfn_checksum;
+        lfn_valid = false;
+        if (attr & 0x08) return 0;  // volume label
+        if (e[0] == '.' && (e[1] == ' ' || (e[1] == '.' && e[2] == ' '))) return 0;
+
+        FileListItem it;
+        if (have_lfn) {
+            uint16_t len = 0;
+            while (len < name_len && name16[len] != 0x0000 && name16[len] != 0xFFFF) len++;
+            it.name = name16ToUtf8(len);
+        } else {
+            it.name = shortName(e);
+        }
+        if (it.name.length() == 0) return -1;
+        it.is_dir = (attr & 0x10) != 0;
+        it.size = it.is_dir ? 0 : le32(e + 28);
+        it.mtime = dosToEpoch(le16(e + 24), le16(e + 22));
+        NameCollation::setKey(it);
+        out.push_back(it);
+        return 0;
+    }
+
+    int exFatEntry(const uint8_t* e, std::vector<FileListItem>& out) {
+        uint8_t type = e[0];
+        if (type == 0x00) return 1;
+        if ((type & 0x80) == 0) {
+            set_remaining = 0;
+            return 0;
+        }
+        if (type == 0x85) {
+            set_remaining = e[1];
+            if (set_remaining < 2) return -1;
+            set_is_dir = (le16(e + 4) & 0x10) != 0;
+            uint32_t ts = le32(e + 12);
+            set_mtime = dosToEpoch((uint16_t)(ts >> 16), (uint16_t)(ts & 0xFFFF));
+            set_size = 0;
+            set_name_total = 0;
+            name_len = 0;
+            return 0;
+        }
+        if (set_remaining == 0) return 0;  // volume label, bitmap, up-case table, ...
+        if (type == 0xC0) {
+            set_name_total = e[3];
+            set_size = le64(e + 8);  // ValidDataLength, what fileSize() reports
+        } else if (type == 0xC1) {
+            for (uint8_t i = 0; i < 15 && name_len < set_name_total && name_len < MAX_NAME; i++) {
+                name16[name_len++] = le16(e + 2 + i * 2);
+            }
+        }
+        if (--set_remaining == 0) {
+            if (set_name_total == 0 || name_len < set_name_total) return -1;
+            FileListItem it;
+            it.name = name16ToUtf8(name_len);
+            it.is_dir = set_is_dir;
+            it.size = set_is_dir ? 0 : set_size;
+            it.mtime = set_mtime;
+            NameCollation::setKey(it);
+            out.push_back(it);
+        }
+        return 0;
+    }
+
+public:
+    explicit SdDirScanner(uint8_t type)
+        : fat_type(type), name_len(0), lfn_expect(0), lfn_checksum(0), lfn_valid(false), set_remaining(0),
+          set_is_dir(false), set_name_total(0), set_size(0), set_mtime(0) {}
+
+    // FAT date/time (local, 2 s resolution) to seconds since 1970; 0 if unset.
+    static uint32_t dosToEpoch(uint16_t date, uint16_t time) {
+        if (date == 0) return 0;
+        int32_t y = 1980 + (date >> 9);
+        uint32_t m = (date >> 5) & 0x0F;
+        uint32_t d = date & 0x1F;
+        if (m < 1 || m > 12 || d < 1) return 0;
+        // days_from_civil
+        y -= (m <= 2) ? 1 : 0;
+        int32_t era = y / 400;
+        uint32_t yoe = (uint32_t)(y - era * 400);
+        uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+        uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        int32_t days = era * 146097 + (int32_t)doe - 719468;
+        return (uint32_t)days * 86400UL + (time >> 11) * 3600UL + ((time >> 5) & 0x3F) * 60UL + (time & 0x1F) * 2UL;
+    }
+
+    // Incremental form of scan(): begin() once, then step() until it returns 1 (end of
+    // directory) or -1 (unexpected layout or read error; fall back as for scan()).
+    bool begin(FsFile& dir) {
+        if (fat_type != FAT_TYPE_EXFAT && fat_type != FAT_TYPE_FAT32 &&
+            fat_type != FAT_TYPE_FAT16 && fat_type != FAT_TYPE_FAT12) {
+            return false;
+        }
+        name_len = 0;
+        lfn_expect = 0;
+        lfn_valid = false;
+        set_remaining = 0;
+        return dir.rewind();
+    }
+
+    // Decodes up to max_chunks x READ_CHUNK bytes of entries into out.
+    int step(FsFile& dir, std::vector<FileListItem>& out, uint16_t max_chunks) {
+        uint8_t buf[READ_CHUNK];
+        for (uint16_t c = 0; c < max_chunks; c++) {
+            int n = dir.read(buf, sizeof(buf));
+            if (n < 0) return -1;
+            if (n == 0) return 1;
+            if ((n % ENTRY_SIZE) != 0) return -1;
+            for (int off = 0; off < n; off += ENTRY_SIZE) {
+                int rc = (fat_type == FAT_TYPE_EXFAT) ? exFatEntry(buf + off, out) : fatEntry(buf + off, out);
+                if (rc < 0) return -1;
+                if (rc > 0) return 1;
+            }
+        }
+        return 0;
+    }
+
+    bool scan(FsFile& dir, std::vector<FileListItem>& out) {
+        if (!begin(dir)) return false;
+        uint32_t iter = 0;
+        while (true) {
+            int rc = step(dir, out, 1);
+            if (rc != 0) return rc > 0;
+            if ((++iter & 0x0F) == 0) delay(0);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,1042 @@
+#ifndef FILEINDEX_H
+#define FILEINDEX_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <vector>
+#include <memory>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "../config.h"
+#include "storage.h"
+#include "listing.h"
+#include "dirscan.h"
+#include "lfsdir.h"
+#include "trash.h"
+#include "bufpool.h"
+
+// FileIndex - per-drive filename index for search, in INDEX_DIR on the drive itself.
+// names.bin: 2 KB blocks, [u16 count][u16 used] then records [u8 flags][u16 len][path].
+// sig.bin:   "FIX1", u32 block count, u32 volume serial + u32 free clusters (D: stamp,
+//            0 = unknown), then one 256-byte signature per block:
+//            a bit per hashed trigram of every (ASCII-folded) basename in the block.
+// rules.bin: [u32 seq][u16 len][path]; hides records older than seq at or below path.
+// A record's seq is (block << 10) | slot, so records are only ever appended and a
+// removal is one small rule; a rebuild folds the rules back in. A query reads the
+// signatures sequentially and opens only the blocks holding all of its trigrams.
+// Changes are queued from any task and applied by step() on the loop task (the only
+// task that touches SD); a rebuild walks the drive a slice at a time while idle.
+// D: is re-stamped whenever SdSpaceTracker has an exact count and the index is up to
+// date; a card mounted with a different stamp was changed elsewhere and is rebuilt.
+class FileIndex {
+public:
+    // Shorter queries have no trigram to test and would read every block.
+    static constexpr size_t MIN_QUERY = 3;
+
+    // One running search, started by beginSearch() and advanced by stepSearch().
+    struct Query {
+        char drive;
+        String text;                 // ASCII-folded
+        std::vector<uint16_t> bits;  // signature bits every candidate block has set
+        uint32_t epoch;
+        uint32_t block;
+        uint32_t blocks;
+        uint32_t found;
+        bool active;
+        bool stale;                  // index rebuilt or drive gone: start again
+
+        Query() : drive(0), epoch(0), block(0), blocks(0), found(0), active(false), stale(false) {}
+    };
+
+private:
+    static constexpr size_t BLOCK_BYTES = 2048;
+    static constexpr size_t BLOCK_HEAD = 4;
+    static constexpr size_t REC_HEAD = 3;
+    static constexpr size_t MAX_PATH = BLOCK_BYTES - BLOCK_HEAD - REC_HEAD;
+    static constexpr size_t SIG_BYTES = 256;
+    static constexpr uint8_t SIG_BITS = 11;
+    static constexpr size_t SIG_HEAD = 16;
+    static constexpr uint8_t SLOT_BITS = 10;
+    static constexpr uint16_t MAX_SLOTS = (1u << SLOT_BITS) - 1;
+    static constexpr size_t PENDING_MAX = 512;
+    static constexpr size_t BUILD_TOUCHED_MAX = 32;
+    static constexpr uint16_t WALK_SD_CHUNKS = 2;
+    static constexpr uint32_t STEP_BUDGET_MS = 15;
+    static constexpr size_t SEARCH_BUF = 8192;
+
+    enum OpKind : uint8_t { OP_ADD, OP_REMOVE };
+
+    struct Op {
+        char drive;
+        uint8_t kind;
+        String path;
+    };
+
+    struct Rule {
+        uint32_t seq;
+        String path;
+    };
+
+    struct Drive {
+        char id;
+        bool loaded;
+        bool valid;
+        bool want_build;
+        uint32_t blocks;      // on disk, including the partly filled tail
+        uint16_t tail_count;
+        uint16_t tail_used;
+        uint32_t stamp_serial;
+        uint32_t stamp_free;
+        bool verify;          // compare the stamp with the card on the next exact count
+        std::vector<Rule> rules;
+    };
+
+    // A block being filled: records in a leased buffer, signature alongside.
+    struct Block {
+        ScratchLease buf;
+        uint8_t sig[SIG_BYTES];
+        char drive;
+        uint32_t no;
+        uint16_t count;
+        uint16_t used;
+        bool dirty;
+
+        Block() : drive(0), no(0), count(0), used(BLOCK_HEAD), dirty(false) {}
+    };
+
+    // Depth-first walk of a subtree, resumable across steps. No SD handle is held
+    // between steps: the directory is reopened and its scan resumed at sd_pos.
+    struct Walk {
+        char drive;
+        bool active;
+        bool failed;
+        std::vector<String> dirs;
+        String cur;
+        std::unique_ptr<LfsDirIter> lfs;
+        std::unique_ptr<SdDirScanner> sd;
+        uint64_t sd_pos;
+        uint32_t sd_taken;
+        bool sd_end;
+        std::vector<FileListItem> sd_items;
+        size_t sd_next;
+
+        Walk() : drive(0), active(false), failed(false), sd_pos(0), sd_taken(0), sd_end(false), sd_next(0) {}
+    };
+
+    // One index file on either drive.
+    struct IndexFile {
+        char drive;
+        File lfs;
+        FsFile sd;
+
+        IndexFile() : drive(0) {}
+
+        // mode: 'r' read, '+' read/write (created if missing), 'w' truncate.
+        bool open(char d, const String& path, char mode) {
+            drive = d;
+            if (d == 'L') {
+                if (mode == '+' && !LittleFS.exists(path.c_str())) mode = 'w';
+                lfs = LittleFS.open(path.c_str(), mode == 'r' ? "r" : (mode == 'w' ? "w+" : "r+"));
+                return (bool)lfs;
+            }
+            oflag_t flags = O_RDONLY;
+            if (mode == '+') flags = O_RDWR | O_CREAT;
+            else if (mode == 'w') flags = O_RDWR | O_CREAT | O_TRUNC;
+            sd = StorageHelper::getInstance()->getFs().open(path.c_str(), flags);
+            return sd.isOpen();
+        }
+        uint64_t size() { return drive == 'L' ? (uint64_t)lfs.size() : sd.fileSize(); }
+        bool readAt(uint64_t off, uint8_t* p, size_t n) {
+            if (drive == 'L') return lfs.seek((uint32_t)off) && lfs.read(p, n) == n;
+            return sd.seekSet(off) && sd.read(p, n) == (int)n;
+        }
+        bool writeAt(uint64_t off, const uint8_t* p, size_t n) {
+            if (drive == 'L') return lfs.seek((uint32_t)off) && lfs.write(p, n) == n;
+            return sd.seekSet(off) && sd.write(p, n) == n;
+        }
+        void close() {
+            if (lfs) lfs.close();
+            if (sd.isOpen()) sd.close();
+        }
+    };
+
+    Drive drives[2];
+    std::vector<Op> pending;
+    bool lost[2];                       // queue overflowed: only a rebuild is exact
+    SemaphoreHandle_t lock;
+    Walk live;                          // folder added by an op, indexed a slice at a time
+    Block live_block;                   // tail block being appended to; written every step
+    Walk build;                         // full rebuild into the .tmp files
+    Block build_block;
+    std::vector<String> build_touched;  // changed on the building drive since it started
+    uint32_t build_entries;
+    uint32_t build_started_ms;
+    uint32_t epoch;
+    uint32_t sd_sync_seen;              // SdSpaceTracker count already stamped/verified
+
+    static FileIndex* instance;
+
+    FileIndex() : lock(xSemaphoreCreateMutex()), build_entries(0), build_started_ms(0), epoch(0), sd_sync_seen(0) {
+        drives[0].id = 'L';
+        drives[1].id = 'D';
+        for (Drive& d : drives) resetDrive(d);
+        lost[0] = lost[1] = false;
+    }
+
+    void take() { if (lock) xSemaphoreTake(lock, portMAX_DELAY); }
+    void give() { if (lock) xSemaphoreGive(lock); }
+
+    static uint16_t le16(const uint8_t* p) { return (uint16_t)p[0] | ((uint16_t)p[1] << 8); }
+    static uint32_t le32(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+    static void put16(uint8_t* p, uint16_t v) {
+        p[0] = (uint8_t)v;
+        p[1] = (uint8_t)(v >> 8);
+    }
+    static void put32(uint8_t* p, uint32_t v) {
+        put16(p, (uint16_t)v);
+        put16(p + 2, (uint16_t)(v >> 16));
+    }
+
+    static char fold(char c) { return (c >= 'A' && c <= 'Z') ? (char)(c + 32) : c; }
+
+    static uint16_t gramBit(char a, char b, char c) {
+        uint32_t v = ((uint32_t)(uint8_t)a << 16) | ((uint32_t)(uint8_t)b << 8) | (uint8_t)c;
+        return (uint16_t)((v * 2654435761u) >> (32 - SIG_BITS));
+    }
+
+    static size_t baseStart(const char* path, size_t len) {
+        while (len > 0 && path[len - 1] != '/') len--;
+        return len;
+    }
+
+    static bool containsFolded(const char* s, size_t n, const String& needle) {
+        size_t m = needle.length();
+        if (m > n) return false;
+        const char* nd = needle.c_str();
+        for (size_t i = 0; i + m <= n; i++) {
+            size_t k = 0;
+            while (k < m && fold(s[i + k]) == nd[k]) k++;
+            if (k == m) return true;
+        }
+        return false;
+    }
+
+    // True when path (len bytes) is root itself or lies below it.
+    static bool under(const char* root, const char* path, size_t len) {
+        size_t n = strlen(root);
+        if (len < n || memcmp(path, root, n) != 0) return false;
+        return len == n || path[n] == '/';
+    }
+
+    static bool isSkipped(char drive, const String& inner) {
+        const char* p = inner.c_str();
+        size_t n = inner.length();
+        if (under(TrashBin::DIR, p, n) || under(INDEX_DIR, p, n)) return true;
+        // NoteBackup's mirror would repeat every note name; it is browsed, not searched.
+        return drive == 'D' && under(BACKUP_DIR, p, n);
+    }
+
+    static bool sdReady() { return StorageHelper::getInstance()->isInitialized(); }
+    static bool driveReady(char d) { return d == 'L' || (d == 'D' && sdReady()); }
+    static String filePath(const char* name) { return String(INDEX_DIR) + "/" + name; }
+    static uint8_t slot(char d) { return d == 'D' ? 1 : 0; }
+    Drive& state(char d) { return drives[slot(d)]; }
+
+    static void resetDrive(Drive& d) {
+        d.loaded = false;
+        d.valid = false;
+        d.want_build = false;
+        d.blocks = 0;
+        d.tail_count = 0;
+        d.tail_used = BLOCK_HEAD;
+        d.stamp_serial = 0;
+        d.stamp_free = 0;
+        d.verify = false;
+        d.rules.clear();
+    }
+
+    static uint32_t nextSeq(const Drive& d) {
+        return d.blocks == 0 ? 0 : ((d.blocks - 1) << SLOT_BITS) | d.tail_count;
+    }
+
+    static bool hidden(const Drive& d, uint32_t seq, const char* path, size_t len) {
+        for (const Rule& r : d.rules) {
+            if (seq < r.seq && under(r.path.c_str(), path, len)) return true;
+        }
+        return false;
+    }
+
+    static bool ensureDir(char d) {
+        if (d == 'L') return LittleFS.exists(INDEX_DIR) || LittleFS.mkdir(INDEX_DIR);
+        SdFs& fs = StorageHelper::getInstance()->getFs();
+        return fs.exists(INDEX_DIR) || fs.mkdir(INDEX_DIR);
+    }
+
+    static void removeFile(char d, const String& path) {
+        if (d == 'L') {
+            if (LittleFS.exists(path.c_str())) LittleFS.remove(path.c_str());
+        } else {
+            SdFs& fs = StorageHelper::getInstance()->getFs();
+            if (fs.exists(path.c_str())) fs.remove(path.c_str());
+        }
+    }
+
+    static bool renameFile(char d, const String& from, const String& to) {
+        if (d == 'L') return LittleFS.rename(from.c_str(), to.c_str());
+        return StorageHelper::getInstance()->getFs().rename(from.c_str(), to.c_str());
+    }
+
+    // Reads the header, tail block header and rules of a drive's index.
+    void load(Drive& d) {
+        bool want = d.want_build;
+        resetDrive(d);
+        d.loaded = true;
+        d.want_build = want;
+        IndexFile sig, names;
+        uint8_t head[SIG_HEAD];
+        bool ok = sig.open(d.id, filePath("sig.bin"), 'r') && sig.readAt(0, head, SIG_HEAD) &&
+                  memcmp(head, "FIX1", 4) == 0;
+        if (ok) {
+            d.blocks = le32(head + 4);
+            d.stamp_serial = le32(head + 8);
+            d.stamp_free = le32(head + 12);
+            ok = sig.size() >= SIG_HEAD + (uint64_t)d.blocks * SIG_BYTES && names.open(d.id, filePath("names.bin"), 'r') &&
+                 names.size() >= (uint64_t)d.blocks * BLOCK_BYTES;
+        }
+        if (ok && d.blocks > 0) {
+            uint8_t bh[BLOCK_HEAD];
+            ok = names.readAt((uint64_t)(d.blocks - 1) * BLOCK_BYTES, bh, BLOCK_HEAD);
+            d.tail_count = le16(bh);
+            d.tail_used = le16(bh + 2);
+            ok = ok && d.tail_used >= BLOCK_HEAD && d.tail_used <= BLOCK_BYTES && d.tail_count <= MAX_SLOTS;
+        }
+        sig.close();
+        names.close();
+        if (!ok) {
+            d.blocks = 0;
+            d.tail_count = 0;
+            d.tail_used = BLOCK_HEAD;
+            d.want_build = true;
+            return;
+        }
+        loadRules(d);
+        d.valid = true;
+        if (d.rules.size() >= INDEX_MAX_RULES) d.want_build = true;
+    }
+
+    void loadRules(Drive& d) {
+        IndexFile f;
+        if (!f.open(d.id, filePath("rules.bin"), 'r')) return;
+        uint64_t size = f.size();
+        uint64_t off = 0;
+        uint8_t h[6];
+        uint8_t chunk[64];
+        while (off + sizeof(h) <= size && f.readAt(off, h, sizeof(h))) {
+            Rule r;
+            r.seq = le32(h);
+            uint16_t len = le16(h + 4);
+            off += sizeof(h);
+            if (len == 0 || off + len > size) break;
+            r.path.reserve(len);
+            for (uint16_t done = 0; done < len;) {
+                size_t left = (size_t)(len - done);
+                uint16_t n = left < sizeof(chunk) ? (uint16_t)left : (uint16_t)sizeof(chunk);
+                if (!f.readAt(off + done, chunk, n)) break;
+                r.path.concat((const char*)chunk, n);
+                done += n;
+            }
+            off += len;
+            if (r.path.length() != len) break;
+            d.rules.push_back(r);
+        }
+        f.close();
+    }
+
+    void appendRule(Drive& d, const String& path) {
+        Rule r;
+        r.seq = nextSeq(d);
+        r.path = path;
+        uint8_t h[6];
+        put32(h, r.seq);
+        put16(h + 4, (uint16_t)path.length());
+        IndexFile f;
+        bool ok = f.open(d.id, filePath("rules.bin"), '+');
+        if (ok) {
+            uint64_t off = f.size();
+            ok = f.writeAt(off, h, sizeof(h)) && f.writeAt(off + sizeof(h), (const uint8_t*)path.c_str(), path.length());
+        }
+        f.close();
+        d.rules.push_back(r);
+        if (!ok || d.rules.size() >= INDEX_MAX_RULES) d.want_build = true;
+    }
+
+    static bool startBlock(Block& b, char drive, uint32_t no) {
+        if (!b.buf) b.buf = ScratchPool::getInstance()->lease(BLOCK_BYTES, BLOCK_BYTES);
+        if (!b.buf) return false;
+        memset(b.buf.data(), 0, BLOCK_BYTES);
+        memset(b.sig, 0, SIG_BYTES);
+        b.drive = drive;
+        b.no = no;
+        b.count = 0;
+        b.used = BLOCK_HEAD;
+        b.dirty = false;
+        put16(b.buf.data() + 2, BLOCK_HEAD);
+        return true;
+    }
+
+    static bool blockFits(const Block& b, size_t len) {
+        return b.count < MAX_SLOTS && b.used + REC_HEAD + len <= BLOCK_BYTES;
+    }
+
+    static void blockAdd(Block& b, const String& path, bool is_dir) {
+        size_t len = path.length();
+        uint8_t* p = b.buf.data() + b.used;
+        p[0] = is_dir ? 1 : 0;
+        put16(p + 1, (uint16_t)len);
+        memcpy(p + REC_HEAD, path.c_str(), len);
+        b.used += REC_HEAD + len;
+        b.count++;
+        put16(b.buf.data(), b.count);
+        put16(b.buf.data() + 2, b.used);
+        const char* s = path.c_str();
+        for (size_t i = baseStart(s, len); i + 3 <= len; i++) {
+            uint16_t bit = gramBit(fold(s[i]), fold(s[i + 1]), fold(s[i + 2]));
+            b.sig[bit >> 3] |= (uint8_t)(1u << (bit & 7));
+        }
+        b.dirty = true;
+    }
+
+    static bool writeBlock(const Block& b, const char* names_file, const char* sig_file) {
+        IndexFile names, sig;
+        bool ok = names.open(b.drive, filePath(names_file), '+') &&
+                  names.writeAt((uint64_t)b.no * BLOCK_BYTES, b.buf.data(), BLOCK_BYTES) &&
+                  sig.open(b.drive, filePath(sig_file), '+') &&
+                  sig.writeAt(SIG_HEAD + (uint64_t)b.no * SIG_BYTES, b.sig, SIG_BYTES);
+        names.close();
+        sig.close();
+        return ok;
+    }
+
+    static bool writeHeader(char drive, const char* sig_file, uint32_t blocks, uint32_t serial, uint32_t free_clusters) {
+        uint8_t head[SIG_HEAD] = {'F', 'I', 'X', '1'};
+        put32(head + 4, blocks);
+        put32(head + 8, serial);
+        put32(head + 12, free_clusters);
+        IndexFile sig;
+        bool ok = sig.open(drive, filePath(sig_file), '+') && sig.writeAt(0, head, SIG_HEAD);
+        sig.close();
+        return ok;
+    }
+
+    // Appends one record to a drive's live index through live_block, loading the tail
+    // block on first use; the block is written back by flushLive().
+    bool appendLive(Drive& d, const String& path, bool is_dir) {
+        if (path.length() > MAX_PATH) return true;
+        Block& b = live_block;
+        if (b.buf && b.drive != d.id && !flushLive()) return false;
+        if (!b.buf) {
+            bool tail = d.blocks > 0 && d.tail_count < MAX_SLOTS && d.tail_used + REC_HEAD + path.length() <= BLOCK_BYTES;
+            if (!startBlock(b, d.id, tail ? d.blocks - 1 : d.blocks)) return false;
+            if (tail) {
+                IndexFile names, sig;
+                bool ok = names.open(d.id, filePath("names.bin"), 'r') &&
+                          names.readAt((uint64_t)b.no * BLOCK_BYTES, b.buf.data(), BLOCK_BYTES) &&
+                          sig.open(d.id, filePath("sig.bin"), 'r') &&
+                          sig.readAt(SIG_HEAD + (uint64_t)b.no * SIG_BYTES, b.sig, SIG_BYTES);
+                names.close();
+                sig.close();
+                if (!ok) {
+                    b.buf.release();
+                    return false;
+                }
+                b.count = d.tail_count;
+                b.used = d.tail_used;
+            }
+        }
+        if (!blockFits(b, path.length())) {
+            if (!flushLive()) return false;
+            if (!startBlock(b, d.id, d.blocks)) return false;
+        }
+        blockAdd(b, path, is_dir);
+        return true;
+    }
+
+    // Writes live_block back and publishes the new tail; the block is written before
+    // the header, so a cut-off write leaves at worst an unreferenced block.
+    bool flushLive() {
+        Block& b = live_block;
+        if (!b.buf) return true;
+        bool ok = true;
+        if (b.dirty) {
+            Drive& d = state(b.drive);
+            bool grew = b.no >= d.blocks;
+            ok = driveReady(b.drive) && writeBlock(b, "names.bin", "sig.bin") &&
+                 (!grew || writeHeader(b.drive, "sig.bin", b.no + 1, d.stamp_serial, d.stamp_free));
+            if (ok) {
+                if (grew && b.drive == 'D') SdSpaceTracker::getInstance()->noteAllocated(BLOCK_BYTES + SIG_BYTES);
+                d.blocks = grew ? b.no + 1 : d.blocks;
+                d.tail_count = b.count;
+                d.tail_used = b.used;
+            } else {
+                d.want_build = true;
+                Serial.printf("[INDEX] %c: write failed\n", b.drive);
+            }
+        }
+        b.buf.release();
+        return ok;
+    }
+
+    static void endWalk(Walk& w) {
+        w.active = false;
+        w.dirs.clear();
+        w.cur = "";
+        w.lfs.reset();
+        w.sd.reset();
+        w.sd_items.clear();
+        w.sd_next = 0;
+    }
+
+    static void beginWalk(Walk& w, char drive, const String& root) {
+        endWalk(w);
+        w.drive = drive;
+        w.active = true;
+        w.failed = false;
+        w.dirs.push_back(root);
+    }
+
+    // Decodes the next chunks of w.cur. A directory the raw scanner rejects is read
+    // with openNext() instead, skipping the sd_taken entries already returned.
+    static void fillSd(Walk& w) {
+        w.sd_items.clear();
+        w.sd_next = 0;
+        if (!sdReady()) {
+            w.failed = true;
+            endWalk(w);
+            return;
+        }
+        SdFs& fs = StorageHelper::getInstance()->getFs();
+        FsFile dir = fs.open(w.cur.c_str(), O_RDONLY);
+        if (!dir.isOpen() || !dir.isDir()) {
+            if (dir.isOpen()) dir.close();
+            w.sd_end = true;
+            return;
+        }
+        int rc = 0;
+        if (!w.sd) {
+            w.sd.reset(new SdDirScanner(fs.fatType()));
+            if (!w.sd->begin(dir)) rc = -1;
+        } else if (!dir.seekSet(w.sd_pos)) {
+            rc = -1;
+        }
+        if (rc == 0) rc = w.sd->step(dir, w.sd_items, WALK_SD_CHUNKS);
+        w.sd_pos = dir.curPosition();
+        if (rc < 0) {
+            w.sd_items.clear();
+            dir.rewind();
+            FsFile entry;
+            char name[256];
+            uint32_t skip = w.sd_taken;
+            uint32_t iter = 0;
+            while (entry.openNext(&dir, O_RDONLY)) {
+                name[0] = '\0';
+                entry.getName(name, sizeof(name));
+                bool is_dir = entry.isDir();
+                entry.close();
+                if ((++iter & 0x0F) == 0) delay(0);
+                if (name[0] == '\0') continue;
+                if (skip > 0) {
+                    skip--;
+                    continue;
+                }
+                FileListItem it;
+                it.name = name;
+                it.is_dir = is_dir;
+                w.sd_items.push_back(it);
+            }
+            rc = 1;
+        }
+        dir.close();
+        if (rc > 0) w.sd_end = true;
+    }
+
+    // Next entry below the walk's root. False when nothing is ready this call; the
+    // walk is over once w.active drops.
+    static bool walkNext(Walk& w, String& path, bool& is_dir) {
+        String name;
+        while (w.active) {
+            if (w.cur.length() == 0) {
+                if (w.dirs.empty()) {
+                    endWalk(w);
+                    return false;
+                }
+                w.cur = w.dirs.back();
+                w.dirs.pop_back();
+                w.sd.reset();
+                w.sd_items.clear();
+                w.sd_next = 0;
+                w.sd_pos = 0;
+                w.sd_taken = 0;
+                w.sd_end = false;
+                if (w.drive == 'L') {
+                    w.lfs.reset(new LfsDirIter(w.cur));
+                    if (!w.lfs->isOpen()) {
+                        w.lfs.reset();
+                        w.cur = "";
+                        continue;
+                    }
+                }
+            }
+            if (w.drive == 'L') {
+                if (!w.lfs->next(name, is_dir)) {
+                    w.lfs.reset();
+                    w.cur = "";
+                    continue;
+                }
+            } else {
+                if (w.sd_next >= w.sd_items.size()) {
+                    if (w.sd_end) {
+                        w.cur = "";
+                        continue;
+                    }
+                    fillSd(w);
+                    if (w.sd_next >= w.sd_items.size()) return false;
+                }
+                const FileListItem& it = w.sd_items[w.sd_next++];
+                name = it.name;
+                is_dir = it.is_dir;
+                w.sd_taken++;
+            }
+            path = (w.cur == "/") ? "/" + name : w.cur + "/" + name;
+            if (isSkipped(w.drive, path)) continue;
+            if (is_dir) w.dirs.push_back(path);
+            return true;
+        }
+        return false;
+    }
+
+    static bool probe(char drive, const String& path, bool& is_dir) {
+        if (drive == 'L') {
+            File f = LittleFS.open(path.c_str(), "r");
+            if (!f) return false;
+            is_dir = f.isDirectory();
+            f.close();
+            return true;
+        }
+        FsFile f = StorageHelper::getInstance()->getFs().open(path.c_str(), O_RDONLY);
+        if (!f.isOpen()) return false;
+        is_dir = f.isDir();
+        f.close();
+        return true;
+    }
+
+    void queue(char drive, uint8_t kind, const String& inner) {
+#if INDEX_ENABLED
+        if (drive != 'L' && drive != 'D') return;
+        String p = inner;
+        while (p.length() > 1 && p.endsWith("/")) p.remove(p.length() - 1);
+        if (isSkipped(drive, p)) return;
+        take();
+        if (p.length() <= 1 || pending.size() >= PENDING_MAX) {
+            lost[slot(drive)] = true;
+        } else {
+            Op op;
+            op.drive = drive;
+            op.kind = kind;
+            op.path = p;
+            pending.push_back(op);
+        }
+        give();
+#else
+        (void)drive;
+        (void)kind;
+        (void)inner;
+#endif
+    }
+
+    bool pendingEmpty() {
+        take();
+        bool empty = pending.empty() && !lost[0] && !lost[1];
+        give();
+        return empty;
+    }
+
+    // Once SdSpaceTracker has a fresh count: after a mount, compare it with the stamp
+    // (a mismatch means the card was changed elsewhere); later, record it while the
+    // index holds every change we made.
+    void stampSd() {
+        Drive& d = drives[1];
+        SdSpaceTracker* space = SdSpaceTracker::getInstance();
+        if (!d.loaded || !d.valid || d.want_build || !sdReady()) return;
+        if (!space->isExact() || space->syncGeneration() == sd_sync_seen) return;
+        if (live.active || (build.active && build.drive == 'D') || !pendingEmpty()) return;
+        sd_sync_seen = space->syncGeneration();
+        uint32_t serial = space->volumeSerial();
+        uint32_t free_clusters = space->freeClusters();
+        if (d.verify) {
+            d.verify = false;
+            if (serial != d.stamp_serial || free_clusters != d.stamp_free) {
+                Serial.println("[INDEX] D: card changed since last indexed, rebuilding");
+                d.want_build = true;
+            }
+            return;
+        }
+        if (serial == d.stamp_serial && free_clusters == d.stamp_free) return;
+        if (!writeHeader('D', "sig.bin", d.blocks, serial, free_clusters)) return;
+        d.stamp_serial = serial;
+        d.stamp_free = free_clusters;
+    }
+
+    bool popOp(Op& op) {
+        take();
+        bool ok = !pending.empty();
+        if (ok) {
+            op = pending.front();
+            pending.erase(pending.begin());
+        }
+        give();
+        return ok;
+    }
+
+    void noteBuildTouched(const String& path) {
+        if (build_touched.size() >= BUILD_TOUCHED_MAX) return;
+        build_touched.push_back(path);
+    }
+
+    void applyOp(const Op& op) {
+        if (!driveReady(op.drive)) return;
+        Drive& d = state(op.drive);
+        if (!d.loaded) return;
+        if (build.active && build.drive == op.drive) noteBuildTouched(op.path);
+        if (!d.valid) return;
+        if (op.kind == OP_REMOVE) {
+            if (!flushLive()) return;
+            appendRule(d, op.path);
+            return;
+        }
+        bool is_dir = false;
+        if (!probe(op.drive, op.path, is_dir)) return;
+        if (!appendLive(d, op.path, is_dir)) {
+            d.want_build = true;
+            return;
+        }
+        if (is_dir) beginWalk(live, op.drive, op.path);
+    }
+
+    void stepLive(uint32_t t0) {
+        Drive& d = state(live.drive);
+        String path;
+        bool is_dir = false;
+        while (live.active && (millis() - t0) < STEP_BUDGET_MS) {
+            if (!walkNext(live, path, is_dir)) continue;
+            if (!appendLive(d, path, is_dir)) {
+                endWalk(live);
+                d.want_build = true;
+            }
+        }
+        if (live.failed) d.want_build = true;
+    }
+
+    // Follows SD mounts: D: is (re)loaded on the first step after a mount.
+    void syncDrives() {
+        if (!drives[0].loaded) load(drives[0]);
+        Drive& sd = drives[1];
+        if (sdReady() && !sd.loaded) {
+            load(sd);
+            sd.verify = INDEX_VERIFY_ON_MOUNT && sd.valid;
+            sd_sync_seen = 0;
+        }
+        take();
+        for (uint8_t i = 0; i < 2; i++) {
+            if (lost[i]) drives[i].want_build = true;
+            lost[i] = false;
+        }
+        give();
+    }
+
+    void abortBuild(bool retry) {
+        char id = build.drive;
+        endWalk(build);
+        build_block.buf.release();
+        build_touched.clear();
+        if (driveReady(id)) {
+            removeFile(id, filePath("names.tmp"));
+            removeFile(id, filePath("sig.tmp"));
+        }
+        if (retry) state(id).want_build = true;
+    }
+
+    void startBuild(Drive& d) {
+        d.want_build = false;
+        IndexFile names, sig;
+        bool ok = ensureDir(d.id) && names.open(d.id, filePath("names.tmp"), 'w') && sig.open(d.id, filePath("sig.tmp"), 'w');
+        names.close();
+        sig.close();
+        if (!ok || !startBlock(build_block, d.id, 0)) {
+            build_block.buf.release();
+            Serial.printf("[INDEX] %c: cannot start rebuild\n", d.id);
+            return;
+        }
+        build_touched.clear();
+        build_entries = 0;
+        build_started_ms = millis();
+        beginWalk(build, d.id, "/");
+    }
+
+    void stepBuild(uint32_t t0) {
+        String path;
+        bool is_dir = false;
+        while (build.active && (millis() - t0) < STEP_BUDGET_MS) {
+            if (!walkNext(build, path, is_dir)) continue;
+            if (path.length() > MAX_PATH) continue;
+            if (!blockFits(build_block, path.length())) {
+                if (!writeBlock(build_block, "names.tmp", "sig.tmp")) {
+                    Serial.printf("[INDEX] %c: rebuild write failed\n", build.drive);
+                    abortBuild(false);
+                    return;
+                }
+                startBlock(build_block, build.drive, build_block.no + 1);
+            }
+            blockAdd(build_block, path, is_dir);
+            build_entries++;
+        }
+        if (build.active) return;
+        if (build.failed || build_touched.size() >= BUILD_TOUCHED_MAX) {
+            abortBuild(true);
+            return;
+        }
+        commitBuild();
+    }
+
+    // Swaps the finished .tmp files in, then replays what changed while it ran.
+    void commitBuild() {
+        char id = build.drive;
+        Drive& d = state(id);
+        uint32_t blocks = build_block.no + (build_block.count > 0 ? 1 : 0);
+        bool ok = (build_block.count == 0 || writeBlock(build_block, "names.tmp", "sig.tmp")) &&
+                  writeHeader(id, "sig.tmp", blocks, 0, 0);
+        build_block.buf.release();
+        if (ok && live_block.buf && live_block.drive == id) ok = flushLive();
+        if (ok) {
+            removeFile(id, filePath("names.bin"));
+            removeFile(id, filePath("sig.bin"));
+            removeFile(id, filePath("rules.bin"));
+            ok = renameFile(id, filePath("names.tmp"), filePath("names.bin")) &&
+                 renameFile(id, filePath("sig.tmp"), filePath("sig.bin"));
+        }
+        if (!ok) {
+            Serial.printf("[INDEX] %c: rebuild commit failed\n", id);
+            abortBuild(false);
+            resetDrive(d);
+            return;
+        }
+        if (id == 'D') {
+            // The new index has no stamp yet; the next exact count provides it.
+            SdSpaceTracker::getInstance()->requestResync();
+            sd_sync_seen = SdSpaceTracker::getInstance()->syncGeneration();
+        }
+        if (live.active && live.drive == id) endWalk(live);
+        d.want_build = false;
+        load(d);
+        epoch++;
+        Serial.printf("[INDEX] %c: %lu entries in %lu blocks, %lu ms\n", id, (unsigned long)build_entries,
+                      (unsigned long)blocks, (unsigned long)(millis() - build_started_ms));
+        std::vector<String> touched;
+        touched.swap(build_touched);
+        take();
+        for (const String& p : touched) {
+            Op rm;
+            rm.drive = id;
+            rm.kind = OP_REMOVE;
+            rm.path = p;
+            Op add = rm;
+            add.kind = OP_ADD;
+            pending.push_back(rm);
+            pending.push_back(add);
+        }
+        give();
+    }
+
+    void scanBlock(Query& q, const Drive& d, uint32_t no, const uint8_t* blk, std::vector<FileListItem>& out) {
+        uint16_t count = le16(blk);
+        uint16_t used = le16(blk + 2);
+        if (used > BLOCK_BYTES) return;
+        size_t off = BLOCK_HEAD;
+        for (uint16_t s = 0; s < count && off + REC_HEAD <= used && q.found < SEARCH_MAX_RESULTS; s++) {
+            bool is_dir = (blk[off] & 1) != 0;
+            uint16_t len = le16(blk + off + 1);
+            const char* p = (const char*)blk + off + REC_HEAD;
+            off += REC_HEAD + len;
+            if (off > used) break;
+            size_t base = baseStart(p, len);
+            if (!containsFolded(p + base, len - base, q.text)) continue;
+            if (hidden(d, (no << SLOT_BITS) | s, p, len)) continue;
+            FileListItem it;
+            it.name.concat(p, len);
+            it.is_dir = is_dir;
+            it.sort_key = NameCollation::prefixKey(it.name.c_str() + base);
+            out.push_back(it);
+            q.found++;
+        }
+    }
+
+public:
+    static FileIndex* getInstance() {
+        if (!instance) instance = new FileIndex();
+        return instance;
+    }
+
+    // Path inside the index directory; kept out of listings, backups and the index.
+    static bool isIndexPath(const String& inner) { return under(INDEX_DIR, inner.c_str(), inner.length()); }
+
+    // inner was created, copied or moved in (a folder with everything below it).
+    void noteAdded(char drive, const String& inner) { queue(drive, OP_ADD, inner); }
+    // inner and everything below it is gone.
+    void noteRemoved(char drive, const String& inner) { queue(drive, OP_REMOVE, inner); }
+    // Loop task. A search hit that no longer exists: hidden at once, and the drive,
+    // changed behind the index, is rebuilt.
+    void noteMissing(char drive, const String& inner) {
+        if (!driveReady(drive)) return;
+        Drive& d = state(drive);
+        if (d.loaded && d.valid && flushLive()) appendRule(d, inner);
+        d.want_build = true;
+    }
+    // inner may have been removed, replaced or partly changed.
+    void noteChanged(char drive, const String& inner) {
+        queue(drive, OP_REMOVE, inner);
+        queue(drive, OP_ADD, inner);
+    }
+
+    // Loop task, only while no file operation runs. Applies queued changes (walking
+    // added folders a slice at a time) and, while the UI is idle, rebuilds.
+    void step(bool idle) {
+#if INDEX_ENABLED
+        uint32_t t0 = millis();
+        syncDrives();
+        if (live.active) stepLive(t0);
+        Op op;
+        while (!live.active && (millis() - t0) < STEP_BUDGET_MS && popOp(op)) {
+            applyOp(op);
+            if (live.active) stepLive(t0);
+        }
+        flushLive();
+        stampSd();
+        if (!idle || live.active) return;
+        if (build.active) {
+            if (!driveReady(build.drive)) abortBuild(true);
+            else stepBuild(t0);
+            return;
+        }
+        for (Drive& d : drives) {
+            if (d.loaded && d.want_build && driveReady(d.id)) {
+                startBuild(d);
+                return;
+            }
+        }
+#else
+        (void)idle;
+#endif
+    }
+
+    // The card is gone: forget D: (reloaded, and rebuilt, on the next mount).
+    void onSdRemoved() {
+        if (build.active && build.drive == 'D') {
+            endWalk(build);
+            build_block.buf.release();
+            build_touched.clear();
+        }
+        if (live.drive == 'D') endWalk(live);
+        if (live_block.buf && live_block.drive == 'D') live_block.buf.release();
+        resetDrive(drives[1]);
+        epoch++;
+    }
+
+    bool isReady(char drive) {
+        if (!driveReady(drive)) return false;
+        const Drive& d = state(drive);
+        return d.loaded && d.valid;
+    }
+
+    // Starts a filename search on drive; false while it has no usable index yet
+    // (a rebuild is requested and runs once the UI is idle).
+    bool beginSearch(char drive, const String& text, Query& q) {
+        q = Query();
+#if INDEX_ENABLED
+        if (!driveReady(drive)) return false;
+        syncDrives();
+        Drive& d = state(drive);
+        if (!d.valid) {
+            d.want_build = true;
+            return false;
+        }
+        q.drive = drive;
+        if (text.length() < MIN_QUERY) return true;
+        q.text.reserve(text.length());
+        for (size_t i = 0; i < text.length(); i++) q.text += fold(text[i]);
+        for (size_t i = 0; i + 3 <= q.text.length(); i++) {
+            q.bits.push_back(gramBit(q.text[i], q.text[i + 1], q.text[i + 2]));
+        }
+        q.epoch = epoch;
+        q.blocks = d.blocks;
+        q.active = true;
+        return true;
+#else
+        (void)drive;
+        (void)text;
+        return false;
+#endif
+    }
+
+    // Appends matches (name = full inner path) for up to budget_ms; files are closed
+    // again before returning. q.active drops when the index has been read through.
+    void stepSearch(Query& q, std::vector<FileListItem>& out, uint32_t budget_ms) {
+        if (!q.active) return;
+        if (q.epoch != epoch || !driveReady(q.drive)) {
+            q.active = false;
+            q.stale = true;
+            return;
+        }
+        const Drive& d = state(q.drive);
+        ScratchLease buf = ScratchPool::getInstance()->lease(SEARCH_BUF, BLOCK_BYTES + SIG_BYTES);
+        if (!buf) return;
+        uint8_t* blk = buf.data();
+        uint8_t* sigs = buf.data() + BLOCK_BYTES;
+        uint32_t sig_cap = (uint32_t)((buf.size() - BLOCK_BYTES) / SIG_BYTES);
+        IndexFile sig, names;
+        if (!sig.open(q.drive, filePath("sig.bin"), 'r') || !names.open(q.drive, filePath("names.bin"), 'r')) {
+            q.active = false;
+            return;
+        }
+        uint32_t t0 = millis();
+        while (q.block < q.blocks && q.found < SEARCH_MAX_RESULTS && (millis() - t0) < budget_ms) {
+            uint32_t n = q.blocks - q.block;
+            if (n > sig_cap) n = sig_cap;
+            if (!sig.readAt(SIG_HEAD + (uint64_t)q.block * SIG_BYTES, sigs, n * SIG_BYTES)) {
+                q.block = q.blocks;
+                break;
+            }
+            for (uint32_t i = 0; i < n && q.found < SEARCH_MAX_RESULTS; i++) {
+                const uint8_t* s = sigs + i * SIG_BYTES;
+                bool hit = true;
+                for (uint16_t bit : q.bits) {
+                    if (!(s[bit >> 3] & (1u << (bit & 7)))) {
+                        hit = false;
+                        break;
+                    }
+                }
+                uint32_t no = q.block + i;
+                if (hit && names.readAt((uint64_t)no * BLOCK_BYTES, blk, BLOCK_BYTES)) scanBlock(q, d, no, blk, out);
+            }
+            q.block += n;
+            delay(0);
+        }
+        sig.close();
+        names.close();
+        if (q.block >= q.blocks || q.found >= SEARCH_MAX_RESULTS) q.active = false;
+    }
+};
+
+FileIndex* FileIndex::instance = nullptr;
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+enum FsJobPriority : uint8_t {
+    FS_PRIO_IDLE = 0,         // speculative work, cancelled when anything else is queued
+    FS_PRIO_BULK = 1,         // copy / delete batches
+    FS_PRIO_NORMAL = 2,       // create / rename
+    FS_PRIO_INTERACTIVE = 3   // directory scans the user is waiting on
+};
+
+// CancelToken - set by the UI, polled by the job between units of work.
+class CancelToken {
+private:
+    std::atomic<bool> cancelled;
+
+public:
+    CancelToken() : cancelled(false) {}
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+};
+
+enum FsJobEventKind : uint8_t {
+    FS_EVT_PROGRESS = 0,
+    FS_EVT_DONE = 1
+};
+
+struct FsJobEvent {
+    uint32_t job_id;
+    FsJobEventKind kind;
+    bool ok;
+    uint32_t count;   // files copied / paths deleted
+    uint32_t aux;     // paths actually removed
+    uint64_t bytes;   // bytes copied
+};
+
+// SpscRing - lock-free single-producer single-consumer ring. One slot stays empty
+// to tell full from empty, so capacity is N - 1.
+template <typename T, uint16_t N>
+class SpscRing {
+private:
+    T slots[N];
+    std::atomic<uint16_t> head;  // next write, producer only
+    std::atomic<uint16_t> tail;  // next read, consumer only
+
+public:
+    SpscRing() : head(0), tail(0) {}
+
+    bool push(const T& v) {
+        uint16_t h = head.load(std::memory_order_relaxed);
+        uint16_t next = (uint16_t)((h + 1) % N);
+        if (next == tail.load(std::memory_order_acquire)) return false;
+        slots[h] = v;
+        head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& out) {
+        uint16_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        out = slots[t];
+        tail.store((uint16_t)((t + 1) % N), std::memory_order_release);
+        return true;
+    }
+};
+
+// FsJobQueue - pending jobs ordered by priority, FIFO within a priority. Job needs
+// `id` and `priority` fields. Producers and the worker share it under a mutex; jobs
+// are few and short-lived, so a linear scan is enough.
+template <typename Job>
+class FsJobQueue {
+private:
+    std::vector<Job> pending;
+    SemaphoreHandle_t lock;
+    uint32_t next_id;
+
+    void take() { if (lock) xSemaphoreTake(lock, portMAX_DELAY); }
+    void give() { if (lock) xSemaphoreGive(lock); }
+
+    int bestIndex(int min_priority) const {
+        int best = -1;
+        for (size_t i = 0; i < pending.size(); i++) {
+            if ((int)pending[i].priority < min_priority) continue;
+            if (best < 0 || pending[i].priority > pending[best].priority) best = (int)i;
+        }
+        return best;
+    }
+
+public:
+    FsJobQueue() : lock(xSemaphoreCreateMutex()), next_id(1) {}
+
+    // Assigns job.id and queues it; returns the id.
+    uint32_t push(Job& job) {
+        take();
+        job.id = next_id++;
+        if (next_id == 0) next_id = 1;
+        pending.push_back(job);
+        give();
+        return job.id;
+    }
+
+    bool pop(Job& out) { return popAtLeast(0, out); }
+
+    // Highest-priority job with priority >= min_priority, if any.
+    bool popAtLeast(int min_priority, Job& out) {
+        take();
+        int i = bestIndex(min_priority);
+        if (i < 0) {
+            give();
+            return false;
+        }
+        out = pending[i];
+        pending.erase(pending.begin() + i);
+        give();
+        return true;
+    }
+};
+
+// BatchPipe - a producer task appends items in batches, the UI takes everything
+// published so far. Each side holds the mutex only to move a vector.
+template <typename T>
+class BatchPipe {
+private:
+    std::vector<T> staged;
+    SemaphoreHandle_t lock;
+
+    void take() { if (lock) xSemaphoreTake(lock, portMAX_DELAY); }
+    void give() { if (lock) xSemaphoreGive(lock); }
+
+public:
+    BatchPipe() : lock(xSemaphoreCreateMutex()) {}
+    ~BatchPipe() { if (lock) vSemaphoreDelete(lock); }
+    BatchPipe(const BatchPipe&) = delete;
+    BatchPipe& operator=(const BatchPipe&) = delete;
+
+    // Moves batch out (it is left empty).
+    void publish(std::vector<T>& batch) {
+        if (batch.empty()) return;
+        take();
+        if (staged.empty()) {
+            staged.swap(batch);
+        } else {
+            staged.reserve(staged.size() + batch.size());
+            for (size_t i = 0; i < batch.size(); i++) staged.push_back(std::move(batch[i]));
+        }
+        give();
+        batch.clear();
+    }
+
+    // Replaces out with everything published since the last drain.
+    bool drain(std::vector<T>& out) {
+        out.clear();
+        take();
+        out.swap(staged);
+        give();
+        return !out.empty();
+    }
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef LFSDIR_H
+#define LFSDIR_H
+
+#include <Arduino.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// LfsDirIter - LittleFS directory iteration through the esp_littlefs VFS.
+// readdir() is a straight lfs_dir_read: name and type come from directory metadata,
+// no child is opened (File::openNextFile() stats and opens every entry). Size is an
+// lfs_stat() metadata lookup, only done when asked for.
+class LfsDirIter {
+private:
+    static constexpr const char* VFS_BASE = "/littlefs";
+
+    DIR* dir;
+    String base;
+    String cur_name;
+
+public:
+    explicit LfsDirIter(const String& inner_path) : dir(nullptr) {
+        base = String(VFS_BASE) + inner_path;
+        if (base.length() > 1 && base.endsWith("/")) base.remove(base.length() - 1);
+        dir = opendir(base.c_str());
+    }
+
+    ~LfsDirIter() { close(); }
+
+    bool isOpen() const { return dir != nullptr; }
+
+    // Next entry name and type; false at end of directory.
+    bool next(String& name, bool& is_dir) {
+        if (!dir) return false;
+        while (true) {
+            struct dirent* e = readdir(dir);
+            if (!e) return false;
+            if (e->d_name[0] == '\0') continue;
+            if (e->d_name[0] == '.' && (e->d_name[1] == '\0' || (e->d_name[1] == '.' && e->d_name[2] == '\0'))) continue;
+            cur_name = e->d_name;
+            if (e->d_type == DT_DIR) is_dir = true;
+            else if (e->d_type == DT_REG) is_dir = false;
+            else {
+                struct stat st;
+                is_dir = (::stat((base + "/" + cur_name).c_str(), &st) == 0) && S_ISDIR(st.st_mode);
+            }
+            name = cur_name;
+            return true;
+        }
+    }
+
+    // Size (and mtime, if the build keeps it) of the entry last returned by next().
+    bool stat(uint64_t& size, uint32_t* mtime = nullptr) {
+        struct stat st;
+        if (!dir || ::stat((base + "/" + cur_name).c_str(), &st) != 0) return false;
+        size = (uint64_t)st.st_size;
+        if (mtime) *mtime = (uint32_t)st.st_mtime;
+        return true;
+    }
+
+    void close() {
+        if (dir) closedir(dir);
+        dir = nullptr;
+    }
+};
+
+#endif
@@ -0,0 +1,378 @@
+#ifndef LISTING_H
+#define LISTING_H
+
+#include <Arduino.h>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "../config.h"
+
+struct FileListItem {
+    String name;
+    bool is_dir;
+    uint32_t sort_key = 0;  // NameCollation::prefixKey(name), 0 if not computed yet
+    uint64_t size = 0;
+    uint32_t mtime = 0;  // seconds since 1970, 0 if unknown
+};
+
+// What sorting needs of an entry, whether it lives in a FileListItem or an EntryArena.
+struct EntryView {
+    const char* name;
+    uint32_t sort_key;
+    bool is_dir;
+    uint64_t size;
+    uint32_t mtime;
+
+    EntryView(const FileListItem& it)
+        : name(it.name.c_str()), sort_key(it.sort_key), is_dir(it.is_dir), size(it.size), mtime(it.mtime) {}
+    EntryView(const char* n, uint32_t key, bool dir, uint64_t sz, uint32_t mt)
+        : name(n), sort_key(key), is_dir(dir), size(sz), mtime(mt) {}
+};
+
+// NameCollation - list order for names: digits, then letters (case-insensitive),
+// then other ASCII, then UTF-8 bytes, compared byte by byte with a prefix first.
+// Each byte maps to one weight through a 256-entry table, and the first four weights
+// of a name pack into FileListItem::sort_key, so most comparisons are one integer
+// compare and the rest walk the names without per-character rank tests.
+class NameCollation {
+private:
+    struct Table {
+        uint8_t w[256];
+        Table() {
+            uint8_t next = 1;
+            w[0] = 0;
+            for (int c = '0'; c <= '9'; c++) w[c] = next++;
+            for (int c = 'a'; c <= 'z'; c++) {
+                w[c] = next;
+                w[c - 'a' + 'A'] = next++;
+            }
+            for (int c = 1; c < 0x80; c++) {
+                bool alnum = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+                if (!alnum) w[c] = next++;
+            }
+            for (int c = 0x80; c < 0x100; c++) w[c] = next++;
+        }
+    };
+
+    static const uint8_t* weights() {
+        static const Table table;
+        return table.w;
+    }
+
+public:
+    static uint32_t prefixKey(const char* name) {
+        const uint8_t* w = weights();
+        const uint8_t* p = (const uint8_t*)name;
+        uint32_t key = 0;
+        for (uint8_t i = 0; i < 4; i++) {
+            key <<= 8;
+            if (*p) key |= w[*p++];
+        }
+        return key;
+    }
+
+    static void setKey(FileListItem& it) { it.sort_key = prefixKey(it.name.c_str()); }
+
+    static bool less(const EntryView& a, const EntryView& b) {
+        uint32_t ka = a.sort_key ? a.sort_key : prefixKey(a.name);
+        uint32_t kb = b.sort_key ? b.sort_key : prefixKey(b.name);
+        if (ka != kb) return ka < kb;
+        // Same first four weights: either both names end there or both go on.
+        if ((ka & 0xFF) == 0) return false;
+        const uint8_t* w = weights();
+        const uint8_t* pa = (const uint8_t*)a.name + 4;
+        const uint8_t* pb = (const uint8_t*)b.name + 4;
+        while (*pa && w[*pa] == w[*pb]) {
+            pa++;
+            pb++;
+        }
+        return w[*pa] < w[*pb];
+    }
+};
+
+// EntryArena - one directory listing in two allocations: fixed-size records and a
+// pool of NUL-terminated names they point into. Rows and the cache hold these instead
+// of a String per entry; full vpaths are built on demand from the folder plus name().
+// release() frees the whole listing at once.
+class EntryArena {
+private:
+    struct Record {
+        uint64_t size;
+        uint32_t name_off;
+        uint32_t sort_key;
+        uint32_t mtime;
+        uint16_t name_len;
+        bool is_dir;
+    };
+
+    std::vector<Record> recs;
+    std::vector<char> pool;
+
+    Record appendName(const FileListItem& it) {
+        Record r;
+        r.size = it.size;
+        r.name_off = (uint32_t)pool.size();
+        r.sort_key = it.sort_key;
+        r.mtime = it.mtime;
+        r.name_len = (uint16_t)it.name.length();
+        r.is_dir = it.is_dir;
+        pool.insert(pool.end(), it.name.c_str(), it.name.c_str() + r.name_len + 1);
+        return r;
+    }
+
+public:
+    size_t size() const { return recs.size(); }
+    bool empty() const { return recs.empty(); }
+    size_t poolBytes() const { return pool.size(); }
+
+    const char* name(size_t i) const { return pool.data() + recs[i].name_off; }
+    bool isDir(size_t i) const { return recs[i].is_dir; }
+    uint64_t fileSize(size_t i) const { return recs[i].size; }
+    uint32_t mtime(size_t i) const { return recs[i].mtime; }
+
+    EntryView view(size_t i) const {
+        const Record& r = recs[i];
+        return EntryView(pool.data() + r.name_off, r.sort_key, r.is_dir, r.size, r.mtime);
+    }
+
+    void push(const FileListItem& it) { recs.push_back(appendName(it)); }
+
+    void assign(const std::vector<FileListItem>& items) {
+        clear();
+        size_t bytes = 0;
+        for (size_t i = 0; i < items.size(); i++) bytes += items[i].name.length() + 1;
+        recs.reserve(items.size());
+        pool.reserve(bytes);
+        for (size_t i = 0; i < items.size(); i++) push(items[i]);
+    }
+
+    // Merges a batch sorted by less(EntryView, EntryView) into this sorted listing.
+    // Names are appended to the pool; only the records are interleaved. marks, if
+    // given, run parallel to the records and follow them; new entries are unmarked.
+    template <typename Less>
+    void mergeSorted(const std::vector<FileListItem>& batch, Less less, std::vector<bool>* marks = nullptr) {
+        if (batch.empty()) return;
+        if (recs.empty() || !less(EntryView(batch.front()), view(recs.size() - 1))) {
+            for (size_t j = 0; j < batch.size(); j++) push(batch[j]);
+            if (marks) marks->resize(recs.size(), false);
+            return;
+        }
+        std::vector<Record> merged;
+        std::vector<bool> merged_marks;
+        merged.reserve(recs.size() + batch.size());
+        if (marks) merged_marks.reserve(recs.size() + batch.size());
+        size_t i = 0;
+        size_t j = 0;
+        while (i < recs.size() || j < batch.size()) {
+            if (i == recs.size() || (j < batch.size() && less(EntryView(batch[j]), view(i)))) {
+                merged.push_back(appendName(batch[j++]));
+                if (marks) merged_marks.push_back(false);
+            } else {
+                merged.push_back(recs[i]);
+                if (marks) merged_marks.push_back((*marks)[i]);
+                i++;
+            }
+        }
+        recs.swap(merged);
+        if (marks) marks->swap(merged_marks);
+    }
+
+    void swap(EntryArena& other) {
+        recs.swap(other.recs);
+        pool.swap(other.pool);
+    }
+
+    // Keeps capacity for the next listing of similar size.
+    void clear() {
+        recs.clear();
+        pool.clear();
+    }
+
+    // Returns both blocks to the heap.
+    void release() {
+        std::vector<Record>().swap(recs);
+        std::vector<char>().swap(pool);
+    }
+};
+
+// DirListingCache - bounded LRU of sorted directory listings keyed by vpath ("L:/a/b").
+// Writers call invalidatePath() after any mutation; scans snapshot generation() before
+// reading storage so a listing that raced with a mutation is never stored.
+// Pinned vpaths (the file manager's back-stack) are evicted last, never before an
+// unpinned listing; invalidation still drops them.
+class DirListingCache {
+private:
+    struct Entry {
+        String vpath;
+        EntryArena items;
+        uint32_t last_use;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<String> pinned;
+    size_t total_items;
+    uint32_t use_clock;
+    volatile uint32_t gen;
+    SemaphoreHandle_t lock;
+    static DirListingCache* instance;
+
+    DirListingCache() : total_items(0), use_clock(0), gen(1), lock(xSemaphoreCreateMutex()) {}
+
+    void take() { if (lock) xSemaphoreTake(lock, portMAX_DELAY); }
+    void give() { if (lock) xSemaphoreGive(lock); }
+
+    void eraseAt(size_t i) {
+        total_items -= entries[i].items.size();
+        entries.erase(entries.begin() + i);
+    }
+
+    bool isPinned(const String& vpath) const {
+        for (size_t i = 0; i < pinned.size(); i++) {
+            if (pinned[i] == vpath) return true;
+        }
+        return false;
+    }
+
+    void evictOldest() {
+        size_t oldest = entries.size();
+        for (int pass = 0; pass < 2 && oldest == entries.size(); pass++) {
+            for (size_t i = 0; i < entries.size(); i++) {
+                if (pass == 0 && isPinned(entries[i].vpath)) continue;
+                if (oldest == entries.size() || entries[i].last_use < entries[oldest].last_use) oldest = i;
+            }
+        }
+        eraseAt(oldest);
+    }
+
+    static String parentOf(const String& vpath) {
+        int idx = vpath.lastIndexOf('/');
+        if (idx < 0) return vpath;
+        if (idx <= 2) return vpath.substring(0, 3);  // "X:/"
+        return vpath.substring(0, idx);
+    }
+
+    static bool isSameOrUnder(const String& path, const String& root) {
+        if (path == root) return true;
+        if (root.endsWith("/")) return path.startsWith(root);
+        return path.startsWith(root + "/");
+    }
+
+public:
+    static DirListingCache* getInstance() {
+        if (!instance) instance = new DirListingCache();
+        return instance;
+    }
+
+    uint32_t generation() const { return gen; }
+
+    bool get(const String& vpath, EntryArena& out) {
+        take();
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (entries[i].vpath != vpath) continue;
+            entries[i].last_use = ++use_clock;
+            out = entries[i].items;
+            give();
+            return true;
+        }
+        give();
+        return false;
+    }
+
+    // Presence check that does not count as a use.
+    bool contains(const String& vpath) {
+        take();
+        bool found = false;
+        for (size_t i = 0; i < entries.size() && !found; i++) found = entries[i].vpath == vpath;
+        give();
+        return found;
+    }
+
+    // Stores a sorted listing; dropped if any invalidation happened since scan_gen.
+    void put(const String& vpath, const EntryArena& items, uint32_t scan_gen) {
+        if (items.size() > LISTING_CACHE_MAX_ITEMS) return;
+        take();
+        if (scan_gen != gen) {
+            give();
+            return;
+        }
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (entries[i].vpath == vpath) {
+                eraseAt(i);
+                break;
+            }
+        }
+        while (!entries.empty() &&
+               (entries.size() >= LISTING_CACHE_MAX_DIRS || total_items + items.size() > LISTING_CACHE_MAX_ITEMS)) {
+            evictOldest();
+        }
+        entries.push_back(Entry());
+        Entry& e = entries.back();
+        e.vpath = vpath;
+        e.items = items;
+        e.last_use = ++use_clock;
+        total_items += items.size();
+        give();
+    }
+
+    // Drops the parent listing of vpath plus vpath itself and everything below it.
+    void invalidatePath(const String& vpath) {
+        if (vpath.length() < 2) return;
+        String v = vpath;
+        if (v.length() > 3 && v.endsWith("/")) v.remove(v.length() - 1);
+        String parent = parentOf(v);
+        take();
+        gen++;
+        for (size_t i = entries.size(); i-- > 0;) {
+            if (entries[i].vpath == parent || isSameOrUnder(entries[i].vpath, v)) eraseAt(i);
+        }
+        give();
+    }
+
+    void pin(const String& vpath) {
+        take();
+        pinned.push_back(vpath);
+        give();
+    }
+
+    // Drops one pin of vpath (a path may be pinned more than once).
+    void unpin(const String& vpath) {
+        take();
+        for (size_t i = 0; i < pinned.size(); i++) {
+            if (pinned[i] != vpath) continue;
+            pinned.erase(pinned.begin() + i);
+            break;
+        }
+        give();
+    }
+
+    // Cached directories, entries and name-pool bytes, for heap diagnostics.
+    void stats(size_t& dirs, size_t& items, size_t& name_bytes) {
+        take();
+        dirs = entries.size();
+        items = total_items;
+        name_bytes = 0;
+        for (size_t i = 0; i < entries.size(); i++) name_bytes += entries[i].items.poolBytes();
+        give();
+    }
+
+    void invalidateDrive(char drive) {
+        take();
+        gen++;
+        for (size_t i = entries.size(); i-- > 0;) {
+            if (entries[i].vpath.length() > 0 && entries[i].vpath.charAt(0) == drive) eraseAt(i);
+        }
+        give();
+    }
+
+    void clear() {
+        take();
+        gen++;
+        entries.clear();
+        total_items = 0;
+        give();
+    }
+};
+
+DirListingCache* DirListingCache::instance = nullptr;
+
+#endif
@@ -0,0 +1,362 @@
+#ifndef NOTECODEC_H
+#define NOTECODEC_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "../config.h"
+#include "bufpool.h"
+#include "storage.h"
+
+// NoteCodec - LZSS for notes stored on LittleFS.
+// File layout: "CNZ1", raw length (u32 LE), then groups of one flag byte (LSB first,
+// 1 = literal) and eight items: a literal byte, or a match of two bytes
+// [dist-1 low 8][dist-1 high 4 | len-3] with a 4 KB window and lengths 3..18.
+// Decoding needs only a 4 KB ring, so notes stream straight into the editor or an
+// HTTP response; encoding works from the editor's contiguous text with 16 KB of
+// hash tables leased from ScratchPool.
+// The magic alone is not trusted: a stored note must also have a raw length that fits
+// its size and decode to exactly that length at exactly end of file (probe()), so a
+// plain file that happens to start with "CNZ1" is read as is. Compressed notes never
+// leave L: as such: copies, moves and backups to D: read them through Reader.
+class NoteCodec {
+public:
+    static constexpr size_t HEADER_SIZE = 8;
+
+private:
+    static constexpr size_t WINDOW = 4096;
+    static constexpr size_t MIN_MATCH = 3;
+    static constexpr size_t MAX_MATCH = 18;
+    static constexpr uint8_t HASH_BITS = 11;
+    static constexpr size_t HASH_SIZE = 1u << HASH_BITS;
+    static constexpr uint8_t MAX_CHAIN = 16;
+    static constexpr size_t IN_CHUNK = 1024;
+
+    static uint32_t hash3(const uint8_t* p) {
+        uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+        return (uint32_t)(v * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // Buffered token writer for an open LittleFS file.
+    struct Out {
+        File& f;
+        uint8_t buf[256];
+        size_t n;
+        size_t total;
+        bool ok;
+        uint8_t group[17];
+        size_t group_len;
+        uint8_t items;
+
+        explicit Out(File& file) : f(file), n(0), total(0), ok(true), group_len(1), items(0) { group[0] = 0; }
+
+        void put(const uint8_t* p, size_t len) {
+            if (n + len > sizeof(buf)) flushBuf();
+            memcpy(buf + n, p, len);
+            n += len;
+        }
+        void flushBuf() {
+            if (n == 0) return;
+            if (f.write(buf, n) != n) ok = false;
+            total += n;
+            n = 0;
+        }
+        void endGroup() {
+            if (items == 0) return;
+            put(group, group_len);
+            group[0] = 0;
+            group_len = 1;
+            items = 0;
+        }
+        void literal(uint8_t c) {
+            group[0] |= (uint8_t)(1u << items);
+            group[group_len++] = c;
+            if (++items == 8) endGroup();
+        }
+        void match(size_t dist, size_t len) {
+            size_t d = dist - 1;
+            group[group_len++] = (uint8_t)(d & 0xFF);
+            group[group_len++] = (uint8_t)(((d >> 4) & 0xF0) | (len - MIN_MATCH));
+            if (++items == 8) endGroup();
+        }
+    };
+
+    static bool seekTo(File& f, uint64_t pos) { return f.seek((uint32_t)pos); }
+    static bool seekTo(FsFile& f, uint64_t pos) { return f.seekSet(pos); }
+
+public:
+    static bool isCompressed(const uint8_t* p, size_t n) {
+        return n >= HEADER_SIZE && p[0] == 'C' && p[1] == 'N' && p[2] == 'Z' && p[3] == '1';
+    }
+
+    static uint32_t rawLength(const uint8_t* header) {
+        return (uint32_t)header[4] | ((uint32_t)header[5] << 8) | ((uint32_t)header[6] << 16) |
+               ((uint32_t)header[7] << 24);
+    }
+
+    // Header sizes against the stored size: 8 items cost 9 (literals) to 17 bytes
+    // (matches) after their flag byte and yield 8 to 144 bytes.
+    static bool plausible(const uint8_t* header, uint64_t stored) {
+        if (stored < HEADER_SIZE) return false;
+        uint64_t payload = stored - HEADER_SIZE;
+        uint64_t raw = rawLength(header);
+        return payload <= raw + (raw + 7) / 8 && raw <= payload * 9;
+    }
+
+    // Pull decoder over a stored note positioned after its header: read() works like
+    // File::read() on the plain text and returns -1 on damaged data, including bytes
+    // left over after raw_len. Holds a 5 KB lease between begin() and end().
+    template <typename F>
+    class Reader {
+    private:
+        F* in;
+        ScratchLease lease;
+        uint8_t* ring;
+        uint8_t* inbuf;
+        size_t in_len;
+        size_t in_pos;
+        uint32_t raw_len;
+        size_t produced;
+        uint8_t flags;
+        uint8_t item;  // next item in the current group; 8 = read a flag byte first
+        size_t match_dist;
+        size_t match_left;
+        bool bad;
+        bool tail_checked;
+
+        bool next(uint8_t& b) {
+            if (in_pos == in_len) {
+                int n = (int)in->read(inbuf, IN_CHUNK);
+                if (n <= 0) return false;
+                in_len = (size_t)n;
+                in_pos = 0;
+            }
+            b = inbuf[in_pos++];
+            return true;
+        }
+
+        int fault() {
+            bad = true;
+            return -1;
+        }
+
+    public:
+        Reader()
+            : in(nullptr), ring(nullptr), inbuf(nullptr), in_len(0), in_pos(0), raw_len(0), produced(0), flags(0),
+              item(8), match_dist(0), match_left(0), bad(false), tail_checked(false) {}
+
+        bool begin(F& f, uint32_t len) {
+            lease = ScratchPool::getInstance()->lease(WINDOW + IN_CHUNK, WINDOW + IN_CHUNK);
+            if (!lease) return false;
+            in = &f;
+            ring = lease.data();
+            inbuf = lease.data() + WINDOW;
+            in_len = 0;
+            in_pos = 0;
+            raw_len = len;
+            produced = 0;
+            flags = 0;
+            item = 8;
+            match_dist = 0;
+            match_left = 0;
+            bad = false;
+            tail_checked = false;
+            return true;
+        }
+
+        void end() {
+            lease.release();
+            in = nullptr;
+        }
+
+        bool isActive() const { return in != nullptr; }
+        uint32_t rawLength() const { return raw_len; }
+
+        int read(uint8_t* out, size_t n) {
+            if (!in || bad) return -1;
+            size_t w = 0;
+            while (w < n && produced < raw_len) {
+                if (match_left == 0) {
+                    if (item == 8) {
+                        if (!next(flags)) return fault();
+                        item = 0;
+                    }
+                    uint8_t a = 0;
+                    if (!next(a)) return fault();
+                    if (flags & (1u << item++)) {
+                        ring[produced & (WINDOW - 1)] = a;
+                        out[w++] = a;
+                        produced++;
+                        continue;
+                    }
+                    uint8_t b = 0;
+                    if (!next(b)) return fault();
+                    match_dist = ((size_t)a | ((size_t)(b & 0xF0) << 4)) + 1;
+                    match_left = (b & 0x0F) + MIN_MATCH;
+                    if (match_dist > produced) return fault();
+                }
+                uint8_t c = ring[(produced - match_dist) & (WINDOW - 1)];
+                ring[produced & (WINDOW - 1)] = c;
+                out[w++] = c;
+                produced++;
+                match_left--;
+            }
+            if (produced == raw_len && !tail_checked) {
+                tail_checked = true;
+                uint8_t extra = 0;
+                if (in_pos != in_len || in->read(&extra, 1) > 0) return fault();
+            }
+            return (int)w;
+        }
+    };
+
+    // Writes data compressed to an LittleFS path; returns the stored size, 0 on failure.
+    static size_t writeFile(const char* path, const char* data, size_t len) {
+        ScratchLease lease = ScratchPool::getInstance()->lease(16384, 16384);
+        if (!lease) return 0;
+        uint32_t* head = (uint32_t*)lease.data();                     // HASH_SIZE x u32: pos+1
+        uint16_t* prev = (uint16_t*)(lease.data() + HASH_SIZE * 4);   // WINDOW x u16: distance to older
+        memset(head, 0, HASH_SIZE * 4);
+        memset(prev, 0, WINDOW * 2);
+
+        File f = LittleFS.open(path, "w");
+        if (!f) return 0;
+        uint8_t header[HEADER_SIZE] = {'C', 'N', 'Z', '1', (uint8_t)len, (uint8_t)(len >> 8), (uint8_t)(len >> 16),
+                                       (uint8_t)(len >> 24)};
+        Out out(f);
+        out.put(header, sizeof(header));
+
+        const uint8_t* src = (const uint8_t*)data;
+        size_t pos = 0;
+        uint32_t iter = 0;
+        auto insert = [&](size_t p) {
+            if (p + MIN_MATCH > len) return;
+            uint32_t h = hash3(src + p);
+            uint32_t older = head[h];
+            size_t dist = older ? p - (older - 1) : 0;
+            prev[p & (WINDOW - 1)] = (dist > 0 && dist < WINDOW) ? (uint16_t)dist : 0;
+            head[h] = (uint32_t)p + 1;
+        };
+        while (pos < len) {
+            size_t best_len = 0;
+            size_t best_dist = 0;
+            if (pos + MIN_MATCH <= len) {
+                uint32_t cand = head[hash3(src + pos)];
+                size_t max_len = (len - pos < MAX_MATCH) ? len - pos : MAX_MATCH;
+                for (uint8_t chain = 0; cand && chain < MAX_CHAIN; chain++) {
+                    size_t c = cand - 1;
+                    size_t dist = pos - c;
+                    if (dist == 0 || dist > WINDOW) break;
+                    size_t l = 0;
+                    while (l < max_len && src[c + l] == src[pos + l]) l++;
+                    if (l > best_len) {
+                        best_len = l;
+                        best_dist = dist;
+                        if (l == max_len) break;
+                    }
+                    uint16_t step = prev[c & (WINDOW - 1)];
+                    if (step == 0 || step > c) break;
+                    cand = (uint32_t)(c - step) + 1;
+                }
+            }
+            if (best_len >= MIN_MATCH) {
+                out.match(best_dist, best_len);
+                for (size_t i = 0; i < best_len; i++) insert(pos + i);
+                pos += best_len;
+            } else {
+                out.literal(src[pos]);
+                insert(pos);
+                pos++;
+            }
+            if ((++iter & 0x3FF) == 0) delay(0);
+        }
+        out.endGroup();
+        out.flushBuf();
+        f.close();
+        return out.ok ? out.total : 0;
+    }
+
+    // Streams the stored note to sink(const uint8_t*, size_t) -> bool in chunks of up
+    // to 2 KB. `in` is positioned after the header; raw_len comes from it.
+    template <typename F, typename Sink>
+    static bool decode(F& in, uint32_t raw_len, Sink sink) {
+        Reader<F> reader;
+        if (!reader.begin(in, raw_len)) return false;
+        ScratchLease chunk = ScratchPool::getInstance()->lease(2048, 256);
+        if (!chunk) return false;
+        uint32_t iter = 0;
+        while (true) {
+            int n = reader.read(chunk.data(), chunk.size());
+            if (n < 0) return false;
+            if (n == 0) return true;
+            if (!sink(chunk.data(), (size_t)n)) return false;
+            if ((++iter & 0x0F) == 0) delay(0);
+        }
+    }
+
+    // Sets compressed if f (size bytes) holds a note written by writeFile(), checked
+    // with a dry decode; f is then left after the header, otherwise at 0. False on a
+    // seek or memory failure.
+    template <typename F>
+    static bool probe(F& f, uint64_t size, bool& compressed, uint32_t& raw_len) {
+        uint8_t header[HEADER_SIZE];
+        compressed = false;
+        raw_len = 0;
+        if (!seekTo(f, 0)) return false;
+        if (size < HEADER_SIZE) return true;
+        if (f.read(header, HEADER_SIZE) != (int)HEADER_SIZE || !isCompressed(header, HEADER_SIZE) ||
+            !plausible(header, size)) {
+            return seekTo(f, 0);
+        }
+        Reader<F> reader;
+        if (!reader.begin(f, rawLength(header))) return false;
+        uint8_t sink[64];
+        int n = 0;
+        uint32_t iter = 0;
+        while ((n = reader.read(sink, sizeof(sink))) > 0) {
+            if ((++iter & 0xFF) == 0) delay(0);
+        }
+        reader.end();
+        compressed = (n == 0);
+        if (compressed) raw_len = rawLength(header);
+        return seekTo(f, compressed ? HEADER_SIZE : 0);
+    }
+
+    // Reads a whole file (compressed or not) into out. size is the stored file size.
+    // A "CNZ1" file that does not decode cleanly is read as plain text.
+    template <typename F>
+    static bool readAll(F& f, size_t size, String& out) {
+        out = "";
+        uint8_t header[HEADER_SIZE];
+        size_t got = 0;
+        if (size >= HEADER_SIZE) {
+            int n = f.read(header, HEADER_SIZE);
+            got = n > 0 ? (size_t)n : 0;
+        }
+        if (isCompressed(header, got) && plausible(header, size)) {
+            uint32_t raw_len = rawLength(header);
+            Reader<F> reader;
+            ScratchLease chunk = ScratchPool::getInstance()->lease(2048, 256);
+            if (!chunk || !reader.begin(f, raw_len) || !out.reserve(raw_len + 1)) return false;
+            int n = 0;
+            while ((n = reader.read(chunk.data(), chunk.size())) > 0) {
+                if (!out.concat((const char*)chunk.data(), (unsigned int)n)) return false;
+            }
+            if (n == 0) return true;
+            reader.end();
+            out = "";
+            if (!seekTo(f, HEADER_SIZE)) return false;
+        }
+        if (size > 0 && !out.reserve(size + 1)) return false;
+        if (got > 0 && !out.concat((const char*)header, (unsigned int)got)) return false;
+        ScratchLease lease = ScratchPool::getInstance()->lease(8192);
+        if (!lease) return false;
+        while (true) {
+            int n = f.read(lease.data(), lease.size());
+            if (n <= 0) break;
+            if (!out.concat((const char*)lease.data(), (unsigned int)n)) return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef SDCACHE_H
+#define SDCACHE_H
+
+#include <Arduino.h>
+#ifndef DISABLE_FS_H_WARNING
+#define DISABLE_FS_H_WARNING
+#endif
+#include <SdFat.h>
+#include "../config.h"
+
+#if SD_SECTOR_CACHE_SECTORS > 0
+
+#if !defined(USE_BLOCK_DEVICE_INTERFACE) || !USE_BLOCK_DEVICE_INTERFACE
+#error "SD_SECTOR_CACHE_SECTORS needs SdFat built with -DUSE_BLOCK_DEVICE_INTERFACE=1"
+#endif
+
+// SdSectorCache - N-sector LRU between SdFat's volume layer and the card.
+// SdFat itself keeps one FAT and one data/dir sector; metadata-heavy walks (path
+// lookups, recursive delete, exists() probing) thrash it. Single-sector I/O (FAT and
+// directory sectors, partial file sectors) is cached write-back; multi-sector file
+// I/O goes straight to the card with cached copies kept coherent.
+// Dirty sectors reach the card on eviction and on syncDevice(), which SdFat calls on
+// every file sync/close/remove. Inside beginBatch()/endBatch() those syncs are
+// deferred so a whole recursive operation flushes once.
+class SdSectorCache : public FsBlockDevice {
+private:
+    static constexpr uint16_t SECTOR_SIZE = 512;
+
+    struct Slot {
+        uint32_t sector;
+        uint32_t last_use;
+        bool valid;
+        bool dirty;
+    };
+
+    FsBlockDevice* dev;
+    Slot slots[SD_SECTOR_CACHE_SECTORS];
+    uint8_t* data;
+    uint32_t use_clock;
+    uint16_t batch_depth;
+    uint32_t hits;
+    uint32_t misses;
+
+    uint8_t* slotData(uint16_t i) { return data + (size_t)i * SECTOR_SIZE; }
+
+    int find(uint32_t sector) const {
+        for (uint16_t i = 0; i < SD_SECTOR_CACHE_SECTORS; i++) {
+            if (slots[i].valid && slots[i].sector == sector) return i;
+        }
+        return -1;
+    }
+
+    bool writeBack(uint16_t i) {
+        if (!slots[i].valid || !slots[i].dirty) return true;
+        if (!dev->writeSector(slots[i].sector, slotData(i))) return false;
+        slots[i].dirty = false;
+        return true;
+    }
+
+    int victim() {
+        uint16_t best = 0;
+        for (uint16_t i = 0; i < SD_SECTOR_CACHE_SECTORS; i++) {
+            if (!slots[i].valid) return i;
+            if (slots[i].last_use < slots[best].last_use) best = i;
+        }
+        if (!writeBack(best)) return -1;
+        slots[best].valid = false;
+        return best;
+    }
+
+public:
+    SdSectorCache() : dev(nullptr), data(nullptr), use_clock(0), batch_depth(0), hits(0), misses(0) {
+        memset(slots, 0, sizeof(slots));
+    }
+
+    bool attach(FsBlockDevice* device) {
+        if (!data) data = (uint8_t*)malloc((size_t)SD_SECTOR_CACHE_SECTORS * SECTOR_SIZE);
+        if (!data || !device) return false;
+        dev = device;
+        memset(slots, 0, sizeof(slots));
+        batch_depth = 0;
+        hits = 0;
+        misses = 0;
+        return true;
+    }
+
+    // Drops all cached sectors; flushes first unless the card is already gone.
+    void detach(bool flush_first) {
+        if (dev && flush_first) flush();
+        memset(slots, 0, sizeof(slots));
+        batch_depth = 0;
+        dev = nullptr;
+    }
+
+    bool isAttached() const { return dev != nullptr; }
+
+    bool flush() {
+        if (!dev) return false;
+        bool ok = true;
+        for (uint16_t i = 0; i < SD_SECTOR_CACHE_SECTORS; i++) {
+            if (!writeBack(i)) ok = false;
+        }
+        return ok;
+    }
+
+    void beginBatch() { batch_depth++; }
+
+    bool endBatch() {
+        if (batch_depth == 0) return true;
+        if (--batch_depth > 0) return true;
+        return syncDevice();
+    }
+
+    uint32_t hitCount() const { return hits; }
+    uint32_t missCount() const { return misses; }
+
+    void end() override {}
+
+    bool isBusy() override { return dev && dev->isBusy(); }
+
+    uint32_t sectorCount() override { return dev ? dev->sectorCount() : 0; }
+
+    bool readSector(uint32_t sector, uint8_t* dst) override {
+        if (!dev) return false;
+        int i = find(sector);
+        if (i >= 0) {
+            hits++;
+        } else {
+            misses++;
+            i = victim();
+            if (i < 0) return false;
+            if (!dev->readSector(sector, slotData(i))) return false;
+            slots[i].sector = sector;
+            slots[i].valid = true;
+            slots[i].dirty = false;
+        }
+        slots[i].last_use = ++use_clock;
+        memcpy(dst, slotData(i), SECTOR_SIZE);
+        return true;
+    }
+
+    bool readSectors(uint32_t sector, uint8_t* dst, size_t ns) override {
+        if (!dev || !dev->readSectors(sector, dst, ns)) return false;
+        // Cached copies may be newer than the card (dirty); overlay them.
+        for (uint16_t i = 0; i < SD_SECTOR_CACHE_SECTORS; i++) {
+            if (!slots[i].valid || !slots[i].dirty) continue;
+            if (slots[i].sector < sector || slots[i].sector >= sector + ns) continue;
+            memcpy(dst + (size_t)(slots[i].sector - sector) * SECTOR_SIZE, slotData(i), SECTOR_SIZE);
+        }
+        return true;
+    }
+
+    bool writeSector(uint32_t sector, const uint8_t* src) override {
+        if (!dev) return false;
+        int i = find(sector);
+        if (i < 0) {
+            i = victim();
+            if (i < 0) return false;
+            slots[i].sector = sector;
+            slots[i].valid = true;
+        }
+        memcpy(slotData(i), src, SECTOR_SIZE);
+        slots[i].dirty = true;
+        slots[i].last_use = ++use_clock;
+        return true;
+    }
+
+    bool writeSectors(uint32_t sector, const uint8_t* src, size_t ns) override {
+        if (!dev || !dev->writeSectors(sector, src, ns)) return false;
+        for (uint16_t i = 0; i < SD_SECTOR_CACHE_SECTORS; i++) {
+            if (!slots[i].valid) continue;
+            if (slots[i].sector < sector || slots[i].sector >= sector + ns) continue;
+            memcpy(slotData(i), src + (size_t)(slots[i].sector - sector) * SECTOR_SIZE, SECTOR_SIZE);
+            slots[i].dirty = false;
+        }
+        return true;
+    }
+
+    bool syncDevice() override {
+        if (!dev) return false;
+        if (batch_depth > 0) return true;
+        if (!flush()) return false;
+        return dev->syncDevice();
+    }
+};
+
+#endif
+
+#endif
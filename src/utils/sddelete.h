@@ -0,0 +1,143 @@
+#ifndef SDDELETE_H
+#define SDDELETE_H
+
+#include <Arduino.h>
+#ifndef DISABLE_FS_H_WARNING
+#define DISABLE_FS_H_WARNING
+#endif
+#include <SdFat.h>
+#include "sdspace.h"
+
+// SdTreeDeleter - post-order delete of an SD tree without building child paths.
+// Walks a bounded stack of open directory handles; each child is opened with
+// openNext() from its parent and removed through its own handle, and an exhausted
+// directory is rmdir()'d through its handle. Every entry is visited once and no
+// path is resolved below the root. step() does a bounded amount of work so callers
+// can spread a large delete across loop ticks.
+class SdTreeDeleter {
+public:
+    enum Status {
+        DEL_IDLE,
+        DEL_RUNNING,
+        DEL_DONE
+    };
+
+private:
+    static constexpr uint8_t MAX_DEPTH = 24;
+    static constexpr uint32_t MAX_OPS = 60000;  // safety guard for malformed trees
+
+    FsFile dirs[MAX_DEPTH];
+    uint8_t depth;
+    uint32_t ops;
+    uint32_t removed;
+    bool ok;
+    Status status;
+
+    void finish() {
+        while (depth > 0) dirs[--depth].close();
+        status = DEL_DONE;
+    }
+
+    bool countOp() {
+        if (++ops <= MAX_OPS) return true;
+        ok = false;
+        SdSpaceTracker::getInstance()->requestResync();
+        finish();
+        return false;
+    }
+
+    void removeFile(FsFile& entry) {
+        uint64_t size = entry.fileSize();
+        if (entry.remove()) {
+            SdSpaceTracker::getInstance()->noteFreed(size);
+            removed++;
+        } else {
+            entry.close();
+            ok = false;
+        }
+    }
+
+    void popDir() {
+        FsFile& dir = dirs[depth - 1];
+        if (dir.rmdir()) {
+            SdSpaceTracker::getInstance()->noteDirRemoved();
+            removed++;
+        } else {
+            dir.close();
+            ok = false;
+        }
+        depth--;
+    }
+
+public:
+    SdTreeDeleter() : depth(0), ops(0), removed(0), ok(true), status(DEL_IDLE) {}
+
+    bool begin(SdFs& fs, const String& path) {
+        finish();
+        depth = 0;
+        ops = 0;
+        removed = 0;
+        ok = true;
+        status = DEL_DONE;
+        // Directories and read-only files refuse a writable open.
+        FsFile node = fs.open(path.c_str(), O_RDWR);
+        if (!node) node = fs.open(path.c_str(), O_RDONLY);
+        if (!node) {
+            ok = false;
+            return false;
+        }
+        if (!node.isDir()) {
+            removeFile(node);
+            return ok;
+        }
+        dirs[depth++] = node;
+        status = DEL_RUNNING;
+        return true;
+    }
+
+    // Removes up to budget entries; returns the status afterwards.
+    Status step(uint16_t budget) {
+        while (status == DEL_RUNNING && budget-- > 0) {
+            FsFile& dir = dirs[depth - 1];
+            uint64_t pos = dir.curPosition();
+            FsFile entry;
+            if (!entry.openNext(&dir, O_RDWR)) {
+                dir.seekSet(pos);
+                if (!entry.openNext(&dir, O_RDONLY)) {
+                    popDir();
+                    if (!countOp()) break;
+                    if (depth == 0) status = DEL_DONE;
+                    continue;
+                }
+            }
+            if (entry.isDir()) {
+                if (depth >= MAX_DEPTH) {
+                    entry.close();
+                    ok = false;
+                    continue;
+                }
+                dirs[depth++] = entry;
+                continue;
+            }
+            removeFile(entry);
+            if (!countOp()) break;
+        }
+        return status;
+    }
+
+    bool runToEnd() {
+        uint32_t iter = 0;
+        while (step(16) == DEL_RUNNING) {
+            if ((++iter & 0x0F) == 0) delay(0);
+        }
+        return ok;
+    }
+
+    void cancel() { finish(); }
+
+    bool isRunning() const { return status == DEL_RUNNING; }
+    bool succeeded() const { return ok; }
+    uint32_t removedCount() const { return removed; }
+};
+
+#endif
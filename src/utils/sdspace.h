@@ -0,0 +1,289 @@
+#ifndef SDSPACE_H
+#define SDSPACE_H
+
+#include <Arduino.h>
+#ifndef DISABLE_FS_H_WARNING
+#define DISABLE_FS_H_WARNING
+#endif
+#include <SdFat.h>
+#include "../config.h"
+
+// SdSpaceTracker - keeps the SD free-cluster count without blocking the UI.
+// After mount the FAT (or exFAT allocation bitmap) is counted a few sectors per
+// step() from the loop task; afterwards our own writes/deletes adjust the count
+// and a periodic resync picks up external changes. A scan that cannot start or
+// hits a read error is retried after RETRY_MS; the count is never taken in one go.
+class SdSpaceTracker {
+private:
+    static constexpr uint8_t STEP_SECTORS = 4;
+    static constexpr uint16_t SECTOR_SIZE = 512;
+    static constexpr uint32_t RETRY_MS = 5000;
+
+    enum ScanState {
+        SCAN_IDLE,
+        SCAN_PENDING,
+        SCAN_RUNNING
+    };
+
+    SdFs* fs;
+    FsBlockDevice* dev;
+    ScanState state;
+    bool valid;
+    bool exact;         // free_clusters is a fresh count, not adjusted since
+    bool tainted;
+    uint8_t fat_type;
+    uint32_t cluster_count;
+    uint32_t bytes_per_cluster;
+    int64_t free_clusters;
+    uint32_t scan_sector;
+    uint32_t scan_end_sector;
+    uint32_t scan_index;
+    uint32_t scan_count;
+    uint8_t fat12_tail[2];  // FAT12 packs two entries in 3 bytes, across sector edges
+    uint8_t fat12_tail_len;
+    uint32_t last_sync_ms;
+    uint32_t rev;
+    uint32_t sync_gen;  // completed counts
+    uint8_t buf[STEP_SECTORS * SECTOR_SIZE];
+    static SdSpaceTracker* instance;
+
+    SdSpaceTracker()
+        : fs(nullptr), dev(nullptr), state(SCAN_IDLE), valid(false), exact(false), tainted(false), fat_type(0), cluster_count(0),
+          bytes_per_cluster(0), free_clusters(0), scan_sector(0), scan_end_sector(0), scan_index(0),
+          scan_count(0), fat12_tail_len(0), last_sync_ms(0), rev(0), sync_gen(0) {}
+
+    static uint16_t le16(const uint8_t* p) { return (uint16_t)p[0] | ((uint16_t)p[1] << 8); }
+    static uint32_t le32(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    int64_t clustersFor(uint64_t bytes) const {
+        if (bytes_per_cluster == 0 || bytes == 0) return 0;
+        return (int64_t)((bytes + bytes_per_cluster - 1) / bytes_per_cluster);
+    }
+
+    void adjust(int64_t delta_clusters) {
+        if (state == SCAN_RUNNING) tainted = true;
+        if (delta_clusters != 0) exact = false;
+        if (!valid || delta_clusters == 0) return;
+        free_clusters -= delta_clusters;
+        if (free_clusters < 0) free_clusters = 0;
+        if (free_clusters > (int64_t)cluster_count) free_clusters = cluster_count;
+        rev++;
+    }
+
+    // Locates the exFAT allocation bitmap from the boot region and root directory.
+    bool locateExFatBitmap(FsBlockDevice* card, uint32_t& first_sector, uint32_t& sectors) {
+        FsVolume* vol = fs->vol();
+        if (!card->readSector(0, buf)) return false;
+        uint32_t vbr = 0;
+        if (memcmp(buf + 3, "EXFAT   ", 8) != 0) {
+            if (buf[510] != 0x55 || buf[511] != 0xAA) return false;
+            vbr = le32(buf + 446 + 8);
+            if (!card->readSector(vbr, buf)) return false;
+            if (memcmp(buf + 3, "EXFAT   ", 8) != 0) return false;
+        }
+        if (buf[108] != 9) return false;  // only 512-byte sectors
+        uint32_t fat_offset = le32(buf + 80);
+        uint32_t heap_offset = le32(buf + 88);
+        uint32_t root_cluster = le32(buf + 96);
+        uint32_t spc = 1UL << buf[109];
+        if (vbr + fat_offset != vol->fatStartSector() || vbr + heap_offset != vol->dataStartSector()) return false;
+        if (le32(buf + 92) != cluster_count || root_cluster < 2) return false;
+
+        uint32_t root_sector = vol->dataStartSector() + (root_cluster - 2) * spc;
+        for (uint32_t s = 0; s < spc; s++) {
+            if (!card->readSector(root_sector + s, buf)) return false;
+            for (uint16_t off = 0; off < SECTOR_SIZE; off += 32) {
+                uint8_t type = buf[off];
+                if (type == 0x00) return false;
+                if (type != 0x81) continue;
+                uint32_t bitmap_cluster = le32(buf + off + 20);
+                uint32_t bitmap_bytes = le32(buf + off + 24);
+                if (bitmap_cluster < 2 || bitmap_bytes < (cluster_count + 7) / 8) return false;
+                first_sector = vol->dataStartSector() + (bitmap_cluster - 2) * spc;
+                sectors = (bitmap_bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool startScan() {
+        if (!fs || !fs->vol() || !dev) return false;
+        FsVolume* vol = fs->vol();
+        fat_type = vol->fatType();
+        cluster_count = vol->clusterCount();
+        bytes_per_cluster = vol->bytesPerCluster();
+        if (cluster_count == 0 || bytes_per_cluster == 0) return false;
+
+        scan_index = 0;
+        scan_count = 0;
+        fat12_tail_len = 0;
+        tainted = false;
+        if (fat_type == FAT_TYPE_FAT32 || fat_type == FAT_TYPE_FAT16 || fat_type == FAT_TYPE_FAT12) {
+            uint64_t entries = (uint64_t)cluster_count + 2;
+            uint64_t fat_bytes = entries * ((fat_type == FAT_TYPE_FAT32) ? 4 : 2);
+            if (fat_type == FAT_TYPE_FAT12) fat_bytes = (entries * 3 + 1) / 2;
+            scan_sector = vol->fatStartSector();
+            scan_end_sector = scan_sector + (uint32_t)((fat_bytes + SECTOR_SIZE - 1) / SECTOR_SIZE);
+        } else if (fat_type == FAT_TYPE_EXFAT) {
+            uint32_t first = 0;
+            uint32_t sectors = 0;
+            if (!locateExFatBitmap(dev, first, sectors)) return false;
+            scan_sector = first;
+            scan_end_sector = first + sectors;
+        } else {
+            return false;
+        }
+        state = SCAN_RUNNING;
+        return true;
+    }
+
+    // Unrecognised layout or a read error: keep the last count, try again later.
+    void scanFailed() {
+        state = SCAN_IDLE;
+        last_sync_ms = millis();
+    }
+
+    void countFat12Entry(uint16_t entry) {
+        if (scan_index < cluster_count + 2 && scan_index >= 2 && entry == 0) scan_count++;
+        scan_index++;
+    }
+
+    void countSectors(uint8_t n) {
+        const uint32_t limit = cluster_count + 2;
+        if (fat_type == FAT_TYPE_EXFAT) {
+            // Bitmap bit i covers cluster i + 2; count set bits as used.
+            for (uint16_t i = 0; i < (uint16_t)(n * SECTOR_SIZE); i++) {
+                if (scan_index >= cluster_count) return;
+                uint8_t b = buf[i];
+                uint32_t left = cluster_count - scan_index;
+                if (left < 8) b &= (uint8_t)((1U << left) - 1U);
+                scan_count += (uint32_t)__builtin_popcount(b);
+                scan_index += 8;
+            }
+            return;
+        }
+        if (fat_type == FAT_TYPE_FAT32) {
+            for (uint16_t i = 0; i < (uint16_t)(n * SECTOR_SIZE); i += 4, scan_index++) {
+                if (scan_index >= limit) return;
+                if (scan_index >= 2 && (le32(buf + i) & 0x0FFFFFFFUL) == 0) scan_count++;
+            }
+            return;
+        }
+        if (fat_type == FAT_TYPE_FAT12) {
+            for (uint16_t i = 0; i < (uint16_t)(n * SECTOR_SIZE); i++) {
+                if (fat12_tail_len < 2) {
+                    fat12_tail[fat12_tail_len++] = buf[i];
+                    continue;
+                }
+                countFat12Entry((uint16_t)fat12_tail[0] | ((uint16_t)(fat12_tail[1] & 0x0F) << 8));
+                countFat12Entry((uint16_t)(fat12_tail[1] >> 4) | ((uint16_t)buf[i] << 4));
+                fat12_tail_len = 0;
+            }
+            return;
+        }
+        for (uint16_t i = 0; i < (uint16_t)(n * SECTOR_SIZE); i += 2, scan_index++) {
+            if (scan_index >= limit) return;
+            if (scan_index >= 2 && le16(buf + i) == 0) scan_count++;
+        }
+    }
+
+    void finishScan() {
+        state = SCAN_IDLE;
+        if (tainted) {
+            // Our own writes landed mid-scan; the partial count is unreliable.
+            state = SCAN_PENDING;
+            return;
+        }
+        free_clusters = (fat_type == FAT_TYPE_EXFAT) ? (int64_t)cluster_count - scan_count : (int64_t)scan_count;
+        valid = true;
+        exact = true;
+        sync_gen++;
+        last_sync_ms = millis();
+        rev++;
+    }
+
+public:
+    static SdSpaceTracker* getInstance() {
+        if (!instance) instance = new SdSpaceTracker();
+        return instance;
+    }
+
+    // Call after mount (fs != nullptr) or unmount (fs == nullptr). Reads go through
+    // block_dev so sectors still dirty in a write-back cache are seen.
+    void reset(SdFs* mounted_fs, FsBlockDevice* block_dev = nullptr) {
+        fs = mounted_fs;
+        dev = block_dev ? block_dev : (fs ? fs->card() : nullptr);
+        valid = false;
+        exact = false;
+        tainted = false;
+        free_clusters = 0;
+        cluster_count = 0;
+        bytes_per_cluster = 0;
+        state = fs ? SCAN_PENDING : SCAN_IDLE;
+        rev++;
+        if (fs && fs->vol()) {
+            cluster_count = fs->vol()->clusterCount();
+            bytes_per_cluster = fs->vol()->bytesPerCluster();
+        }
+    }
+
+    void requestResync() {
+        if (fs && state == SCAN_IDLE) state = SCAN_PENDING;
+    }
+
+    void noteFileResized(uint64_t old_bytes, uint64_t new_bytes) {
+        adjust(clustersFor(new_bytes) - clustersFor(old_bytes));
+    }
+
+    void noteAllocated(uint64_t bytes) { adjust(clustersFor(bytes)); }
+    void noteFreed(uint64_t bytes) { adjust(-clustersFor(bytes)); }
+    void noteDirCreated() { adjust(1); }
+    void noteDirRemoved() { adjust(-1); }
+
+    // Loop task only, and only while no SD file is held open for writing.
+    void step() {
+        if (!fs) return;
+        if (state == SCAN_IDLE) {
+            if ((millis() - last_sync_ms) < (valid ? SD_SPACE_RESYNC_MS : RETRY_MS)) return;
+            state = SCAN_PENDING;
+        }
+        if (state == SCAN_PENDING) {
+            if (!startScan()) scanFailed();
+            return;
+        }
+        uint32_t left = scan_end_sector - scan_sector;
+        uint8_t n = (left < STEP_SECTORS) ? (uint8_t)left : STEP_SECTORS;
+        if (n == 0 || !dev->readSectors(scan_sector, buf, n)) {
+            if (n == 0) finishScan();
+            else scanFailed();
+            return;
+        }
+        countSectors(n);
+        scan_sector += n;
+        if (scan_sector >= scan_end_sector) finishScan();
+    }
+
+    bool isValid() const { return valid; }
+    // The count was just taken from the card and nothing was written since; bumps
+    // syncGeneration(). Lets FileIndex tell whether a PC changed the card.
+    bool isExact() const { return valid && exact; }
+    uint32_t syncGeneration() const { return sync_gen; }
+    uint32_t freeClusters() const { return valid ? (uint32_t)free_clusters : 0; }
+    uint32_t volumeSerial() const { return (fs && fs->vol()) ? fs->vol()->volumeSerialNumber() : 0; }
+    // Bumped whenever the reported usage changes; lets the UI redraw only on change.
+    uint32_t revision() const { return rev; }
+    uint64_t totalBytes() const { return (uint64_t)bytes_per_cluster * cluster_count; }
+    uint64_t freeBytes() const { return valid ? (uint64_t)bytes_per_cluster * (uint64_t)free_clusters : 0; }
+    uint64_t usedBytes() const {
+        uint64_t total = totalBytes();
+        uint64_t free_bytes = freeBytes();
+        return (total > free_bytes) ? (total - free_bytes) : 0;
+    }
+};
+
+SdSpaceTracker* SdSpaceTracker::instance = nullptr;
+
+#endif
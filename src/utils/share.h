@@ -8,16 +8,21 @@
 #include <DNSServer.h>
 #include <esp_heap_caps.h>
 #include "storage.h"
+#include "listing.h"
+#include "lfsdir.h"
+#include "trash.h"
+#include "bufpool.h"
+#include "notecodec.h"
+#include "fileindex.h"
 
 class ApShareService {
 private:
     static constexpr size_t SHARE_LIST_MAX_ENTRIES = 1200;
     static constexpr uint32_t TOGGLE_DEBOUNCE_MS = 700;
     static constexpr uint32_t WIFI_OFF_DELAY_MS = 2500;
-    static constexpr size_t UPLOAD_WRITE_SLICE = 256;
-    static constexpr size_t UPLOAD_WRITE_SLICE_LOW_MEM = 128;
+    static constexpr size_t UPLOAD_BUFFER = 8192;     // upload writes are coalesced to this size
+    static constexpr size_t DOWNLOAD_CHUNK = 16384;
     static constexpr size_t UPLOAD_YIELD_EVERY_BYTES = 1024;
-    static constexpr size_t UPLOAD_MIN_FREE_HEAP = 24UL * 1024UL;
     static constexpr size_t UPLOAD_SYNC_EVERY_BYTES = 8192;
 
     StorageHelper* sd_helper;
@@ -37,6 +42,9 @@ private:
     bool upload_failed;
     size_t upload_bytes;
     size_t upload_sync_bytes;
+    uint64_t upload_sd_old_size;
+    ScratchLease upload_lease;
+    size_t upload_fill;
     String upload_vpath;
     String upload_error;
     bool upload_active;
@@ -51,12 +59,14 @@ public:
         : sd_helper(nullptr), server(nullptr), dns(nullptr), running(false), switching(false),
           last_toggle_ms(0), wifi_off_pending(false), wifi_off_due_ms(0), ssid("CYDnote-Share"),
           upload_drive('L'), upload_ok(false), upload_failed(false), upload_bytes(0),
-                    upload_sync_bytes(0),
+                    upload_sync_bytes(0), upload_sd_old_size(0), upload_fill(0),
                     upload_vpath(""), upload_error(""), upload_active(false), upload_batch_active(false),
                     upload_batch_total(0), upload_batch_ok(0), upload_batch_fail(0), upload_batch_error("") {}
 
     void init(StorageHelper* helper) { sd_helper = helper; }
 
+    bool isUploading() const { return upload_active; }
+
     void update() {
         if (!running && wifi_off_pending) {
             uint32_t now = millis();
@@ -249,17 +259,74 @@ private:
         return true;
     }
 
+    // Sends a compressed note as plain text; false (nothing sent) if f is not one.
+    template <typename F>
+    bool sendDecodedNote(F& f, size_t size) {
+        bool compressed = false;
+        uint32_t raw_len = 0;
+        if (!NoteCodec::probe(f, size, compressed, raw_len) || !compressed) return false;
+        server->setContentLength(raw_len);
+        server->send(200, "application/octet-stream", "");
+        NoteCodec::decode(f, raw_len, [this](const uint8_t* p, size_t n) -> bool {
+            server->sendContent((const char*)p, n);
+            return server->client().connected();
+        });
+        return true;
+    }
+
     void closeUploadHandles() {
         if (upload_lfs) upload_lfs.close();
         if (upload_sd.isOpen()) upload_sd.close();
+        upload_lease.release();
+        upload_fill = 0;
+    }
+
+    bool writeUploadBytes(const uint8_t* p, size_t n) {
+        size_t w = 0;
+        if (upload_drive == 'L' && upload_lfs) w = upload_lfs.write(p, n);
+        else if (upload_drive == 'D' && upload_sd.isOpen()) w = upload_sd.write(p, n);
+        if (w != n) return false;
+        upload_bytes += n;
+        upload_sync_bytes += n;
+        if (upload_bytes >= UPLOAD_YIELD_EVERY_BYTES) {
+            upload_bytes = 0;
+            delay(0);
+        }
+        if (upload_drive == 'D' && upload_sd.isOpen() && upload_sync_bytes >= UPLOAD_SYNC_EVERY_BYTES) {
+            upload_sd.sync();
+            upload_sync_bytes = 0;
+            delay(0);
+        }
+        return true;
+    }
+
+    bool flushUploadBuffer() {
+        if (upload_fill == 0) return true;
+        bool ok = writeUploadBytes(upload_lease.data(), upload_fill);
+        upload_fill = 0;
+        return ok;
+    }
+
+    void failUploadWrite() {
+        upload_ok = false; upload_failed = true; upload_error = "write failed";
+        closeUploadHandles(); if (upload_vpath.length()) removeVPath(upload_vpath);
+        upload_batch_fail++;
+        if (!upload_batch_error.length()) upload_batch_error = upload_error;
     }
 
     bool removeVPath(const String& vpath) {
         char d = driveFromVPath(vpath);
         String p = innerFromVPath(vpath);
-        if (d == 'L') return LittleFS.remove(p.c_str());
-        if (d == 'D' && sd_helper && sd_helper->isInitialized()) return sd_helper->getFs().remove(p.c_str());
-        return false;
+        FileIndex::getInstance()->noteRemoved(d, p);
+        bool ok = false;
+        if (d == 'L') ok = LittleFS.remove(p.c_str());
+        else if (d == 'D' && sd_helper && sd_helper->isInitialized()) {
+            // Partially written upload: exact cluster delta unknown, recount later.
+            SdSpaceTracker::getInstance()->requestResync();
+            ok = sd_helper->getFs().remove(p.c_str());
+        }
+        DirListingCache::getInstance()->invalidatePath(vpath);
+        return ok;
     }
 
     String buildPage(const String& msg = "") const {
@@ -329,12 +396,11 @@ private:
             String out;
             size_t count = 0;
             if (d == 'L') {
-                File root = LittleFS.open(dir.c_str(), "r");
-                if (!root || !root.isDirectory()) return server->send(404, "text/html; charset=utf-8", "<li class='err'>not found</li>");
-                while (true) {
-                    File e = root.openNextFile(); if (!e) break;
-                    String name = basenameOf(String(e.name())); bool is_dir = e.isDirectory(); e.close();
-                    if (!name.length()) continue;
+                LfsDirIter root(dir);
+                if (!root.isOpen()) return server->send(404, "text/html; charset=utf-8", "<li class='err'>not found</li>");
+                String name; bool is_dir = false;
+                while (root.next(name, is_dir)) {
+                    if (TrashBin::isHiddenEntry(dir, name)) continue;
                     String full = joinPath(dir, name);
                     if (is_dir) out += "<li><details class='dir' data-drive='L' data-path='" + htmlEscape(full) + "'><summary>" + htmlEscape(name) + "</summary><ul class='children'></ul></details></li>";
                     else out += "<li><a href='/download?drive=L&path=" + urlEncodeUtf8(full) + "'>" + htmlEscape(name) + "</a></li>";
@@ -347,7 +413,7 @@ private:
                 FsFile e;
                 while (e.openNext(&root, O_RDONLY)) {
                     char buf[256]; buf[0] = '\0'; e.getName(buf, sizeof(buf)); String name = basenameOf(String(buf)); bool is_dir = e.isDir(); e.close();
-                    if (!name.length()) continue;
+                    if (!name.length() || TrashBin::isHiddenEntry(dir, name)) continue;
                     String full = joinPath(dir, name);
                     if (is_dir) out += "<li><details class='dir' data-drive='D' data-path='" + htmlEscape(full) + "'><summary>" + htmlEscape(name) + "</summary><ul class='children'></ul></details></li>";
                     else out += "<li><a href='/download?drive=D&path=" + urlEncodeUtf8(full) + "'>" + htmlEscape(name) + "</a></li>";
@@ -367,15 +433,22 @@ private:
             String p = innerFromVPath(vpath);
             String fn = fileNameOf(p);
             server->sendHeader("Content-Disposition", "attachment; filename=\"" + asciiFallbackName(fn) + "\"; filename*=UTF-8''" + urlEncodeUtf8(fn));
+            bool raw = server->arg("raw") == "1";
             if (d == 'L') {
                 if (!LittleFS.exists(p.c_str())) return server->send(404, "text/plain", "file not found");
                 File f = LittleFS.open(p.c_str(), "r"); if (!f) return server->send(500, "text/plain", "open failed");
-                server->streamFile(f, "application/octet-stream"); f.close(); return;
+                if (!raw && sendDecodedNote(f, (size_t)f.size())) { f.close(); return; }
+                f.seek(0); server->streamFile(f, "application/octet-stream"); f.close(); return;
             }
             if (d == 'D' && sd_helper && sd_helper->isInitialized()) {
                 FsFile f = sd_helper->getFs().open(p.c_str(), O_RDONLY); if (!f.isOpen()) return server->send(404, "text/plain", "file not found");
+                if (!raw && sendDecodedNote(f, (size_t)f.fileSize())) { f.close(); return; }
+                f.seekSet(0);
+                ScratchLease lease = ScratchPool::getInstance()->lease(DOWNLOAD_CHUNK);
+                if (!lease) { f.close(); return server->send(503, "text/plain", "out of memory"); }
                 server->setContentLength((size_t)f.fileSize()); server->send(200, "application/octet-stream", "");
-                char chunk[1024]; while (true) { int n = f.read(chunk, sizeof(chunk)); if (n <= 0) break; server->sendContent(chunk, (size_t)n); } f.close(); return;
+                while (true) { int n = f.read(lease.data(), lease.size()); if (n <= 0) break; server->sendContent((const char*)lease.data(), (size_t)n); }
+                f.close(); return;
             }
             server->send(500, "text/plain", "drive unavailable");
         });
@@ -441,8 +514,17 @@ private:
                 String vpath = buildVPath(driveFromVPath(dir_vpath), final_inner);
                 upload_vpath = vpath; upload_drive = driveFromVPath(vpath);
                 String p = innerFromVPath(vpath);
+                DirListingCache::getInstance()->invalidatePath(dir_vpath);
+                DirListingCache::getInstance()->invalidatePath(vpath);
                 if (upload_drive == 'L') { ensureLittleFsParent(p); upload_lfs = LittleFS.open(p.c_str(), "w"); upload_ok = (bool)upload_lfs; }
-                else if (upload_drive == 'D' && sd_helper && sd_helper->isInitialized()) { ensureSdParent(p); upload_sd = sd_helper->getFs().open(p.c_str(), O_WRONLY | O_CREAT | O_TRUNC); upload_ok = upload_sd.isOpen(); }
+                else if (upload_drive == 'D' && sd_helper && sd_helper->isInitialized()) {
+                    ensureSdParent(p);
+                    upload_sd = sd_helper->getFs().open(p.c_str(), O_WRONLY | O_CREAT);
+                    upload_sd_old_size = upload_sd.isOpen() ? upload_sd.fileSize() : 0;
+                    upload_ok = upload_sd.isOpen() && (upload_sd_old_size == 0 || upload_sd.truncate(0));
+                }
+                // Without a lease (low memory) chunks are written straight from the server buffer.
+                if (upload_ok) upload_lease = ScratchPool::getInstance()->lease(UPLOAD_BUFFER, 2048);
                 if (!upload_ok) {
                     upload_failed = true;
                     upload_error = "open failed";
@@ -451,46 +533,39 @@ private:
                 }
             } else if (up.status == UPLOAD_FILE_WRITE) {
                 if (!upload_ok || upload_failed) return;
+                if (!upload_lease) {
+                    if (!writeUploadBytes(up.buf, up.currentSize)) failUploadWrite();
+                    return;
+                }
                 size_t off = 0;
                 while (off < up.currentSize) {
-                    size_t chunk = up.currentSize - off;
-                    size_t slice = UPLOAD_WRITE_SLICE;
-                    size_t free_heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
-                    if (free_heap < UPLOAD_MIN_FREE_HEAP) slice = UPLOAD_WRITE_SLICE_LOW_MEM;
-                    if (chunk > slice) chunk = slice;
-
-                    size_t w = 0;
-                    if (upload_drive == 'L' && upload_lfs) w = upload_lfs.write(up.buf + off, chunk);
-                    else if (upload_drive == 'D' && upload_sd.isOpen()) w = upload_sd.write(up.buf + off, chunk);
-                    if (w != chunk) {
-                        upload_ok = false; upload_failed = true; upload_error = "write failed";
-                        closeUploadHandles(); if (upload_vpath.length()) removeVPath(upload_vpath);
-                        upload_batch_fail++;
-                        if (!upload_batch_error.length()) upload_batch_error = upload_error;
+                    size_t n = upload_lease.size() - upload_fill;
+                    if (n > up.currentSize - off) n = up.currentSize - off;
+                    memcpy(upload_lease.data() + upload_fill, up.buf + off, n);
+                    upload_fill += n;
+                    off += n;
+                    if (upload_fill == upload_lease.size() && !flushUploadBuffer()) {
+                        failUploadWrite();
                         return;
                     }
-
-                    off += chunk;
-                    upload_bytes += chunk;
-                    upload_sync_bytes += chunk;
-                    delay(0);
-                    if (upload_bytes >= UPLOAD_YIELD_EVERY_BYTES) {
-                        upload_bytes = 0;
-                        delay(0);
-                    }
-                    if (upload_drive == 'D' && upload_sd.isOpen() && upload_sync_bytes >= UPLOAD_SYNC_EVERY_BYTES) {
-                        upload_sd.sync();
-                        upload_sync_bytes = 0;
-                        delay(0);
-                    }
                 }
             } else if (up.status == UPLOAD_FILE_END) {
-                if (upload_drive == 'D' && upload_sd.isOpen()) upload_sd.sync();
+                if (upload_ok && !upload_failed && !flushUploadBuffer()) {
+                    failUploadWrite();
+                    return;
+                }
+                if (upload_drive == 'D' && upload_sd.isOpen()) {
+                    upload_sd.sync();
+                    SdSpaceTracker::getInstance()->noteFileResized(upload_sd_old_size, upload_sd.fileSize());
+                }
                 closeUploadHandles();
+                // Again now the file is complete: a listing read mid-upload must not stay cached.
+                DirListingCache::getInstance()->invalidatePath(upload_vpath);
                 delay(0);
                 if (!upload_failed) {
                     upload_ok = true;
                     upload_batch_ok++;
+                    FileIndex::getInstance()->noteChanged(upload_drive, innerFromVPath(upload_vpath));
                 }
             } else if (up.status == UPLOAD_FILE_ABORTED) {
                 closeUploadHandles();
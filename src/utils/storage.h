@@ -9,17 +9,67 @@
 #endif
 #include <SdFat.h>
 #include <SdCard/SdCardInfo.h>
+#include <Preferences.h>
 #include "../config.h"
+#include "sdspace.h"
+#include "sdcache.h"
+#include "bufpool.h"
+
+enum SdMountEvent {
+    SD_MOUNT_NONE,
+    SD_MOUNT_INSERTED,
+    SD_MOUNT_REMOVED
+};
 
 // StorageHelper - SD card file operations wrapper for CYDnote
 class StorageHelper {
 private:
+    static constexpr uint8_t TUNE_REF_MHZ = 4;
+    static constexpr uint32_t TUNE_SECTORS = 64;
+    static constexpr uint32_t TUNE_CHUNK_SECTORS = 8;
+    static constexpr uint8_t TUNE_PASSES = 2;
+    static constexpr size_t READ_CHUNK = 8192;
+
+    // Mount runs as a sequence of steps, one SPI (re)mount or tune candidate per call.
+    enum MountPhase : uint8_t {
+        MOUNT_IDLE,
+        MOUNT_HINT,      // last boot's clock
+        MOUNT_CFG,       // SD_SPI_SPEED
+        MOUNT_FALLBACK,  // fallback_speeds[mount_idx]
+        MOUNT_PROFILE,   // look up the tuned clock for this card
+        MOUNT_TUNE_REF,  // reference read at TUNE_REF_MHZ
+        MOUNT_TUNE,      // tune_candidates[mount_idx]
+        MOUNT_REMOUNT    // settle at mount_target
+    };
+
     SdFs sd;
+#if SD_SECTOR_CACHE_SECTORS > 0
+    SdSectorCache sector_cache;
+#endif
     bool initialized;
+    uint32_t mounted_mhz;
+    uint32_t presence_last_ms;
+    uint8_t presence_misses;
+    bool mount_failed_card;
+    bool spi_started;
+    MountPhase mount_phase;
+    uint8_t mount_idx;
+    uint32_t mount_cfg_mhz;
+    uint32_t mount_base_mhz;    // first clock that mounted
+    uint32_t mount_target_mhz;  // clock MOUNT_REMOUNT settles at
+    const char* mount_note;
+    uint32_t tune_key;
+    uint32_t tune_ref_crc;
+    uint32_t tune_best_mhz;
+    uint32_t tune_best_kbps;
     static StorageHelper* instance;
     
 public:
-    StorageHelper() : initialized(false) {}
+    StorageHelper()
+        : initialized(false), mounted_mhz(0), presence_last_ms(0), presence_misses(0), mount_failed_card(false),
+          spi_started(false), mount_phase(MOUNT_IDLE), mount_idx(0), mount_cfg_mhz(0), mount_base_mhz(0),
+          mount_target_mhz(0), mount_note(""), tune_key(0), tune_ref_crc(0),
+          tune_best_mhz(0), tune_best_kbps(0) {}
     
     static StorageHelper* getInstance() {
         if (!instance) {
@@ -28,48 +78,96 @@ public:
         return instance;
     }
     
+    // Blocking mount: runs every mount step. pollPresence() spreads the same steps
+    // over loop iterations instead.
     bool begin() {
         if (initialized) return true;
-        pinMode(SD_CS, OUTPUT);
-        digitalWrite(SD_CS, HIGH);
+        if (mount_phase == MOUNT_IDLE) startMount();
+        while (mount_phase != MOUNT_IDLE) stepMount();
+        return initialized;
+    }
+    
+    void end() {
+        if (!initialized) return;
+#if SD_SECTOR_CACHE_SECTORS > 0
+        // Called after a failed presence check: the card is gone, nothing to flush to.
+        sector_cache.detach(false);
+#endif
+        sd.end();
+        initialized = false;
+        mount_phase = MOUNT_IDLE;
+        mounted_mhz = 0;
+        presence_misses = 0;
+        SdSpaceTracker::getInstance()->reset(nullptr);
+    }
 
-        uint32_t cfg_mhz = SD_SPI_SPEED / 1000000UL;
-        if (cfg_mhz < 4) cfg_mhz = 4;
-        if (cfg_mhz > 40) cfg_mhz = 40;
-        if (sd.begin(SdSpiConfig(SD_CS, DEDICATED_SPI, SD_SCK_MHZ(cfg_mhz), &SPI))) {
-            initialized = true;
-            Serial.print("[SD] mounted @ ");
-            Serial.print(cfg_mhz);
-            Serial.println("MHz");
-            return true;
+    // Hot-plug state machine, called from the loop task while no SD file is open.
+    // Unmounted: a cheap CMD0 probe every SD_PRESENCE_POLL_MS; once a card answers,
+    // the mount (and first-time clock tuning) advances one step per call. Mounted: a
+    // CID read detects removal (two misses in a row).
+    SdMountEvent pollPresence() {
+        if (mount_phase != MOUNT_IDLE) {
+            stepMount();
+            if (initialized) return SD_MOUNT_INSERTED;
+            if (mount_phase == MOUNT_IDLE) mount_failed_card = true;
+            return SD_MOUNT_NONE;
         }
+        uint32_t now = millis();
+        if (presence_last_ms != 0 && (now - presence_last_ms) < SD_PRESENCE_POLL_MS) return SD_MOUNT_NONE;
+        presence_last_ms = now;
 
-#if SD_ALLOW_FALLBACK_SPEEDS
-        const uint32_t fallback_speeds[] = {25, 12, 8, 4};
-        for (uint8_t i = 0; i < (sizeof(fallback_speeds) / sizeof(fallback_speeds[0])); i++) {
-            uint32_t mhz = fallback_speeds[i];
-            if (mhz == cfg_mhz) continue;
-            if (sd.begin(SdSpiConfig(SD_CS, DEDICATED_SPI, SD_SCK_MHZ(mhz), &SPI))) {
-                initialized = true;
-                Serial.print("[SD] mounted @ ");
-                Serial.print(mhz);
-                Serial.println("MHz (fallback)");
-                return true;
+        if (!initialized) {
+            if (!probeCardPresent()) {
+                mount_failed_card = false;
+                return SD_MOUNT_NONE;
             }
+            // Same unreadable card still inserted: don't stall the UI retrying.
+            if (mount_failed_card) return SD_MOUNT_NONE;
+            Serial.println("[SD] card detected");
+            startMount();
+            return SD_MOUNT_NONE;
         }
+
+        cid_t cid;
+        if (sd.card() && sd.card()->readCID(&cid)) {
+            presence_misses = 0;
+            return SD_MOUNT_NONE;
+        }
+        if (++presence_misses < 2) return SD_MOUNT_NONE;
+        Serial.println("[SD] card removed");
+        end();
+        return SD_MOUNT_REMOVED;
+    }
+
+    // Metadata batch: SdFat's per-operation syncs are held back until the outermost
+    // endBatch(), so a recursive delete/copy writes each FAT/dir sector once.
+    void beginBatch() {
+#if SD_SECTOR_CACHE_SECTORS > 0
+        if (initialized) sector_cache.beginBatch();
 #endif
+    }
 
-        Serial.print("[SD] Init failed. Error code: 0x");
-        Serial.println(sd.sdErrorCode(), HEX);
-        Serial.print("[SD] Error data: 0x");
-        Serial.println(sd.sdErrorData(), HEX);
-        return false;
+    bool endBatch() {
+#if SD_SECTOR_CACHE_SECTORS > 0
+        if (initialized) return sector_cache.endBatch();
+#endif
+        return true;
     }
-    
+
+    // Volume-coherent block device (through the sector cache when enabled).
+    FsBlockDevice* blockDevice() {
+#if SD_SECTOR_CACHE_SECTORS > 0
+        if (sector_cache.isAttached()) return &sector_cache;
+#endif
+        return sd.card();
+    }
+
     // Expose underlying SdFs for advanced operations
     SdFs& getFs() { return sd; }
     
     bool isInitialized() const { return initialized; }
+
+    uint32_t busMhz() const { return initialized ? mounted_mhz : 0; }
     
     bool fileExists(const char* path) {
         if (!initialized) return false;
@@ -90,13 +188,15 @@ public:
         uint32_t fsz = (uint32_t)file.fileSize();
         if (fsz > 0) content.reserve(fsz + 1);
 
-        static constexpr size_t CHUNK = 1024;
-        char buf[CHUNK + 1];
+        ScratchLease lease = ScratchPool::getInstance()->lease(READ_CHUNK);
+        if (!lease) {
+            file.close();
+            return false;
+        }
         while (true) {
-            int n = file.read(buf, CHUNK);
+            int n = file.read(lease.data(), lease.size());
             if (n <= 0) break;
-            buf[n] = '\0';
-            if (!content.concat(buf, (unsigned int)n)) {
+            if (!content.concat((const char*)lease.data(), (unsigned int)n)) {
                 file.close();
                 return false;
             }
@@ -106,6 +206,10 @@ public:
     }
     
     bool writeFile(const char* path, const String& content) {
+        return writeFile(path, content.c_str(), content.length());
+    }
+
+    bool writeFile(const char* path, const char* data, size_t expected) {
         if (!initialized) return false;
 
         String norm = normalizePath(path);
@@ -114,22 +218,36 @@ public:
             sd.mkdir(parent.c_str(), true);
         }
 
-        FsFile file = sd.open(norm.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
+        FsFile file = sd.open(norm.c_str(), O_WRONLY | O_CREAT);
         if (!file.isOpen()) {
             Serial.print("Failed to open file for write: ");
             Serial.println(path);
             return false;
         }
+        uint64_t old_size = file.fileSize();
+        if (old_size > 0 && !file.truncate(0)) {
+            file.close();
+            return false;
+        }
 
-        size_t expected = content.length();
-        size_t written = file.write((const uint8_t*)content.c_str(), expected);
+        size_t written = file.write((const uint8_t*)data, expected);
         file.close();
+        SdSpaceTracker::getInstance()->noteFileResized(old_size, written);
         return written == expected;
     }
     
     bool deleteFile(const char* path) {
         if (!initialized) return false;
-        return sd.remove(normalizePath(path).c_str());
+        String norm = normalizePath(path);
+        uint64_t size = 0;
+        FsFile file = sd.open(norm.c_str(), O_RDONLY);
+        if (file.isOpen()) {
+            size = file.fileSize();
+            file.close();
+        }
+        if (!sd.remove(norm.c_str())) return false;
+        SdSpaceTracker::getInstance()->noteFreed(size);
+        return true;
     }
 
     uint64_t totalBytes() {
@@ -137,19 +255,19 @@ public:
         return (uint64_t)sd.vol()->bytesPerCluster() * (uint64_t)sd.vol()->clusterCount();
     }
 
+    // Usage comes from SdSpaceTracker; false until its first background count completes.
+    bool usageKnown() const {
+        return initialized && SdSpaceTracker::getInstance()->isValid();
+    }
+
     uint64_t usedBytes() {
-        if (!initialized || !sd.vol()) return 0;
-        uint64_t total = totalBytes();
-        int32_t free_clusters = sd.freeClusterCount();
-        if (free_clusters < 0) return 0;
-        uint64_t free_bytes = (uint64_t)sd.vol()->bytesPerCluster() * (uint64_t)free_clusters;
-        return (total > free_bytes) ? (total - free_bytes) : 0;
+        if (!usageKnown()) return 0;
+        return SdSpaceTracker::getInstance()->usedBytes();
     }
 
     uint64_t freeBytes() {
-        uint64_t total = totalBytes();
-        uint64_t used = usedBytes();
-        return (total > used) ? (total - used) : 0;
+        if (!usageKnown()) return 0;
+        return SdSpaceTracker::getInstance()->freeBytes();
     }
 
     uint32_t sectorCount() {
@@ -177,6 +295,313 @@ public:
     }
 
 private:
+    // Raw SPI CMD0 at 400 kHz; an inserted card answers R1 = 0x01 (idle) within a few bytes.
+    bool probeCardPresent() {
+        if (!spi_started) {
+            SPI.begin();
+            pinMode(SD_CS, OUTPUT);
+            digitalWrite(SD_CS, HIGH);
+            spi_started = true;
+        }
+        SPI.beginTransaction(SPISettings(400000, MSBFIRST, SPI_MODE0));
+        for (uint8_t i = 0; i < 10; i++) SPI.transfer(0xFF);
+        digitalWrite(SD_CS, LOW);
+        static const uint8_t cmd0[6] = {0x40, 0x00, 0x00, 0x00, 0x00, 0x95};
+        for (uint8_t i = 0; i < sizeof(cmd0); i++) SPI.transfer(cmd0[i]);
+        uint8_t r1 = 0xFF;
+        for (uint8_t i = 0; i < 10 && r1 == 0xFF; i++) r1 = SPI.transfer(0xFF);
+        digitalWrite(SD_CS, HIGH);
+        SPI.transfer(0xFF);
+        SPI.endTransaction();
+        return r1 == 0x01;
+    }
+
+    bool mountAt(uint32_t mhz) {
+#if SD_SECTOR_CACHE_SECTORS > 0
+        sector_cache.detach(false);
+        sd.end();
+        if (!sd.cardBegin(SdSpiConfig(SD_CS, DEDICATED_SPI, SD_SCK_MHZ(mhz), &SPI))) return false;
+        // Volume goes through the sector cache; raw card access stays on sd.card().
+        if (!sector_cache.attach(sd.card())) return sd.volumeBegin();
+        return sd.FsVolume::begin(&sector_cache);
+#else
+        sd.end();
+        return sd.begin(SdSpiConfig(SD_CS, DEDICATED_SPI, SD_SCK_MHZ(mhz), &SPI));
+#endif
+    }
+
+    void startMount() {
+        if (!spi_started) {
+            SPI.begin();
+            pinMode(SD_CS, OUTPUT);
+            digitalWrite(SD_CS, HIGH);
+            spi_started = true;
+        }
+        mount_cfg_mhz = SD_SPI_SPEED / 1000000UL;
+        if (mount_cfg_mhz < 4) mount_cfg_mhz = 4;
+        if (mount_cfg_mhz > 40) mount_cfg_mhz = 40;
+        mount_idx = 0;
+        mount_note = "";
+        mount_phase = MOUNT_HINT;
+    }
+
+    void stepMount() {
+        switch (mount_phase) {
+            case MOUNT_HINT: {
+#if SD_AUTO_TUNE
+                // Most boots see the same card again: try its tuned clock first.
+                uint32_t hint_mhz = 0;
+                Preferences prefs;
+                if (prefs.begin("sdtune", true)) {
+                    hint_mhz = prefs.getUChar("last_mhz", 0);
+                    prefs.end();
+                }
+                if (hint_mhz >= 4 && hint_mhz != mount_cfg_mhz && mountAt(hint_mhz)) {
+                    mounted(hint_mhz);
+                    return;
+                }
+#endif
+                mount_phase = MOUNT_CFG;
+                return;
+            }
+            case MOUNT_CFG:
+                if (mountAt(mount_cfg_mhz)) {
+                    mounted(mount_cfg_mhz);
+                    return;
+                }
+#if SD_ALLOW_FALLBACK_SPEEDS
+                mount_phase = MOUNT_FALLBACK;
+                mount_idx = 0;
+#else
+                mountFailed();
+#endif
+                return;
+            case MOUNT_FALLBACK: {
+                static const uint8_t fallback_speeds[] = {25, 12, 8, 4};
+                while (mount_idx < sizeof(fallback_speeds) && fallback_speeds[mount_idx] == mount_cfg_mhz) mount_idx++;
+                if (mount_idx >= sizeof(fallback_speeds)) {
+                    mountFailed();
+                    return;
+                }
+                uint32_t mhz = fallback_speeds[mount_idx++];
+                mount_note = " (fallback)";
+                if (mountAt(mhz)) mounted(mhz);
+                return;
+            }
+#if SD_AUTO_TUNE
+            case MOUNT_PROFILE:
+                stepProfile();
+                return;
+            case MOUNT_TUNE_REF:
+            case MOUNT_TUNE:
+                stepTune();
+                return;
+            case MOUNT_REMOUNT:
+                stepRemount();
+                return;
+#endif
+            default:
+                mount_phase = MOUNT_IDLE;
+                return;
+        }
+    }
+
+    // A first mount succeeded at mhz; tune or settle before reporting the card.
+    void mounted(uint32_t mhz) {
+        mount_base_mhz = mhz;
+#if SD_AUTO_TUNE
+        mount_phase = MOUNT_PROFILE;
+#else
+        finishMount(mhz);
+#endif
+    }
+
+    void mountFailed() {
+        mount_phase = MOUNT_IDLE;
+        Serial.print("[SD] Init failed. Error code: 0x");
+        Serial.println(sd.sdErrorCode(), HEX);
+        Serial.print("[SD] Error data: 0x");
+        Serial.println(sd.sdErrorData(), HEX);
+    }
+
+    void finishMount(uint32_t mhz) {
+        mount_phase = MOUNT_IDLE;
+        initialized = true;
+        mounted_mhz = mhz;
+        SdSpaceTracker::getInstance()->reset(&sd, blockDevice());
+        Serial.print("[SD] mounted @ ");
+        Serial.print(mhz);
+        Serial.print("MHz");
+        Serial.println(mount_note);
+    }
+
+    static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+        crc = ~crc;
+        for (size_t i = 0; i < len; i++) {
+            crc ^= data[i];
+            for (uint8_t b = 0; b < 8; b++) crc = (crc >> 1) ^ (0xEDB88320UL & (0U - (crc & 1U)));
+        }
+        return ~crc;
+    }
+
+    // FNV-1a over the raw CID; 0 when the card does not answer.
+    uint32_t cardKey() {
+        cid_t cid;
+        if (!sd.card() || !sd.card()->readCID(&cid)) return 0;
+        const uint8_t* p = (const uint8_t*)&cid;
+        uint32_t h = 2166136261UL;
+        for (size_t i = 0; i < sizeof(cid); i++) {
+            h ^= p[i];
+            h *= 16777619UL;
+        }
+        return h ? h : 1;
+    }
+
+    // Reads the FAT region and returns its CRC and the elapsed time.
+    bool readBenchmark(uint8_t* buf, uint32_t& crc, uint32_t& elapsed_us) {
+        if (!sd.card() || !sd.vol()) return false;
+        uint32_t first = sd.vol()->fatStartSector();
+        if (first == 0 || first + TUNE_SECTORS > sd.card()->sectorCount()) return false;
+        crc = 0;
+        uint32_t t0 = micros();
+        for (uint32_t s = 0; s < TUNE_SECTORS; s += TUNE_CHUNK_SECTORS) {
+            if (!sd.card()->readSectors(first + s, buf, TUNE_CHUNK_SECTORS)) return false;
+            crc = crc32Update(crc, buf, TUNE_CHUNK_SECTORS * 512);
+        }
+        elapsed_us = micros() - t0;
+        if (elapsed_us == 0) elapsed_us = 1;
+        return true;
+    }
+
+#if SD_AUTO_TUNE
+    void tuneKeyName(char* k, size_t n) const { snprintf(k, n, "c%08lx", (unsigned long)tune_key); }
+
+    // Remounts at the tuned clock stored for this card, tuning it first if unknown.
+    void stepProfile() {
+        tune_key = cardKey();
+        if (tune_key == 0) {
+            finishMount(mount_base_mhz);
+            return;
+        }
+        char k[12];
+        tuneKeyName(k, sizeof(k));
+        uint32_t tuned = 0;
+        Preferences prefs;
+        if (prefs.begin("sdtune", true)) {
+            tuned = prefs.getUChar(k, 0);
+            prefs.end();
+        }
+        if (tuned == 0) {
+            Serial.println("[SD] new card, tuning bus speed");
+            tune_best_mhz = 0;
+            tune_best_kbps = 0;
+            mount_phase = MOUNT_TUNE_REF;
+            return;
+        }
+        if (tuned == mount_base_mhz) {
+            settle(mount_base_mhz);
+            return;
+        }
+        mount_target_mhz = tuned;
+        mount_phase = MOUNT_REMOUNT;
+    }
+
+    // Tries each candidate clock (one per step) against a reference read at
+    // TUNE_REF_MHZ and picks the fastest one that reads back identical data. Higher
+    // clocks must be >5% faster to win, so a card that saturates early keeps a safer clock.
+    void stepTune() {
+        static const uint8_t candidates[] = {8, 12, 16, 20, 25, 32, 40};
+        ScratchLease lease = ScratchPool::getInstance()->lease(TUNE_CHUNK_SECTORS * 512, TUNE_CHUNK_SECTORS * 512);
+        if (!lease) {
+            storeTune();
+            return;
+        }
+        uint8_t* buf = lease.data();
+        uint32_t elapsed = 0;
+        if (mount_phase == MOUNT_TUNE_REF) {
+            if (mountAt(TUNE_REF_MHZ) && readBenchmark(buf, tune_ref_crc, elapsed)) {
+                tune_best_mhz = TUNE_REF_MHZ;
+                tune_best_kbps = (TUNE_SECTORS * 512UL * 1000UL) / elapsed;
+                mount_idx = 0;
+                mount_phase = MOUNT_TUNE;
+            } else {
+                storeTune();
+            }
+            return;
+        }
+        uint32_t mhz = candidates[mount_idx];
+        if (!mountAt(mhz)) {
+            storeTune();
+            return;
+        }
+        uint32_t kbps = 0;
+        bool stable = true;
+        for (uint8_t pass = 0; pass < TUNE_PASSES && stable; pass++) {
+            uint32_t crc = 0;
+            if (!readBenchmark(buf, crc, elapsed) || crc != tune_ref_crc) stable = false;
+            else kbps = (TUNE_SECTORS * 512UL * 1000UL) / elapsed;
+        }
+        Serial.print("[SD] tune ");
+        Serial.print(mhz);
+        Serial.print("MHz: ");
+        if (!stable) {
+            Serial.println("unstable");
+            storeTune();
+            return;
+        }
+        Serial.print(kbps);
+        Serial.println(" KB/s");
+        if (kbps * 100UL > tune_best_kbps * 105UL) {
+            tune_best_mhz = mhz;
+            tune_best_kbps = kbps;
+        }
+        if (++mount_idx >= sizeof(candidates)) storeTune();
+    }
+
+    // Saves the tuning result; the tuner leaves the card at its last candidate.
+    void storeTune() {
+        uint32_t tuned = tune_best_mhz ? tune_best_mhz : mount_base_mhz;
+        char k[12];
+        tuneKeyName(k, sizeof(k));
+        Preferences prefs;
+        if (prefs.begin("sdtune", false)) {
+            prefs.putUChar(k, (uint8_t)tuned);
+            prefs.end();
+        }
+        mount_target_mhz = tuned;
+        mount_phase = MOUNT_REMOUNT;
+    }
+
+    void stepRemount() {
+        if (mountAt(mount_target_mhz)) {
+            settle(mount_target_mhz);
+            return;
+        }
+        // Stored profile no longer works (card aged, wiring changed): drop it.
+        char k[12];
+        tuneKeyName(k, sizeof(k));
+        Preferences prefs;
+        if (prefs.begin("sdtune", false)) {
+            prefs.remove(k);
+            prefs.end();
+        }
+        if (mountAt(mount_base_mhz)) {
+            settle(mount_base_mhz);
+            return;
+        }
+        mountFailed();
+    }
+
+    void settle(uint32_t mhz) {
+        Preferences prefs;
+        if (prefs.begin("sdtune", false)) {
+            prefs.putUChar("last_mhz", (uint8_t)mhz);
+            prefs.end();
+        }
+        finishMount(mhz);
+    }
+#endif
+
     String normalizePath(const char* p) {
         if (!p || p[0] == '\0') return "/";
         String path = String(p);
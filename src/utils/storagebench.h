@@ -0,0 +1,375 @@
+#ifndef STORAGEBENCH_H
+#define STORAGEBENCH_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <vector>
+#include <functional>
+#include "../config.h"
+#include "storage.h"
+#include "listing.h"
+#include "dirscan.h"
+#include "lfsdir.h"
+#include "bufpool.h"
+
+// StorageBench - on-device storage benchmark, started by typing "bench" (both
+// drives), "bench L" or "bench D" on the serial console. Runs to completion on the
+// loop task through the same calls the app uses (LittleFS File / LfsDirIter on L:,
+// StorageHelper / SdFs / SdDirScanner on D:) and prints one CSV row per test:
+//   drive,test,param,bytes,ops,us,rate
+// rate is KB/s for throughput rows and ops/s otherwise. The note rows go through the
+// app's own save/open/copy, handed in with setNoteIo(). Work files live in
+// STORAGE_BENCH_DIR and are removed afterwards, also when a test fails. "heap" prints free heap, the largest
+// free block and the listing cache size, to watch fragmentation while browsing.
+class StorageBench {
+private:
+    static constexpr size_t SEQ_BYTES = 256 * 1024;
+    static constexpr size_t BUF_SIZES[] = {512, 2048, 8192, 32768};
+    static constexpr uint16_t SMALL_FILES = 64;
+    static constexpr size_t SMALL_SIZE = 256;
+    static constexpr uint16_t RANDOM_READS = 256;
+    static constexpr size_t RANDOM_SIZE = 512;
+    static constexpr size_t NOTE_BYTES = 64 * 1024;
+    static constexpr uint8_t FREE_COUNT_RUNS = 3;
+
+    String line;
+    ScratchLease lease;
+    uint32_t rng;
+    std::function<bool(const String&, const char*, size_t)> save_fn;
+    std::function<bool(const String&, String&)> open_fn;
+    std::function<bool(const String&, const String&)> copy_fn;
+    static StorageBench* instance;
+
+    StorageBench() : rng(1) {}
+
+    uint32_t nextRandom() {
+        rng ^= rng << 13;  // xorshift32: same offsets on every run
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        return rng;
+    }
+
+    void fillPattern(uint8_t* p, size_t n) {
+        for (size_t i = 0; i < n; i++) p[i] = (uint8_t)('a' + (i % 26));
+    }
+
+    static void row(char drive, const char* test, uint32_t param, uint64_t bytes, uint32_t ops, uint32_t us) {
+        double secs = us > 0 ? (double)us / 1000000.0 : 0.000001;
+        double rate = bytes > 0 ? ((double)bytes / 1024.0) / secs : (double)ops / secs;
+        Serial.printf("%c,%s,%lu,%llu,%lu,%lu,%.1f\n", drive, test, (unsigned long)param, (unsigned long long)bytes,
+                      (unsigned long)ops, (unsigned long)us, rate);
+    }
+
+    static String benchPath(const char* name) { return String(STORAGE_BENCH_DIR) + "/" + name; }
+
+    // ---- L: (LittleFS) ----
+    void runLfs() {
+        LittleFS.mkdir(STORAGE_BENCH_DIR);
+        runLfsTests();
+        std::vector<String> names;
+        {
+            LfsDirIter dir(STORAGE_BENCH_DIR);
+            String entry;
+            bool is_dir = false;
+            while (dir.next(entry, is_dir)) names.push_back(entry);
+        }
+        for (size_t i = 0; i < names.size(); i++) LittleFS.remove(benchPath(names[i].c_str()).c_str());
+        LittleFS.rmdir(STORAGE_BENCH_DIR);
+        DirListingCache::getInstance()->invalidatePath(String("L:") + STORAGE_BENCH_DIR);
+    }
+
+    void runLfsTests() {
+        size_t total = SEQ_BYTES;
+        size_t free_bytes = LittleFS.totalBytes() - LittleFS.usedBytes();
+        while (total > 16384 && total * 2 > free_bytes) total /= 2;
+        String seq = benchPath("seq.bin");
+        uint8_t* buf = lease.data();
+
+        for (size_t b : BUF_SIZES) {
+            if (b > lease.size()) break;
+            fillPattern(buf, b);
+            uint32_t t0 = micros();
+            File f = LittleFS.open(seq.c_str(), "w");
+            if (!f) return fail('L', "seq_write");
+            size_t done = 0;
+            while (done < total && f.write(buf, b) == b) done += b;
+            f.close();
+            row('L', "seq_write", b, done, (uint32_t)(done / b), micros() - t0);
+
+            t0 = micros();
+            f = LittleFS.open(seq.c_str(), "r");
+            if (!f) return fail('L', "seq_read");
+            done = 0;
+            while (true) {
+                size_t n = f.read(buf, b);
+                if (n == 0) break;
+                done += n;
+            }
+            f.close();
+            row('L', "seq_read", b, done, (uint32_t)(done / b), micros() - t0);
+        }
+
+        File f = LittleFS.open(seq.c_str(), "r");
+        if (f && f.size() > RANDOM_SIZE) {
+            uint32_t span = (uint32_t)(f.size() - RANDOM_SIZE);
+            uint32_t t0 = micros();
+            size_t done = 0;
+            for (uint16_t i = 0; i < RANDOM_READS; i++) {
+                f.seek(nextRandom() % span);
+                done += f.read(buf, RANDOM_SIZE);
+            }
+            row('L', "random_read", RANDOM_SIZE, done, RANDOM_READS, micros() - t0);
+        }
+        if (f) f.close();
+        LittleFS.remove(seq.c_str());
+
+        noteRoundTrip('L');
+
+        fillPattern(buf, SMALL_SIZE);
+        char name[24];
+        uint32_t t0 = micros();
+        uint16_t made = 0;
+        for (; made < SMALL_FILES; made++) {
+            snprintf(name, sizeof(name), "s%03u.txt", (unsigned)made);
+            File s = LittleFS.open(benchPath(name).c_str(), "w");
+            if (!s) break;
+            s.write(buf, SMALL_SIZE);
+            s.close();
+        }
+        row('L', "small_create", SMALL_SIZE, 0, made, micros() - t0);
+
+        t0 = micros();
+        uint32_t seen = 0;
+        {
+            LfsDirIter dir(STORAGE_BENCH_DIR);
+            String entry;
+            bool is_dir = false;
+            while (dir.next(entry, is_dir)) seen++;
+        }
+        row('L', "dir_scan", made, 0, seen, micros() - t0);
+
+        t0 = micros();
+        uint16_t removed = 0;
+        for (uint16_t i = 0; i < made; i++) {
+            snprintf(name, sizeof(name), "s%03u.txt", (unsigned)i);
+            if (LittleFS.remove(benchPath(name).c_str())) removed++;
+        }
+        row('L', "small_delete", SMALL_SIZE, 0, removed, micros() - t0);
+
+        for (uint8_t i = 0; i < FREE_COUNT_RUNS; i++) {
+            t0 = micros();
+            size_t used = LittleFS.usedBytes();
+            row('L', "used_bytes", i, 0, used > 0 ? 1 : 0, micros() - t0);
+        }
+    }
+
+    // ---- D: (SD via StorageHelper) ----
+    void runSd() {
+        StorageHelper* sd = StorageHelper::getInstance();
+        SdFs& fs = sd->getFs();
+        fs.mkdir(STORAGE_BENCH_DIR, true);
+        runSdTests();
+        std::vector<String> names;
+        FsFile dir = fs.open(STORAGE_BENCH_DIR, O_RDONLY);
+        if (dir.isOpen()) {
+            FsFile entry;
+            char name[64];
+            while (entry.openNext(&dir, O_RDONLY)) {
+                if (!entry.isDir() && entry.getName(name, sizeof(name)) > 0) names.push_back(String(name));
+                entry.close();
+            }
+            dir.close();
+        }
+        for (size_t i = 0; i < names.size(); i++) sd->deleteFile(benchPath(names[i].c_str()).c_str());
+        fs.rmdir(STORAGE_BENCH_DIR);
+        DirListingCache::getInstance()->invalidatePath(String("D:") + STORAGE_BENCH_DIR);
+    }
+
+    void runSdTests() {
+        StorageHelper* sd = StorageHelper::getInstance();
+        SdFs& fs = sd->getFs();
+        String seq = benchPath("seq.bin");
+        uint8_t* buf = lease.data();
+
+        for (size_t b : BUF_SIZES) {
+            if (b > lease.size()) break;
+            fillPattern(buf, b);
+            uint32_t t0 = micros();
+            FsFile f = fs.open(seq.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
+            if (!f.isOpen()) return fail('D', "seq_write");
+            size_t done = 0;
+            while (done < SEQ_BYTES && f.write(buf, b) == b) done += b;
+            f.close();
+            row('D', "seq_write", b, done, (uint32_t)(done / b), micros() - t0);
+            SdSpaceTracker::getInstance()->noteFileResized(0, done);
+            sd->deleteFile(seq.c_str());
+        }
+        // Leave one copy for the read tests.
+        FsFile w = fs.open(seq.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
+        if (!w.isOpen()) return fail('D', "seq_read");
+        fillPattern(buf, lease.size());
+        size_t written = 0;
+        while (written < SEQ_BYTES && w.write(buf, lease.size()) == lease.size()) written += lease.size();
+        w.close();
+        SdSpaceTracker::getInstance()->noteFileResized(0, written);
+
+        for (size_t b : BUF_SIZES) {
+            if (b > lease.size()) break;
+            uint32_t t0 = micros();
+            FsFile f = fs.open(seq.c_str(), O_RDONLY);
+            if (!f.isOpen()) return fail('D', "seq_read");
+            size_t done = 0;
+            while (true) {
+                int n = f.read(buf, b);
+                if (n <= 0) break;
+                done += (size_t)n;
+            }
+            f.close();
+            row('D', "seq_read", b, done, (uint32_t)(done / b), micros() - t0);
+        }
+
+        FsFile f = fs.open(seq.c_str(), O_RDONLY);
+        if (f.isOpen() && f.fileSize() > RANDOM_SIZE) {
+            uint32_t span = (uint32_t)(f.fileSize() - RANDOM_SIZE);
+            uint32_t t0 = micros();
+            size_t done = 0;
+            for (uint16_t i = 0; i < RANDOM_READS; i++) {
+                f.seekSet(nextRandom() % span);
+                int n = f.read(buf, RANDOM_SIZE);
+                if (n > 0) done += (size_t)n;
+            }
+            row('D', "random_read", RANDOM_SIZE, done, RANDOM_READS, micros() - t0);
+        }
+        if (f.isOpen()) f.close();
+        sd->deleteFile(seq.c_str());
+
+        noteRoundTrip('D');
+
+        fillPattern(buf, SMALL_SIZE);
+        char name[24];
+        uint32_t t0 = micros();
+        uint16_t made = 0;
+        for (; made < SMALL_FILES; made++) {
+            snprintf(name, sizeof(name), "s%03u.txt", (unsigned)made);
+            if (!sd->writeFile(benchPath(name).c_str(), (const char*)buf, SMALL_SIZE)) break;
+        }
+        row('D', "small_create", SMALL_SIZE, 0, made, micros() - t0);
+
+        t0 = micros();
+        std::vector<FileListItem> items;
+        FsFile dir = fs.open(STORAGE_BENCH_DIR, O_RDONLY);
+        if (dir.isOpen()) {
+            SdDirScanner raw(fs.fatType());
+            if (!raw.scan(dir, items)) items.clear();
+            dir.close();
+        }
+        row('D', "dir_scan", made, 0, (uint32_t)items.size(), micros() - t0);
+
+        t0 = micros();
+        uint16_t removed = 0;
+        for (uint16_t i = 0; i < made; i++) {
+            snprintf(name, sizeof(name), "s%03u.txt", (unsigned)i);
+            if (sd->deleteFile(benchPath(name).c_str())) removed++;
+        }
+        row('D', "small_delete", SMALL_SIZE, 0, removed, micros() - t0);
+
+        for (uint8_t i = 0; i < FREE_COUNT_RUNS; i++) {
+            t0 = micros();
+            int32_t n = fs.freeClusterCount();
+            row('D', "free_cluster_count", i, 0, n >= 0 ? 1 : 0, micros() - t0);
+        }
+    }
+
+    // Whole-note save, open and copy through the editor's and file manager's paths.
+    void noteRoundTrip(char drive) {
+        if (!save_fn || !open_fn || !copy_fn) return fail(drive, "note_save");
+        String text;
+        if (!text.reserve(NOTE_BYTES + 1)) return fail(drive, "note_save");
+        for (size_t i = 0; i < NOTE_BYTES; i++) text += (char)((i % 64) == 63 ? '\n' : 'a' + (i % 26));
+        String path = String(drive) + ":" + benchPath("note.txt");
+        uint32_t t0 = micros();
+        if (!save_fn(path, text.c_str(), text.length())) return fail(drive, "note_save");
+        row(drive, "note_save", NOTE_BYTES, text.length(), 1, micros() - t0);
+
+        String back;
+        t0 = micros();
+        bool ok = open_fn(path, back);
+        row(drive, "note_open", NOTE_BYTES, back.length(), (ok && back == text) ? 1 : 0, micros() - t0);
+        back = "";
+
+        String copy = String(drive) + ":" + benchPath("copy.txt");
+        t0 = micros();
+        if (!copy_fn(path, copy)) return fail(drive, "note_copy");
+        row(drive, "note_copy", NOTE_BYTES, NOTE_BYTES, 1, micros() - t0);
+    }
+
+    static void fail(char drive, const char* test) { Serial.printf("%c,%s,0,0,0,0,FAIL\n", drive, test); }
+
+public:
+    static StorageBench* getInstance() {
+        if (!instance) instance = new StorageBench();
+        return instance;
+    }
+
+    void setNoteIo(std::function<bool(const String&, const char*, size_t)> save,
+                   std::function<bool(const String&, String&)> open,
+                   std::function<bool(const String&, const String&)> copy) {
+        save_fn = save;
+        open_fn = open;
+        copy_fn = copy;
+    }
+
+    // Collects a serial command line; runs the benchmark when one arrives.
+    // Loop task only, while no SD file is open.
+    void poll() {
+        while (Serial.available() > 0) {
+            int c = Serial.read();
+            if (c < 0) break;
+            if (c == '\r') continue;
+            if (c != '\n') {
+                if (line.length() < 32) line += (char)c;
+                continue;
+            }
+            String cmd = line;
+            line = "";
+            cmd.trim();
+            if (cmd == "bench") run(true, true);
+            else if (cmd == "bench L") run(true, false);
+            else if (cmd == "bench D") run(false, true);
+            else if (cmd == "heap") printHeap();
+        }
+    }
+
+    void printHeap() {
+        size_t dirs = 0;
+        size_t items = 0;
+        size_t name_bytes = 0;
+        DirListingCache::getInstance()->stats(dirs, items, name_bytes);
+        Serial.printf("[Heap] free=%lu largest=%lu min=%lu cache_dirs=%lu cache_items=%lu cache_names=%lu\n",
+                      (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMaxAllocHeap(),
+                      (unsigned long)ESP.getMinFreeHeap(), (unsigned long)dirs, (unsigned long)items,
+                      (unsigned long)name_bytes);
+    }
+
+    void run(bool lfs, bool sd) {
+        lease = ScratchPool::getInstance()->lease(BUF_SIZES[3], BUF_SIZES[1]);
+        if (!lease) {
+            Serial.println("[Bench] no scratch buffer");
+            return;
+        }
+        rng = 1;
+        Serial.println("drive,test,param,bytes,ops,us,rate");
+        if (lfs) runLfs();
+        if (sd) {
+            if (StorageHelper::getInstance()->isInitialized()) runSd();
+            else Serial.println("[Bench] D: not mounted");
+        }
+        Serial.println("[Bench] done");
+        lease.release();
+    }
+};
+
+constexpr size_t StorageBench::BUF_SIZES[];
+StorageBench* StorageBench::instance = nullptr;
+
+#endif
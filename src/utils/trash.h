@@ -0,0 +1,291 @@
+#ifndef TRASH_H
+#define TRASH_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include "../config.h"
+#include "storage.h"
+#include "sddelete.h"
+#include "lfsdir.h"
+
+// TrashBin - per-drive /.trash that force delete renames into (O(1) on both FAT and
+// LittleFS). Entries are named "<clock>-<seq>" with the clock in powered-on minutes,
+// so names sort oldest first and ages survive reboots. step() runs on the loop task
+// and purges the oldest entry while the device is idle and a limit is exceeded; a
+// move that leaves the drive under the free-space floor purges without waiting.
+class TrashBin {
+public:
+    static constexpr const char* DIR = "/.trash";
+    static constexpr const char* DIR_NAME = ".trash";
+
+private:
+    static constexpr uint16_t PURGE_OPS_PER_STEP = 16;
+    static constexpr uint32_t CHECK_INTERVAL_MS = 30000;
+    static constexpr uint32_t CLOCK_SAVE_MIN = 10;
+    static constexpr uint16_t SEQ_BLOCK = 64;  // sequence numbers reserved per NVS write
+
+    bool loaded;
+    uint32_t clock_base_min;
+    uint32_t clock_saved_min;
+    uint16_t seq;
+    uint16_t seq_limit;  // NVS holds this; seq may run up to it without a write
+    bool check_now;
+    uint32_t last_check_ms;
+    char purge_drive;
+    char urgent_drive;  // under the free-space floor after a move: purge even if not idle
+    String lfs_purge_root;
+    bool lfs_stuck;
+    bool sd_stuck;
+    SdTreeDeleter sd_purge;
+    static TrashBin* instance;
+
+    TrashBin()
+        : loaded(false), clock_base_min(0), clock_saved_min(0), seq(0), seq_limit(0), check_now(true), last_check_ms(0),
+          purge_drive(0), urgent_drive(0), lfs_purge_root(""), lfs_stuck(false), sd_stuck(false) {}
+
+    void load() {
+        if (loaded) return;
+        loaded = true;
+        Preferences prefs;
+        if (prefs.begin("trash", true)) {
+            clock_base_min = prefs.getUInt("clock", 0);
+            seq = prefs.getUShort("seq", 0);
+            prefs.end();
+        }
+        seq_limit = seq;  // numbers below it may be in use from the last session
+        clock_saved_min = clock_base_min;
+    }
+
+    uint32_t nowMin() {
+        load();
+        return clock_base_min + millis() / 60000UL;
+    }
+
+    void save() {
+        uint32_t now = nowMin();
+        Preferences prefs;
+        if (!prefs.begin("trash", false)) return;
+        prefs.putUInt("clock", now);
+        prefs.putUShort("seq", seq_limit);
+        prefs.end();
+        clock_saved_min = now;
+    }
+
+    static bool sdReady() { return StorageHelper::getInstance()->isInitialized(); }
+
+    static bool ensureDir(char drive) {
+        if (drive == 'L') return LittleFS.exists(DIR) || LittleFS.mkdir(DIR);
+        if (drive == 'D' && sdReady()) {
+            SdFs& fs = StorageHelper::getInstance()->getFs();
+            return fs.exists(DIR) || fs.mkdir(DIR);
+        }
+        return false;
+    }
+
+    // Oldest entry name and entry count of a drive's trash.
+    static bool oldestEntry(char drive, String& oldest, uint32_t& count) {
+        oldest = "";
+        count = 0;
+        uint32_t iter = 0;
+        if (drive == 'L') {
+            LfsDirIter dir(DIR);
+            if (!dir.isOpen()) return false;
+            String name;
+            bool is_dir = false;
+            while (dir.next(name, is_dir)) {
+                count++;
+                if (oldest.length() == 0 || strcmp(name.c_str(), oldest.c_str()) < 0) oldest = name;
+                if ((++iter & 0x0F) == 0) delay(0);
+            }
+            return count > 0;
+        }
+        if (drive != 'D' || !sdReady()) return false;
+        FsFile dir = StorageHelper::getInstance()->getFs().open(DIR, O_RDONLY);
+        if (!dir || !dir.isDir()) return false;
+        FsFile entry;
+        while (entry.openNext(&dir, O_RDONLY)) {
+            char name[64];
+            name[0] = '\0';
+            entry.getName(name, sizeof(name));
+            entry.close();
+            if (name[0] == '\0') continue;
+            count++;
+            if (oldest.length() == 0 || strcmp(name, oldest.c_str()) < 0) oldest = name;
+            if ((++iter & 0x0F) == 0) delay(0);
+        }
+        dir.close();
+        return count > 0;
+    }
+
+    static bool belowFreeFloor(char drive) {
+        uint64_t total = 0;
+        uint64_t free_bytes = 0;
+        if (drive == 'L') {
+            total = LittleFS.totalBytes();
+            uint64_t used = LittleFS.usedBytes();
+            free_bytes = (total > used) ? (total - used) : 0;
+        } else {
+            SdSpaceTracker* space = SdSpaceTracker::getInstance();
+            if (!space->isValid()) return false;
+            total = space->totalBytes();
+            free_bytes = space->freeBytes();
+        }
+        return total > 0 && free_bytes * 100ULL < total * (uint64_t)TRASH_MIN_FREE_PCT;
+    }
+
+    bool startPurge(char drive) {
+        if ((drive == 'L' && lfs_stuck) || (drive == 'D' && sd_stuck)) return false;
+        String oldest;
+        uint32_t count = 0;
+        if (!oldestEntry(drive, oldest, count)) return false;
+        uint32_t age = nowMin() - (uint32_t)strtoul(oldest.c_str(), nullptr, 16);
+        if (count <= TRASH_MAX_ENTRIES && age <= TRASH_MAX_AGE_MIN && !belowFreeFloor(drive)) return false;
+
+        String path = String(DIR) + "/" + oldest;
+        if (drive == 'L') {
+            lfs_purge_root = path;
+            purge_drive = 'L';
+            return true;
+        }
+        if (!sd_purge.begin(StorageHelper::getInstance()->getFs(), path)) {
+            sd_stuck = true;
+            return false;
+        }
+        purge_drive = 'D';
+        return true;
+    }
+
+    // Removes one leaf (file or empty directory) under lfs_purge_root; true when the
+    // root itself is gone.
+    bool purgeLfsLeaf() {
+        String cur = lfs_purge_root;
+        while (true) {
+            LfsDirIter dir(cur);
+            if (!dir.isOpen()) {
+                if (!LittleFS.remove(cur.c_str())) lfs_stuck = true;
+                return cur == lfs_purge_root;
+            }
+            String name;
+            bool is_dir = false;
+            if (!dir.next(name, is_dir)) {
+                dir.close();
+                if (!LittleFS.rmdir(cur.c_str())) lfs_stuck = true;
+                return cur == lfs_purge_root;
+            }
+            dir.close();
+            String child = cur + "/" + name;
+            if (is_dir) {
+                cur = child;
+                continue;
+            }
+            if (!LittleFS.remove(child.c_str())) lfs_stuck = true;
+            return false;
+        }
+    }
+
+    void finishPurge() {
+        purge_drive = 0;
+        lfs_purge_root = "";
+        check_now = true;  // more entries may still be over the limits
+    }
+
+    void stepPurge() {
+        if (purge_drive == 'D') {
+            // Batch per step only, so nothing stays unflushed between steps.
+            StorageHelper::getInstance()->beginBatch();
+            SdTreeDeleter::Status st = sd_purge.step(PURGE_OPS_PER_STEP);
+            StorageHelper::getInstance()->endBatch();
+            if (st == SdTreeDeleter::DEL_RUNNING) return;
+            if (!sd_purge.succeeded()) sd_stuck = true;
+            finishPurge();
+            return;
+        }
+        for (uint16_t i = 0; i < PURGE_OPS_PER_STEP; i++) {
+            bool done = purgeLfsLeaf();
+            if (done || lfs_stuck) {
+                finishPurge();
+                return;
+            }
+        }
+    }
+
+public:
+    static TrashBin* getInstance() {
+        if (!instance) instance = new TrashBin();
+        return instance;
+    }
+
+    static bool isTrashPath(const String& inner) {
+        return inner == DIR || inner.startsWith(String(DIR) + "/");
+    }
+
+    // True for the trash and search index directories in a root listing.
+    static bool isHiddenEntry(const String& dir_inner, const String& name) {
+        if (dir_inner.length() != 0 && dir_inner != "/") return false;
+        return name == DIR_NAME || name == INDEX_DIR_NAME;
+    }
+
+    // Renames inner (file or directory) into the drive's trash. Loop/UI task only.
+    bool moveToTrash(char drive, const String& inner) {
+        if (inner.length() == 0 || inner == "/" || isTrashPath(inner)) return false;
+        if (drive == 'D' && !sdReady()) return false;
+        if (!ensureDir(drive)) return false;
+        load();
+        if (seq == seq_limit) {
+            seq_limit = (uint16_t)(seq + SEQ_BLOCK);
+            save();
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%s/%08lx-%04x", DIR, (unsigned long)nowMin(), (unsigned)seq);
+        bool ok = (drive == 'L') ? LittleFS.rename(inner.c_str(), name)
+                                 : StorageHelper::getInstance()->getFs().rename(inner.c_str(), name);
+        if (!ok) {
+            Serial.println("[TRASH] rename failed: " + inner);
+            return false;
+        }
+        seq++;
+        if (drive == 'L') lfs_stuck = false;
+        else sd_stuck = false;
+        check_now = true;
+        if (belowFreeFloor(drive)) urgent_drive = drive;
+        return true;
+    }
+
+    // SD went away: drop any handles held by a running purge.
+    void onSdRemoved() {
+        if (purge_drive == 'D') {
+            sd_purge.cancel();
+            purge_drive = 0;
+        }
+        if (urgent_drive == 'D') urgent_drive = 0;
+        sd_stuck = false;
+    }
+
+    // Loop task, only while no file operation is running. Purges only when idle,
+    // unless a move left the drive under the free-space floor.
+    void step(bool idle) {
+        if (!idle && urgent_drive == 0) return;
+        if (purge_drive != 0) {
+            if (purge_drive == 'D' && !sdReady()) onSdRemoved();
+            else stepPurge();
+            return;
+        }
+        if (urgent_drive != 0) {
+            // Oldest first until the floor is met again or the trash is empty.
+            char d = urgent_drive;
+            urgent_drive = 0;
+            if ((d == 'L' || sdReady()) && belowFreeFloor(d) && startPurge(d)) urgent_drive = d;
+            return;
+        }
+        if (!check_now && (millis() - last_check_ms) < CHECK_INTERVAL_MS) return;
+        check_now = false;
+        last_check_ms = millis();
+        if (nowMin() - clock_saved_min >= CLOCK_SAVE_MIN) save();
+        if (!startPurge('L')) startPurge('D');
+    }
+};
+
+TrashBin* TrashBin::instance = nullptr;
+
+#endif
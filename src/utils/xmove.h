@@ -0,0 +1,499 @@
+#ifndef XMOVE_H
+#define XMOVE_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include "storage.h"
+#include "listing.h"
+#include "lfsdir.h"
+#include "bufpool.h"
+#include "fileindex.h"
+#include "notecodec.h"
+
+// CrossDriveMove - moves a file or tree between L: and D: one file at a time:
+// stream-copy with CRC32, re-read the copy to verify, then delete the source file.
+// Peak extra space is the largest single file, not the whole tree. Compressed notes
+// moved off L: are decoded on the way (the CRC covers the plain text).
+// The walk always takes the first remaining source entry, so moved files simply
+// disappear from the walk and an interrupted move resumes by starting over.
+// NVS ("xmove") journals only the move itself (src, dst), written once by begin()
+// and cleared when it ends. The destination must not exist, so a file found in
+// both places on resume is the in-flight one: its copy is checked against the
+// source by CRC and either kept (the source is removed) or dropped and redone.
+// Loop/UI task only (touches SD).
+class CrossDriveMove {
+public:
+    enum Status {
+        XM_IDLE,
+        XM_RUNNING,
+        XM_DONE,
+        XM_FAILED
+    };
+
+private:
+    static constexpr size_t BUF_SIZE = 8192;  // preferred scratch lease
+    static constexpr uint32_t BG_BYTES_PER_STEP = 8192;
+
+    enum Phase {
+        PH_FIND,
+        PH_CHECK,  // hash the source of a leftover copy
+        PH_COPY,
+        PH_VERIFY
+    };
+
+    // One open file on either drive.
+    struct DriveFile {
+        char drive;
+        File lfs;
+        FsFile sd;
+        NoteCodec::Reader<File> note;
+
+        DriveFile() : drive(0) {}
+
+        // decode: read a compressed L: note as its plain text.
+        bool openRead(char d, const String& path, bool decode = false) {
+            drive = d;
+            if (d == 'L') {
+                lfs = LittleFS.open(path.c_str(), "r");
+                if (!lfs || lfs.isDirectory()) return false;
+                if (!decode) return true;
+                bool compressed = false;
+                uint32_t raw_len = 0;
+                if (!NoteCodec::probe(lfs, (uint64_t)lfs.size(), compressed, raw_len)) return false;
+                return !compressed || note.begin(lfs, raw_len);
+            }
+            sd = StorageHelper::getInstance()->getFs().open(path.c_str(), O_RDONLY);
+            return sd && !sd.isDir();
+        }
+
+        bool openWrite(char d, const String& path) {
+            drive = d;
+            if (d == 'L') {
+                lfs = LittleFS.open(path.c_str(), "w");
+                return (bool)lfs;
+            }
+            sd = StorageHelper::getInstance()->getFs().open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
+            return (bool)sd;
+        }
+
+        uint64_t size() {
+            if (note.isActive()) return note.rawLength();
+            return drive == 'L' ? (uint64_t)lfs.size() : (uint64_t)sd.fileSize();
+        }
+        int read(uint8_t* b, size_t n) {
+            if (note.isActive()) return note.read(b, n);
+            return drive == 'L' ? (int)lfs.read(b, n) : sd.read(b, n);
+        }
+        int write(const uint8_t* b, size_t n) { return drive == 'L' ? (int)lfs.write(b, n) : (int)sd.write(b, n); }
+
+        void close() {
+            note.end();
+            if (lfs) lfs.close();
+            if (sd) sd.close();
+        }
+    };
+
+    enum Probe {
+        PROBE_MISSING,
+        PROBE_FILE,
+        PROBE_EMPTY_DIR,
+        PROBE_DIR
+    };
+
+    bool active;
+    bool background;
+    bool journal_checked;
+    Phase phase;
+    char src_drive;
+    char dst_drive;
+    String src_root;
+    String dst_root;
+    String cur_rel;
+    DriveFile in;
+    DriveFile out;
+    uint64_t cur_size;
+    uint64_t cur_done;
+    uint32_t crc;
+    uint32_t verify_crc;
+    bool leftover;  // verifying a copy found in place, not one just written
+    uint64_t done_bytes;
+    uint32_t done_files;
+    uint64_t peak_bytes;
+    uint32_t started_ms;
+    ScratchLease lease;  // held only while a move is active
+    uint8_t* buf;
+    size_t buf_size;
+    static CrossDriveMove* instance;
+
+    CrossDriveMove()
+        : active(false), background(false), journal_checked(false), phase(PH_FIND), src_drive(0), dst_drive(0),
+          cur_size(0), cur_done(0), crc(0), verify_crc(0), leftover(false), done_bytes(0), done_files(0), peak_bytes(0),
+          started_ms(0), buf(nullptr), buf_size(0) {}
+
+    static uint32_t crc32Update(uint32_t c, const uint8_t* p, size_t n) {
+        c = ~c;
+        while (n--) {
+            c ^= *p++;
+            for (uint8_t k = 0; k < 8; k++) c = (c >> 1) ^ (0xEDB88320UL & (0UL - (c & 1UL)));
+        }
+        return ~c;
+    }
+
+    static bool driveReady(char d) {
+        return d == 'L' || (d == 'D' && StorageHelper::getInstance()->isInitialized());
+    }
+
+    static Probe probe(char d, const String& path, String& first, bool& first_is_dir) {
+        if (d == 'L') {
+            LfsDirIter dir(path);
+            if (!dir.isOpen()) return LittleFS.exists(path.c_str()) ? PROBE_FILE : PROBE_MISSING;
+            return dir.next(first, first_is_dir) ? PROBE_DIR : PROBE_EMPTY_DIR;
+        }
+        FsFile node = StorageHelper::getInstance()->getFs().open(path.c_str(), O_RDONLY);
+        if (!node) return PROBE_MISSING;
+        if (!node.isDir()) return PROBE_FILE;
+        FsFile entry;
+        while (entry.openNext(&node, O_RDONLY)) {
+            char name[256];
+            name[0] = '\0';
+            entry.getName(name, sizeof(name));
+            first_is_dir = entry.isDir();
+            entry.close();
+            if (name[0] == '\0') continue;
+            first = name;
+            return PROBE_DIR;
+        }
+        return PROBE_EMPTY_DIR;
+    }
+
+    static bool ensureDir(char d, const String& path) {
+        if (d == 'L') return LittleFS.exists(path.c_str()) || LittleFS.mkdir(path.c_str());
+        SdFs& fs = StorageHelper::getInstance()->getFs();
+        if (fs.exists(path.c_str())) return true;
+        if (!fs.mkdir(path.c_str(), true)) return false;
+        SdSpaceTracker::getInstance()->noteDirCreated();
+        return true;
+    }
+
+    static bool removeDir(char d, const String& path) {
+        if (d == 'L') return LittleFS.rmdir(path.c_str());
+        if (!StorageHelper::getInstance()->getFs().rmdir(path.c_str())) return false;
+        SdSpaceTracker::getInstance()->noteDirRemoved();
+        return true;
+    }
+
+    static bool exists(char d, const String& path) {
+        if (d == 'L') return LittleFS.exists(path.c_str());
+        return StorageHelper::getInstance()->getFs().exists(path.c_str());
+    }
+
+    static bool removeFile(char d, const String& path) {
+        if (d == 'L') return !LittleFS.exists(path.c_str()) || LittleFS.remove(path.c_str());
+        SdFs& fs = StorageHelper::getInstance()->getFs();
+        FsFile f = fs.open(path.c_str(), O_RDONLY);
+        if (!f) return true;
+        uint64_t size = f.isDir() ? 0 : f.fileSize();
+        f.close();
+        if (!fs.remove(path.c_str())) return false;
+        SdSpaceTracker::getInstance()->noteFreed(size);
+        return true;
+    }
+
+    String srcPath(const String& rel) const { return src_root + rel; }
+    String dstPath(const String& rel) const { return dst_root + rel; }
+
+    void clearJournal() {
+        Preferences prefs;
+        if (!prefs.begin("xmove", false)) return;
+        prefs.clear();
+        prefs.end();
+    }
+
+    void invalidateRoots() {
+        DirListingCache* cache = DirListingCache::getInstance();
+        cache->invalidatePath(String(src_drive) + ":" + src_root);
+        cache->invalidatePath(String(dst_drive) + ":" + dst_root);
+    }
+
+    bool startFile(const String& rel) {
+        cur_rel = rel;
+        leftover = exists(dst_drive, dstPath(rel));
+        if (!in.openRead(src_drive, srcPath(rel), dst_drive != 'L')) {
+            in.close();
+            return false;
+        }
+        if (leftover) {
+            Serial.println("[XMOVE] checking leftover copy of " + rel);
+            cur_size = in.size();
+            crc = 0;
+            phase = PH_CHECK;
+            return true;
+        }
+        if (!out.openWrite(dst_drive, dstPath(rel))) {
+            in.close();
+            return false;
+        }
+        cur_size = in.size();
+        cur_done = 0;
+        crc = 0;
+        if (cur_size > peak_bytes) peak_bytes = cur_size;
+        phase = PH_COPY;
+        return true;
+    }
+
+    // Takes the first remaining source entry: descends into directories, removes
+    // emptied ones, and starts the first file found.
+    Status stepFind() {
+        String rel;
+        while (true) {
+            String first;
+            bool first_is_dir = false;
+            Probe pr = probe(src_drive, srcPath(rel), first, first_is_dir);
+            if (pr == PROBE_MISSING) return rel.length() == 0 ? finish(true) : fail();
+            if (pr == PROBE_FILE) return startFile(rel) ? XM_RUNNING : fail();
+            if (pr == PROBE_EMPTY_DIR) {
+                if (!removeDir(src_drive, srcPath(rel))) return fail();
+                if (rel.length() == 0) return finish(true);
+                invalidateRoots();
+                return XM_RUNNING;
+            }
+            String child = rel + "/" + first;
+            if (first_is_dir) {
+                if (!ensureDir(dst_drive, dstPath(child))) return fail();
+                rel = child;
+                continue;
+            }
+            return startFile(child) ? XM_RUNNING : fail();
+        }
+    }
+
+    Status stepCopy(uint32_t budget) {
+        while (budget > 0) {
+            size_t want = (budget < buf_size) ? budget : buf_size;
+            int n = in.read(buf, want);
+            if (n < 0) return fail();
+            if (n == 0) {
+                in.close();
+                out.close();
+                if (dst_drive == 'D') SdSpaceTracker::getInstance()->noteAllocated(cur_done);
+                if (cur_done != cur_size || !in.openRead(dst_drive, dstPath(cur_rel))) return fail();
+                verify_crc = 0;
+                phase = PH_VERIFY;
+                return XM_RUNNING;
+            }
+            if (out.write(buf, (size_t)n) != n) return fail();
+            crc = crc32Update(crc, buf, (size_t)n);
+            cur_done += (uint64_t)n;
+            done_bytes += (uint64_t)n;
+            budget -= (budget < (uint32_t)n) ? budget : (uint32_t)n;
+        }
+        return XM_RUNNING;
+    }
+
+    Status stepCheck(uint32_t budget) {
+        while (budget > 0) {
+            size_t want = (budget < buf_size) ? budget : buf_size;
+            int n = in.read(buf, want);
+            if (n < 0) return fail();
+            if (n == 0) {
+                in.close();
+                if (!in.openRead(dst_drive, dstPath(cur_rel))) return fail();
+                verify_crc = 0;
+                phase = PH_VERIFY;
+                return XM_RUNNING;
+            }
+            crc = crc32Update(crc, buf, (size_t)n);
+            budget -= (budget < (uint32_t)n) ? budget : (uint32_t)n;
+        }
+        return XM_RUNNING;
+    }
+
+    Status stepVerify(uint32_t budget) {
+        while (budget > 0) {
+            size_t want = (budget < buf_size) ? budget : buf_size;
+            int n = in.read(buf, want);
+            if (n < 0) return fail();
+            if (n == 0) {
+                in.close();
+                if (verify_crc != crc) {
+                    if (!leftover) return fail();
+                    // Torn by a power loss: drop it, the next find copies the file again.
+                    if (!removeFile(dst_drive, dstPath(cur_rel))) return fail();
+                    leftover = false;
+                    phase = PH_FIND;
+                    return XM_RUNNING;
+                }
+                if (!removeFile(src_drive, srcPath(cur_rel))) return fail();
+                leftover = false;
+                done_files++;
+                invalidateRoots();
+                cur_rel = "";
+                phase = PH_FIND;
+                return XM_RUNNING;
+            }
+            verify_crc = crc32Update(verify_crc, buf, (size_t)n);
+            budget -= (budget < (uint32_t)n) ? budget : (uint32_t)n;
+        }
+        return XM_RUNNING;
+    }
+
+    // Drops the partial copy of the in-flight file; the source still has it.
+    void rollbackCurrent() {
+        in.close();
+        out.close();
+        if (phase != PH_FIND && driveReady(dst_drive)) removeFile(dst_drive, dstPath(cur_rel));
+        leftover = false;
+        phase = PH_FIND;
+    }
+
+    void dropBuffer() {
+        lease.release();
+        buf = nullptr;
+        buf_size = 0;
+    }
+
+    Status finish(bool ok) {
+        in.close();
+        out.close();
+        dropBuffer();
+        active = false;
+        background = false;
+        clearJournal();
+        invalidateRoots();
+        FileIndex::getInstance()->noteChanged(src_drive, src_root);
+        FileIndex::getInstance()->noteChanged(dst_drive, dst_root);
+        uint32_t ms = millis() - started_ms;
+        uint32_t kbps = ms ? (uint32_t)((done_bytes * 1000ULL / ms) / 1024ULL) : 0;
+        Serial.printf("[XMOVE] %c:%s -> %c:%s %s: %lu files, %llu bytes, %lu ms (%lu KB/s), peak extra %llu bytes\n",
+                      src_drive, src_root.c_str(), dst_drive, dst_root.c_str(), ok ? "done" : "stopped",
+                      (unsigned long)done_files, (unsigned long long)done_bytes, (unsigned long)ms,
+                      (unsigned long)kbps, (unsigned long long)peak_bytes);
+        return ok ? XM_DONE : XM_FAILED;
+    }
+
+    Status fail() {
+        if (!driveReady(src_drive) || !driveReady(dst_drive)) {
+            // A drive went away: keep the journal so the next mount/boot repairs it.
+            in.close();
+            out.close();
+            dropBuffer();
+            active = false;
+            background = false;
+            journal_checked = false;
+            Serial.println("[XMOVE] drive unavailable, move suspended");
+            return XM_FAILED;
+        }
+        rollbackCurrent();
+        return finish(false);
+    }
+
+    bool prepare(const String& src_vpath, const String& dst_vpath) {
+        if (src_vpath.length() < 3 || dst_vpath.length() < 3) return false;
+        src_drive = src_vpath.charAt(0);
+        dst_drive = dst_vpath.charAt(0);
+        src_root = src_vpath.substring(2);
+        dst_root = dst_vpath.substring(2);
+        if (src_root == "/" || dst_root == "/" || src_drive == dst_drive) return false;
+        if (!driveReady(src_drive) || !driveReady(dst_drive)) return false;
+        if (!lease) lease = ScratchPool::getInstance()->lease(BUF_SIZE);
+        if (!lease) return false;
+        buf = lease.data();
+        buf_size = lease.size();
+        phase = PH_FIND;
+        cur_rel = "";
+        done_bytes = 0;
+        done_files = 0;
+        peak_bytes = 0;
+        started_ms = millis();
+        return true;
+    }
+
+public:
+    static CrossDriveMove* getInstance() {
+        if (!instance) instance = new CrossDriveMove();
+        return instance;
+    }
+
+    // src/dst are "X:/inner"; dst must not exist yet.
+    bool begin(const String& src_vpath, const String& dst_vpath) {
+        if (active) return false;
+        if (!prepare(src_vpath, dst_vpath) || exists(dst_drive, dst_root)) {
+            dropBuffer();
+            return false;
+        }
+        String first;
+        bool first_is_dir = false;
+        Probe pr = probe(src_drive, src_root, first, first_is_dir);
+        Preferences prefs;
+        if (pr == PROBE_MISSING || (pr != PROBE_FILE && !ensureDir(dst_drive, dst_root)) ||
+            !prefs.begin("xmove", false)) {
+            dropBuffer();
+            return false;
+        }
+        prefs.putString("src", src_vpath);
+        prefs.putString("dst", dst_vpath);
+        prefs.end();
+        active = true;
+        background = false;
+        journal_checked = true;
+        return true;
+    }
+
+    Status step(uint32_t byte_budget) {
+        if (!active) return XM_IDLE;
+        if (!driveReady(src_drive) || !driveReady(dst_drive)) return fail();
+        if (phase == PH_FIND) return stepFind();
+        if (phase == PH_CHECK) return stepCheck(byte_budget);
+        if (phase == PH_COPY) return stepCopy(byte_budget);
+        return stepVerify(byte_budget);
+    }
+
+    // Stops after rolling back the in-flight file; files already moved stay moved.
+    void cancel() {
+        if (!active) return;
+        rollbackCurrent();
+        finish(false);
+    }
+
+    // Loop task, while the file manager is idle: resumes a journalled move left by a
+    // power loss (startFile() settles the in-flight file) and drives it to completion.
+    void stepBackground(bool sd_ready) {
+        if (active) {
+            if (background) step(BG_BYTES_PER_STEP);
+            return;
+        }
+        if (journal_checked) return;
+        Preferences prefs;
+        if (!prefs.begin("xmove", true)) {
+            journal_checked = true;
+            return;
+        }
+        String src = prefs.getString("src", "");
+        String dst = prefs.getString("dst", "");
+        prefs.end();
+        if (src.length() < 3 || dst.length() < 3) {
+            journal_checked = true;
+            return;
+        }
+        if ((src.charAt(0) == 'D' || dst.charAt(0) == 'D') && !sd_ready) return;  // wait for the card
+        journal_checked = true;
+        if (!prepare(src, dst)) {
+            dropBuffer();
+            clearJournal();
+            return;
+        }
+        Serial.println("[XMOVE] resuming interrupted move " + src + " -> " + dst);
+        active = true;
+        background = true;
+    }
+
+    bool isActive() const { return active; }
+    bool isBackground() const { return background; }
+    uint64_t doneBytes() const { return done_bytes; }
+    uint32_t doneFiles() const { return done_files; }
+};
+
+CrossDriveMove* CrossDriveMove::instance = nullptr;
+
+#endif